@@ -33,16 +33,30 @@
 // ==========================================================================
 
 #include <iostream>
+#include <string>
 
 #include <seqan/stream.h>  // for IOError
 
 #include "bam_realigner_app.h"
 #include "bam_realigner_options.h"
+#include "msa_dump.h"
+#include "shard_merger.h"
 
 int main(int argc, char ** argv)
 {
     try
     {
+        if (argc >= 2 && std::string(argv[1]) == "merge")
+        {
+            mergeShards(parseMergeCommandLine(argc - 1, argv + 1));
+            return 0;
+        }
+        if (argc >= 2 && std::string(argv[1]) == "render-msas")
+        {
+            renderMsas(parseRenderMsasCommandLine(argc - 1, argv + 1));
+            return 0;
+        }
+
         BamRealignerOptions options = parseCommandLine(argc, argv);
         BamRealignerApp app(options);
         app.run();
@@ -34,19 +34,105 @@
 
 #include "bam_realigner_app.h"
 
+#include <condition_variable>
+#include <algorithm>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <istream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 
 #include <seqan/bam_io.h>
 #include <seqan/seq_io.h>
-#include <seqan/simple_intervals_io.h>
 
 #include "bam_realigner_options.h"
+#include "bam_writer.h"
+#include "bgzf_io.h"
+#include "blocking_queue.h"
+#include "cram_io.h"
+#include "interval_planner.h"
+#include "mate_fixer.h"
+#include "msa_dump.h"
 #include "realigner_step.h"
+#include "record_cache.h"
+#include "reference_provider.h"
+#include "shard_planner.h"
+#include "step_stats.h"
+#include "streaming_realigner.h"
+#include "target_discoverer.h"
+#include "target_reader.h"
 
 namespace {  // anonymous namespace
 
+// ---------------------------------------------------------------------------
+// Class WorkerInput
+// ---------------------------------------------------------------------------
+
+// Input files of one worker thread.  The files keep a read position and buffers, so each worker needs its own; the
+// BAI index is only read from and shared between all workers.
+
+class WorkerInput
+{
+public:
+    seqan::BamFileIn bamFileIn;
+    // Only opened for CRAM input, bamFileIn then only holds the reference names.
+    std::unique_ptr<CramFileIn> cramFileIn;
+    seqan::FaiIndex faiIndex;
+    std::unique_ptr<RecordCache> recordCache;
+    std::unique_ptr<ReferenceProvider> referenceProvider;
+};
+
+// Number of consecutive windows a worker picks at once, so its record cache can serve neighbouring windows.
+unsigned const WINDOW_BATCH_SIZE = 16;
+
+// Number of windows buffered between the stages of the pipeline, in addition to the one each stage works on.
+unsigned const PIPELINE_DEPTH = 1;
+
+// ---------------------------------------------------------------------------
+// Class PrefetchedWindow
+// ---------------------------------------------------------------------------
+
+// A window with its records and reference sequence, loaded ahead of realignment.
+
+class PrefetchedWindow
+{
+public:
+    // Index of the window.
+    unsigned idx;
+    // The result to fill, with the loading times.
+    std::unique_ptr<RealignerStepResult> result;
+    // The records of the window.
+    std::vector<seqan::BamAlignmentRecord> records;
+    // The reference sequence of refRegion.
+    seqan::GenomicRegion refRegion;
+    seqan::Dna5String ref;
+
+    PrefetchedWindow() : idx(0)
+    {}
+};
+
+// Returns region, extended by the records on its contig including their soft-clipped ends.  This contains the region
+// that RealignerStep extends the window to.
+seqan::GenomicRegion recordsExtent(seqan::GenomicRegion region, std::vector<seqan::BamAlignmentRecord> const & records)
+{
+    for (auto const & record : records)
+    {
+        if (record.rID != region.rID || record.beginPos < 0)
+            continue;
+        int beginPos = record.beginPos, endPos = beginPos + getAlignmentLengthInRef(record);
+        for (unsigned i = 0; i < length(record.cigar) && record.cigar[i].operation == 'S'; ++i)
+            beginPos -= record.cigar[i].count;
+        for (unsigned i = length(record.cigar); i > 0 && record.cigar[i - 1].operation == 'S'; --i)
+            endPos += record.cigar[i - 1].count;
+        region.beginPos = std::min((int)region.beginPos, std::max(0, beginPos));
+        region.endPos = std::max((int)region.endPos, endPos);
+    }
+    return region;
+}
+
 }  // anonymous namespace
 
 // ---------------------------------------------------------------------------
@@ -68,31 +154,84 @@ private:
     void openFai();
     // Open input BAM file and bai index.
     void openBamIn();
-    // Open intervals file.
-    void openIntervals();
+    // Open input CRAM file and crai index, called by openBamIn().
+    void openCramIn();
 
     // Open output BAM file.
     void openBamOut();
     // Open output MSA txt file.
     void openMsasTxtOut();
+    // Open output binary MSA dump file.
+    void openMsasBinOut();
+
+    // Open per-thread input files.
+    void openWorkerInputs();
+    // Open the input files of input.
+    void openWorkerInput(WorkerInput & input);
+
+    // Load all regions from the targets file and/or discover them from the BAM file, translate their reference names
+    // to reference IDs and plan the windows.
+    void loadRegions();
+    // Append the targets discovered by a sweep over the input BAM file to regions.
+    void discoverRegions();
 
-    // Process regions one-by-one.
+    // Process regions one-by-one or in parallel.
     void processAllRegions();
-    void processOneRegion(seqan::GenomicRegion const & region);
+    void processStreaming();
+    void processAllRegionsParallel();
+    void processAllRegionsPipelined();
+    void processOneRegion(RealignerStepResult & result,
+                          RecordCache & recordCache,
+                          RealignerStep & step,
+                          RealignmentWindow const & window);
+    // Write out result of one region and add its stats to the report.
+    void writeResult(RealignerStepResult & result);
+    // Write the stats and skipped windows reports if requested.
+    void writeStats() const;
+    // Print progress for window with the given index.
+    void printProgress(unsigned idx) const;
+    // Print record and reference cache counters, summed over all threads.
+    void printCacheStats() const;
 
     // Program configuration.
     BamRealignerOptions options;
 
-    // Objects used for I/O.
+    // Objects used for I/O.  bamFileOut is not opened, it provides the context for bamWriter.
     seqan::BamFileOut bamFileOut;
+    std::unique_ptr<BamWriter> bamWriter;
+    // Updates the mates of moved records on output, writes to bamWriter.
+    std::unique_ptr<MateFixer> mateFixer;
     seqan::VirtualStream<char, seqan::Output> msasTxtOut;
+    std::unique_ptr<MsaDumpWriter> msasBinOut;
     seqan::FaiIndex faiIndex;
+    // Decompresses the input BAM file in parallel for bamFileIn, only used with --streaming and --io-threads > 1.
+    std::unique_ptr<BgzfInputBuffer> bgzfInputBuffer;
+    std::unique_ptr<std::istream> bgzfInputStream;
     seqan::BamFileIn bamFileIn;
     seqan::BamIndex<seqan::Bai> baiIndex;
-    seqan::SimpleIntervalsFileIn intervalsFileIn;
+    // Reads the input for CRAM files (with its CRAI index), bamFileIn is then not opened and only holds the reference
+    // names.
+    std::unique_ptr<CramFileIn> cramFileIn;
+    // Cache of records read from bamFileIn.
+    std::unique_ptr<RecordCache> recordCache;
+    // Provides reference windows from faiIndex.
+    std::unique_ptr<ReferenceProvider> referenceProvider;
+
+    // Input files for worker threads, only used with more than one thread.
+    std::vector<std::unique_ptr<WorkerInput>> workerInputs;
+    // Input files for the prefetch thread, only used with --pipeline.
+    std::unique_ptr<WorkerInput> prefetchInput;
 
     // BAM header is read into this variable.
     seqan::BamHeader bamHeader;
+
+    // The target regions, in the order of the targets file followed by the discovered ones.
+    std::vector<seqan::GenomicRegion> regions;
+    // The windows to process, sorted by coordinate.
+    std::vector<RealignmentWindow> windows;
+
+    // Per-window counters and timings, only collected when writing them out.
+    StatsReport statsReport;
 };
 
 void BamRealignerAppImpl::run()
@@ -115,7 +254,7 @@ void BamRealignerAppImpl::run()
 
     openFai();
     openBamIn();
-    openIntervals();
+    openWorkerInputs();
 
     // Open Input Files
 
@@ -128,12 +267,103 @@ void BamRealignerAppImpl::run()
 
     openBamOut();
     openMsasTxtOut();
+    openMsasBinOut();
 
     // Process Intervals
 
-    processAllRegions();
+    loadRegions();
+    if (options.streaming)
+        processStreaming();
+    else if (options.numThreads > 1)
+        processAllRegionsParallel();
+    else if (options.pipeline)
+        processAllRegionsPipelined();
+    else
+        processAllRegions();
 
     // Writing Output
+
+    mateFixer->close();
+    if (options.verbosity >= 1)
+        mateFixer->printStats(std::cerr);
+    bamWriter->close();
+    if (msasBinOut)
+        msasBinOut->close();
+    writeStats();
+}
+
+void BamRealignerAppImpl::loadRegions()
+{
+    if (!options.inIntervalsPath.empty())
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Reading targets from " << options.inIntervalsPath << " ...";
+        readTargets(regions, options.inIntervalsPath, bamFileIn);
+        if (options.verbosity >= 1)
+            std::cerr << " OK (" << regions.size() << " targets)\n";
+    }
+    if (options.discoverTargets)
+        discoverRegions();
+
+    planWindows(windows, regions, options);
+    if (options.verbosity >= 1)
+        std::cerr << "    Planned " << windows.size() << " windows from " << regions.size() << " target regions\n";
+
+    if (options.numShards > 1)
+    {
+        double numReads = selectShard(windows, baiIndex, options.shardIndex, options.numShards);
+        if (options.verbosity >= 1)
+            std::cerr << "    Shard " << (options.shardIndex + 1) << "/" << options.numShards << " has "
+                      << windows.size() << " windows with about " << (uint64_t)numReads << " reads\n";
+    }
+}
+
+// Discovery sweeps over its own BamFileIn so bamFileIn keeps its position for --streaming.
+
+void BamRealignerAppImpl::discoverRegions()
+{
+    if (options.verbosity >= 1)
+        std::cerr << "    Discovering targets from " << options.inAlignmentPath << " ...\n";
+    seqan::BamFileIn discoveryBamFileIn;
+    std::unique_ptr<CramFileIn> discoveryCramFileIn;
+    std::unique_ptr<BgzfInputBuffer> discoveryInputBuffer;
+    std::unique_ptr<std::istream> discoveryInputStream;
+    seqan::BamHeader header;
+    if (cramFileIn)
+    {
+        discoveryCramFileIn.reset(new CramFileIn(options.inAlignmentPath, options.inReferencePath,
+                                                 options.numIOThreads));
+        discoveryCramFileIn->readHeader(header, discoveryBamFileIn);
+    }
+    else if (options.numIOThreads > 1 && isBamPath(options.inAlignmentPath))
+    {
+        discoveryInputBuffer.reset(new BgzfInputBuffer(options.inAlignmentPath, options.numIOThreads));
+        discoveryInputStream.reset(new std::istream(discoveryInputBuffer.get()));
+        if (!open(discoveryBamFileIn, *discoveryInputStream, seqan::Bam()))
+            throw seqan::IOError("Could not open BAM file.");
+    }
+    else if (!open(discoveryBamFileIn, options.inAlignmentPath.c_str()))
+    {
+        throw seqan::IOError("Could not open BAM file.");
+    }
+    if (!discoveryCramFileIn)
+        readRecord(header, discoveryBamFileIn);
+
+    size_t numBefore = regions.size();
+    uint64_t numRecords = discoverTargets(regions, discoveryBamFileIn, discoveryCramFileIn.get(), *referenceProvider,
+                                          options);
+    if (options.verbosity >= 1)
+        std::cerr << "    Discovered " << (regions.size() - numBefore) << " targets in " << numRecords
+                  << " records\n";
+}
+
+void BamRealignerAppImpl::printProgress(unsigned idx) const
+{
+    seqan::CharString buffer;
+    windows[idx].region.toString(buffer);
+    // std::cerr << "\r                                                   "
+    //           << "\rProcessing (#" << no << ") " << buffer << std::flush;
+    std::cerr << "Processing (#" << (idx + 1) << ") " << buffer << "\n";
 }
 
 void BamRealignerAppImpl::processAllRegions()
@@ -142,26 +372,305 @@ void BamRealignerAppImpl::processAllRegions()
               << "__PROCESSING REGIONS_____________________________________________\n"
               << "\n";
 
-    seqan::GenomicRegion region;
-    for (unsigned no = 1; !atEnd(intervalsFileIn); ++no)
+    RealignerStep step(*referenceProvider, options);
+    for (unsigned idx = 0; idx < windows.size(); ++idx)
+    {
+        printProgress(idx);
+
+        RealignerStepResult result;
+        processOneRegion(result, *recordCache, step, windows[idx]);
+        writeResult(result);
+    }
+
+    std::cerr << " DONE\n";
+    printCacheStats();
+}
+
+// The workers pick batches of consecutive windows in order and the main thread writes out the results in the same
+// order, so the output is the same as when using one thread.  The number of windows in flight is limited to bound the
+// memory used for buffering results of windows that are done before their predecessors.
+
+void BamRealignerAppImpl::processAllRegionsParallel()
+{
+    if (options.pipeline && options.verbosity >= 1)
+        std::cerr << "WARNING: --pipeline is ignored with more than one thread.\n";
+    std::cerr << "\n"
+              << "__PROCESSING REGIONS_____________________________________________\n"
+              << "\n";
+
+    unsigned const maxInFlight = 2 * WINDOW_BATCH_SIZE * options.numThreads;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::unique_ptr<RealignerStepResult>> results(windows.size());
+    unsigned nextRegion = 0;   // next region to pick by a worker
+    unsigned nextToWrite = 0;  // next region to write out by the main thread
+    std::exception_ptr error;  // first error from a worker, if any
+
+    auto workerFunc = [&](WorkerInput & input) {
+        RealignerStep step(*input.referenceProvider, options);
+        while (true)
+        {
+            unsigned batchBegin = 0, batchEnd = 0;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() {
+                        return error || nextRegion >= windows.size() || nextRegion < nextToWrite + maxInFlight;
+                    });
+                if (error || nextRegion >= windows.size())
+                    return;
+                batchBegin = nextRegion;
+                batchEnd = std::min((unsigned)windows.size(), batchBegin + WINDOW_BATCH_SIZE);
+                nextRegion = batchEnd;
+            }
+
+            for (unsigned idx = batchBegin; idx < batchEnd; ++idx)
+            {
+                std::unique_ptr<RealignerStepResult> result(new RealignerStepResult);
+                try
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        printProgress(idx);
+                    }
+                    processOneRegion(*result, *input.recordCache, step, windows[idx]);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                    cv.notify_all();
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                results[idx] = std::move(result);
+                cv.notify_all();
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (auto & input : workerInputs)
+        workers.push_back(std::thread(workerFunc, std::ref(*input)));
+
+    // Write out results in region order.
+    for (; nextToWrite < windows.size(); )
+    {
+        std::unique_ptr<RealignerStepResult> result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return error || results[nextToWrite]; });
+            if (error)
+                break;
+            result = std::move(results[nextToWrite]);
+        }
+
+        writeResult(*result);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++nextToWrite;
+        cv.notify_all();
+    }
+
+    for (auto & worker : workers)
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    std::cerr << " DONE\n";
+    printCacheStats();
+}
+
+// With --pipeline, a prefetch thread loads the records and the reference sequence of the next window while the main
+// thread realigns the current one, and a writer thread writes out the previous one.  The reference sequence is
+// loaded for the records' extent, which contains the region the step extends the window to, and handed to the step's
+// ReferenceProvider.  The writer thread is the only one writing output, so the output is the same as without
+// pipelining.
+
+void BamRealignerAppImpl::processAllRegionsPipelined()
+{
+    std::cerr << "\n"
+              << "__PROCESSING REGIONS_____________________________________________\n"
+              << "\n";
+
+    BlockingQueue<std::unique_ptr<PrefetchedWindow>> loaded(PIPELINE_DEPTH);
+    BlockingQueue<std::unique_ptr<RealignerStepResult>> done(PIPELINE_DEPTH);
+    std::mutex mutex;
+    std::exception_ptr error;  // first error from any stage, if any
+
+    // Record the current exception and stop all stages.
+    auto fail = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error)
+                error = std::current_exception();
+        }
+        loaded.close();
+        done.close();
+    };
+
+    std::thread prefetcher([&]() {
+            try
+            {
+                for (unsigned idx = 0; idx < windows.size(); ++idx)
+                {
+                    std::unique_ptr<PrefetchedWindow> window(new PrefetchedWindow);
+                    window->idx = idx;
+                    window->result.reset(new RealignerStepResult);
+                    {
+                        StageTimer timer(window->result->stats, STAGE_LOAD_ALIGNMENTS);
+                        prefetchInput->recordCache->fetch(window->records, windows[idx]);
+                    }
+                    {
+                        StageTimer timer(window->result->stats, STAGE_LOAD_REFERENCE);
+                        window->refRegion = recordsExtent(windows[idx].region, window->records);
+                        prefetchInput->referenceProvider->getRegion(window->ref, window->refRegion);
+                    }
+                    if (!loaded.push(std::move(window)))
+                        return;  // stopped after an error
+                }
+                loaded.close();
+            }
+            catch (...)
+            {
+                fail();
+            }
+        });
+    std::thread writer([&]() {
+            try
+            {
+                std::unique_ptr<RealignerStepResult> result;
+                while (done.pop(result))
+                    writeResult(*result);
+            }
+            catch (...)
+            {
+                fail();
+            }
+        });
+
+    try
     {
-        readRecord(region, intervalsFileIn);
-        seqan::CharString buffer;
-        region.toString(buffer);
-        // std::cerr << "\r                                                   "
-        //           << "\rProcessing (#" << no << ") " << buffer << std::flush;
-        std::cerr << "Processing (#" << no << ") " << buffer << "\n";
-
-        processOneRegion(region);
+        RealignerStep step(*referenceProvider, options);
+        std::unique_ptr<PrefetchedWindow> window;
+        while (loaded.pop(window))
+        {
+            printProgress(window->idx);
+            referenceProvider->setPrefetched(window->refRegion, window->ref);
+            step.run(*window->result, window->records, windows[window->idx]);
+            if (!done.push(std::move(window->result)))
+                break;  // stopped after an error
+        }
+        done.close();
     }
+    catch (...)
+    {
+        fail();
+    }
+
+    prefetcher.join();
+    writer.join();
+    if (error)
+        std::rethrow_exception(error);
 
     std::cerr << " DONE\n";
+    printCacheStats();
+}
+
+void BamRealignerAppImpl::printCacheStats() const
+{
+    if (options.verbosity < 1)
+        return;
+
+    RecordCacheStats stats;
+    std::vector<RecordCache const *> caches;
+    if (recordCache)
+        caches.push_back(recordCache.get());
+    for (auto const & input : workerInputs)
+        caches.push_back(input->recordCache.get());
+    if (prefetchInput)
+        caches.push_back(prefetchInput->recordCache.get());
+    for (auto cache : caches)
+    {
+        stats.hits += cache->stats().hits;
+        stats.partialHits += cache->stats().partialHits;
+        stats.misses += cache->stats().misses;
+        stats.recordsDecoded += cache->stats().recordsDecoded;
+        stats.recordsServed += cache->stats().recordsServed;
+    }
+    if (!caches.empty())
+        stats.print(std::cerr);
+
+    referenceProvider->printStats(std::cerr);
+    for (auto const & input : workerInputs)
+        input->referenceProvider->printStats(std::cerr);
+    if (prefetchInput)
+        prefetchInput->referenceProvider->printStats(std::cerr);
+}
+
+void BamRealignerAppImpl::processStreaming()
+{
+    if (options.numThreads > 1 && options.verbosity >= 1)
+        std::cerr << "WARNING: --threads is ignored in streaming mode.\n";
+    if (options.pipeline && options.verbosity >= 1)
+        std::cerr << "WARNING: --pipeline is ignored in streaming mode.\n";
+
+    StreamingRealigner realigner(*mateFixer, msasTxtOut, msasBinOut.get(), bamFileIn, cramFileIn.get(),
+                                 *referenceProvider, windows, statsReport, options);
+    realigner.run();
+    printCacheStats();
+}
+
+void BamRealignerAppImpl::processOneRegion(RealignerStepResult & result,
+                                           RecordCache & recordCache,
+                                           RealignerStep & step,
+                                           RealignmentWindow const & window)
+{
+    std::vector<seqan::BamAlignmentRecord> records;
+    {
+        StageTimer timer(result.stats, STAGE_LOAD_ALIGNMENTS);
+        recordCache.fetch(records, window);
+    }
+
+    step.run(result, records, window);
+}
+
+void BamRealignerAppImpl::writeResult(RealignerStepResult & result)
+{
+    {
+        StageTimer timer(result.stats, STAGE_WRITE);
+        mateFixer->addMoves(result.mateMoves);
+        for (auto & record : result.records)
+            mateFixer->writeRecord(record);
+        if (!result.msasTxt.empty())
+            msasTxtOut << result.msasTxt;
+        if (!result.msasBin.empty())
+            msasBinOut->write(result.msasBin);
+    }
+    if (!options.statsOutPath.empty() || !options.skippedWindowsOutPath.empty())
+        statsReport.add(result.stats, result.skipReason);
 }
 
-void BamRealignerAppImpl::processOneRegion(seqan::GenomicRegion const & region)
+void BamRealignerAppImpl::writeStats() const
 {
-    RealignerStep worker(bamFileOut, msasTxtOut, bamFileIn, baiIndex, faiIndex, region, options);
-    worker.run();
+    if (!options.statsOutPath.empty())
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Writing " << options.statsOutPath << " ...";
+        statsReport.write(options.statsOutPath);
+        if (options.verbosity >= 1)
+            std::cerr << " OK\n";
+    }
+    if (!options.skippedWindowsOutPath.empty())
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Writing " << options.skippedWindowsOutPath << " ...";
+        statsReport.writeSkipped(options.skippedWindowsOutPath);
+        if (options.verbosity >= 1)
+            std::cerr << " OK\n";
+    }
 }
 
 void BamRealignerAppImpl::openFai()
@@ -178,14 +687,39 @@ void BamRealignerAppImpl::openFai()
     }
     if (options.verbosity >= 1)
         std::cerr << "OK\n";
+
+    referenceProvider.reset(new ReferenceProvider(faiIndex, options));
+    if (options.preloadReference)
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Preloading reference ...";
+        referenceProvider->preload();
+        if (options.verbosity >= 1)
+            std::cerr << " OK\n";
+    }
 }
 
 void BamRealignerAppImpl::openBamIn()
 {
     if (options.verbosity >= 1)
         std::cerr << "    Opening " << options.inAlignmentPath << " ...";
-    if (!open(bamFileIn, options.inAlignmentPath.c_str()))
+    if (isCramPath(options.inAlignmentPath))
+    {
+        openCramIn();
+        return;
+    }
+    if (options.streaming && options.numIOThreads > 1 && isBamPath(options.inAlignmentPath))
+    {
+        // Reading sequentially, so the blocks ahead can be decompressed in parallel.
+        bgzfInputBuffer.reset(new BgzfInputBuffer(options.inAlignmentPath, options.numIOThreads));
+        bgzfInputStream.reset(new std::istream(bgzfInputBuffer.get()));
+        if (!open(bamFileIn, *bgzfInputStream, seqan::Bam()))
+            throw seqan::IOError("Could not open BAM file.");
+    }
+    else if (!open(bamFileIn, options.inAlignmentPath.c_str()))
+    {
         throw seqan::IOError("Could not open BAM file.");
+    }
     if (options.verbosity >= 1)
         std::cerr << " OK\n";
 
@@ -195,6 +729,9 @@ void BamRealignerAppImpl::openBamIn()
     if (options.verbosity >= 1)
         std::cerr << " OK\n";
 
+    if (options.streaming)
+        return;  // no index required for reading sequentially
+
     std::string baiPath = options.inAlignmentPath + ".bai";
     if (options.verbosity >= 1)
         std::cerr << "    Opening " << baiPath << " ...";
@@ -202,27 +739,95 @@ void BamRealignerAppImpl::openBamIn()
         throw seqan::IOError("Could not open BAI file.");
     if (options.verbosity >= 1)
         std::cerr << "OK\n";
+
+    recordCache.reset(new RecordCache(bamFileIn, baiIndex, nullptr, options));
 }
 
-void BamRealignerAppImpl::openIntervals()
+// The CRAM file is opened by htslib, which decodes the containers in --io-threads threads in all modes.
+
+void BamRealignerAppImpl::openCramIn()
 {
+    cramFileIn.reset(new CramFileIn(options.inAlignmentPath, options.inReferencePath, options.numIOThreads));
+    if (options.verbosity >= 1)
+        std::cerr << " OK\n";
+
+    if (options.verbosity >= 1)
+        std::cerr << "        Reading header ...";
+    cramFileIn->readHeader(bamHeader, bamFileIn);
+    if (options.verbosity >= 1)
+        std::cerr << " OK\n";
+
+    if (options.streaming)
+        return;  // no index required for reading sequentially
+
     if (options.verbosity >= 1)
-        std::cerr << "    Opening " << options.inIntervalsPath << " ...";
-    if (!open(intervalsFileIn, options.inIntervalsPath.c_str()))
-        throw seqan::IOError("Could not open intervals file.");
+        std::cerr << "    Opening " << options.inAlignmentPath << ".crai ...";
+    cramFileIn->loadIndex();
     if (options.verbosity >= 1)
         std::cerr << "OK\n";
+
+    recordCache.reset(new RecordCache(bamFileIn, baiIndex, cramFileIn.get(), options));
+}
+
+void BamRealignerAppImpl::openWorkerInputs()
+{
+    if (options.streaming)
+        return;
+
+    if (options.numThreads > 1)
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Opening input files for " << options.numThreads << " threads ...";
+        for (int i = 0; i < options.numThreads; ++i)
+        {
+            workerInputs.push_back(std::unique_ptr<WorkerInput>(new WorkerInput));
+            openWorkerInput(*workerInputs.back());
+        }
+        if (options.verbosity >= 1)
+            std::cerr << " OK\n";
+    }
+    else if (options.pipeline)
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "    Opening input files for prefetching ...";
+        prefetchInput.reset(new WorkerInput);
+        openWorkerInput(*prefetchInput);
+        if (options.verbosity >= 1)
+            std::cerr << " OK\n";
+    }
+}
+
+void BamRealignerAppImpl::openWorkerInput(WorkerInput & input)
+{
+    if (!open(input.faiIndex, options.inReferencePath.c_str()))
+        throw seqan::IOError("Could not open FAI index.");
+    seqan::BamHeader header;
+    if (cramFileIn)
+    {
+        input.cramFileIn.reset(new CramFileIn(options.inAlignmentPath, options.inReferencePath, 1));
+        input.cramFileIn->readHeader(header, input.bamFileIn);
+        input.cramFileIn->loadIndex();
+    }
+    else
+    {
+        if (!open(input.bamFileIn, options.inAlignmentPath.c_str()))
+            throw seqan::IOError("Could not open BAM file.");
+        readRecord(header, input.bamFileIn);
+    }
+    input.recordCache.reset(new RecordCache(input.bamFileIn, baiIndex, input.cramFileIn.get(), options));
+    input.referenceProvider.reset(new ReferenceProvider(input.faiIndex, *referenceProvider, options));
 }
 
 void BamRealignerAppImpl::openBamOut()
 {
     if (options.verbosity >= 1)
         std::cerr << "    Opening " << options.outAlignmentPath << " ...";
-    if (!open(bamFileOut, options.outAlignmentPath.c_str()))
-        throw seqan::IOError("Could not open output BAM file.");
+    bamWriter.reset(new BamWriter(bamFileOut, options.outAlignmentPath, options.inReferencePath,
+                                  options.numIOThreads, options.compressionLevel));
     if (options.verbosity >= 1)
         std::cerr << "OK\n";
-    writeRecord(bamFileOut, bamHeader);
+    bamWriter->writeHeader(bamHeader);
+    mateFixer.reset(new MateFixer(*bamWriter, options.mateFixDistance));
 }
 
 void BamRealignerAppImpl::openMsasTxtOut()
@@ -238,6 +843,18 @@ void BamRealignerAppImpl::openMsasTxtOut()
         std::cerr << "OK\n";
 }
 
+void BamRealignerAppImpl::openMsasBinOut()
+{
+    if (options.outMsasBinPath.empty())
+        return;
+
+    if (options.verbosity >= 1)
+        std::cerr << "    Opening " << options.outMsasBinPath << " ...";
+    msasBinOut.reset(new MsaDumpWriter(options.outMsasBinPath, options.numIOThreads, options.compressionLevel));
+    if (options.verbosity >= 1)
+        std::cerr << "OK\n";
+}
+
 
 // ---------------------------------------------------------------------------
 // Class BamRealignerApp
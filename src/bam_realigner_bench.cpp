@@ -0,0 +1,399 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+// Benchmark for the BAM realigner on synthetic datasets.  Generates a reference, BAM and intervals file and runs the
+// realigner for each combination of the given window radii, thread counts and modes.  Writes one TSV row per run with
+// the throughput, the peak resident set size, the summed per-stage times and the per-stage peak resident set sizes from
+// the --stats-out report.
+
+#include <sys/stat.h>
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <seqan/arg_parse.h>
+#include <seqan/basic.h>
+#include <seqan/stream.h>  // for IOError
+
+#include "bam_realigner_app.h"
+#include "bam_realigner_options.h"
+#include "step_stats.h"
+#include "synthetic_dataset.h"
+
+namespace {  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class BenchOptions
+// ---------------------------------------------------------------------------
+
+class BenchOptions
+{
+public:
+    // Verbosity level, the realigner's output is suppressed below 2.
+    int verbosity;
+    // Directory for the dataset and the realigner output.
+    std::string outDir;
+    // Parameters of the dataset.
+    SyntheticDatasetOptions dataset;
+    // Configurations to compare, each combination is run.
+    std::vector<int> windowRadii;
+    std::vector<int> numThreads;
+    std::vector<std::string> modes;
+    // Number of runs per configuration, the fastest one is reported.
+    int repeat;
+
+    BenchOptions() : verbosity(1), outDir("bam_realigner_bench.tmp"), repeat(1)
+    {}
+};
+
+// A stream buffer discarding its input, for silencing std::cerr.
+class NullBuffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+};
+
+// Split comma-separated list.
+std::vector<std::string> splitList(std::string const & str)
+{
+    std::vector<std::string> result;
+    std::istringstream in(str);
+    std::string item;
+    while (std::getline(in, item, ','))
+        if (!item.empty())
+            result.push_back(item);
+    return result;
+}
+
+std::vector<int> splitIntList(std::string const & str)
+{
+    std::vector<int> result;
+    for (auto const & item : splitList(str))
+        result.push_back(std::stoi(item));
+    return result;
+}
+
+BenchOptions parseBenchCommandLine(int argc, char ** argv)
+{
+    BenchOptions result;
+
+    seqan::ArgumentParser parser("bam_realigner_bench");
+    setShortDescription(parser, "BAM realigner benchmark");
+    setVersion(parser, "0.1");
+    setDate(parser, "October 2014");
+
+    addUsageLine(parser, "[--out-dir DIR] [--coverage X] [--indel-rate X] [--window-radius 10,100] [--threads 1,4]");
+    addDescription(parser, "Generate a synthetic dataset and report the throughput and peak memory of the BAM "
+                   "realigner for each combination of window radius, thread count and mode.  The dataset is the "
+                   "same for the same parameters.");
+
+    addOption(parser, seqan::ArgParseOption("q",  "quiet",        "Quiet output"));
+    addOption(parser, seqan::ArgParseOption("v",  "verbose",      "Verbose output, including the realigner's."));
+
+    addOption(parser, seqan::ArgParseOption("", "out-dir", "Directory for the dataset and output files.",
+                                            seqan::ArgParseArgument::STRING, "DIR"));
+    setDefaultValue(parser, "out-dir", result.outDir);
+
+    // Define Options -- Dataset
+    addSection(parser, "Dataset Parameters");
+
+    addOption(parser, seqan::ArgParseOption("", "seed", "Random seed.", seqan::ArgParseArgument::INTEGER, "NUM"));
+    setDefaultValue(parser, "seed", result.dataset.seed);
+    addOption(parser, seqan::ArgParseOption("", "contigs", "Number of contigs.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "contigs", "1");
+    setDefaultValue(parser, "contigs", result.dataset.numContigs);
+    addOption(parser, seqan::ArgParseOption("", "contig-length", "Length of each contig.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "contig-length", "1000");
+    setDefaultValue(parser, "contig-length", result.dataset.contigLength);
+    addOption(parser, seqan::ArgParseOption("", "read-length", "Read length.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "read-length", "20");
+    setDefaultValue(parser, "read-length", result.dataset.readLength);
+    addOption(parser, seqan::ArgParseOption("", "coverage", "Average coverage.",
+                                            seqan::ArgParseArgument::DOUBLE, "X"));
+    setMinValue(parser, "coverage", "0");
+    setDefaultValue(parser, "coverage", result.dataset.coverage);
+    addOption(parser, seqan::ArgParseOption("", "indel-rate", "Indels per reference base.",
+                                            seqan::ArgParseArgument::DOUBLE, "X"));
+    setMinValue(parser, "indel-rate", "0");
+    setMaxValue(parser, "indel-rate", "0.05");
+    setDefaultValue(parser, "indel-rate", result.dataset.indelRate);
+    addOption(parser, seqan::ArgParseOption("", "max-indel-length", "Largest indel length.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "max-indel-length", "1");
+    setDefaultValue(parser, "max-indel-length", result.dataset.maxIndelLength);
+    addOption(parser, seqan::ArgParseOption("", "error-rate", "Sequencing errors per base.",
+                                            seqan::ArgParseArgument::DOUBLE, "X"));
+    setMinValue(parser, "error-rate", "0");
+    setMaxValue(parser, "error-rate", "1");
+    setDefaultValue(parser, "error-rate", result.dataset.errorRate);
+    addOption(parser, seqan::ArgParseOption("", "targets-per-mbp", "Target intervals per million bases, placed on "
+                                            "the indels first and at random positions when there are not enough.",
+                                            seqan::ArgParseArgument::DOUBLE, "X"));
+    setMinValue(parser, "targets-per-mbp", "0");
+    setDefaultValue(parser, "targets-per-mbp", result.dataset.targetsPerMbp);
+
+    // Define Options -- Configurations
+    addSection(parser, "Configurations");
+
+    addOption(parser, seqan::ArgParseOption("", "window-radius", "Comma-separated window radii.",
+                                            seqan::ArgParseArgument::STRING, "LIST"));
+    setDefaultValue(parser, "window-radius", "10");
+    addOption(parser, seqan::ArgParseOption("", "threads", "Comma-separated thread counts.",
+                                            seqan::ArgParseArgument::STRING, "LIST"));
+    setDefaultValue(parser, "threads", "1");
+    addOption(parser, seqan::ArgParseOption("", "modes", "Comma-separated modes, \"indexed\" and/or \"streaming\".",
+                                            seqan::ArgParseArgument::STRING, "LIST"));
+    setDefaultValue(parser, "modes", "indexed");
+    addOption(parser, seqan::ArgParseOption("", "repeat", "Runs per configuration, the fastest is reported.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "repeat", "1");
+    setDefaultValue(parser, "repeat", result.repeat);
+
+    seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
+    if (res != seqan::ArgumentParser::PARSE_OK)
+        throw InvalidCommandLineArgumentsException();
+
+    result.verbosity = isSet(parser, "quiet") ? 0 : result.verbosity;
+    result.verbosity = isSet(parser, "verbose") ? 2 : result.verbosity;
+
+    getOptionValue(result.outDir, parser, "out-dir");
+    getOptionValue(result.dataset.seed, parser, "seed");
+    getOptionValue(result.dataset.numContigs, parser, "contigs");
+    getOptionValue(result.dataset.contigLength, parser, "contig-length");
+    getOptionValue(result.dataset.readLength, parser, "read-length");
+    getOptionValue(result.dataset.coverage, parser, "coverage");
+    getOptionValue(result.dataset.indelRate, parser, "indel-rate");
+    getOptionValue(result.dataset.maxIndelLength, parser, "max-indel-length");
+    getOptionValue(result.dataset.errorRate, parser, "error-rate");
+    getOptionValue(result.dataset.targetsPerMbp, parser, "targets-per-mbp");
+
+    std::string buffer;
+    try
+    {
+        getOptionValue(buffer, parser, "window-radius");
+        result.windowRadii = splitIntList(buffer);
+        getOptionValue(buffer, parser, "threads");
+        result.numThreads = splitIntList(buffer);
+    }
+    catch (std::exception const &)
+    {
+        std::cerr << "bam_realigner_bench: --window-radius and --threads must be comma-separated numbers.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
+    getOptionValue(buffer, parser, "modes");
+    result.modes = splitList(buffer);
+    for (auto const & mode : result.modes)
+        if (mode != "indexed" && mode != "streaming")
+        {
+            std::cerr << "bam_realigner_bench: Invalid mode " << mode << ".\n";
+            throw InvalidCommandLineArgumentsException();
+        }
+    getOptionValue(result.repeat, parser, "repeat");
+
+    return result;
+}
+
+// Read the "sum" and "max" rows of a stats report written by StatsReport::write() and the number of windows.
+void readStatsSummary(std::map<std::string, double> & sums, std::map<std::string, double> & maxima,
+                      unsigned & numWindows, std::string const & path)
+{
+    std::ifstream in(path.c_str());
+    if (!in.good())
+        throw seqan::IOError(("Could not open stats file " + path).c_str());
+
+    std::vector<std::string> header;
+    std::string line, field;
+    numWindows = 0;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::vector<std::string> values;
+        while (std::getline(fields, field, '\t'))
+            values.push_back(field);
+        if (values.empty())
+            continue;
+        if (values[0] == "#type")
+            header = values;
+        else if (values[0] == "window")
+            ++numWindows;
+        else if (values[0] == "sum" || values[0] == "max")
+            for (unsigned i = 3; i < values.size() && i < header.size(); ++i)
+                (values[0] == "sum" ? sums : maxima)[header[i]] = std::stod(values[i]);
+    }
+}
+
+}  // anonymous namespace
+
+int main(int argc, char ** argv)
+{
+    try
+    {
+        BenchOptions options = parseBenchCommandLine(argc, argv);
+        mkdir(options.outDir.c_str(), 0755);
+        std::string prefix = options.outDir + "/";
+
+        // Generate the dataset.
+        if (options.verbosity >= 1)
+            std::cerr << "Generating dataset in " << options.outDir << " ...";
+        resetPeakRss();
+        double startTime = seqan::sysTime();
+        SyntheticDataset dataset;
+        generateSyntheticDataset(dataset, prefix, options.dataset);
+        double generateTime = seqan::sysTime() - startTime;
+        if (options.verbosity >= 1)
+            std::cerr << " OK (" << dataset.numRecords << " records, " << dataset.numTargets << " targets)\n";
+
+        std::cout << "#config\tseconds\trecords\twindows\trecords_per_s\twindows_per_s\tpeak_rss_mb";
+        for (int stage = 0; stage < NUM_STAGES; ++stage)
+            std::cout << '\t' << stageName((StepStage)stage) << "_s";
+        for (int stage = 0; stage < NUM_STAGES; ++stage)
+            std::cout << '\t' << stageName((StepStage)stage) << "_rss_mb";
+        std::cout << '\n';
+        std::cout << "generate\t" << generateTime << '\t' << dataset.numRecords << '\t' << dataset.numTargets << '\t'
+                  << dataset.numRecords / generateTime << '\t' << dataset.numTargets / generateTime << '\t'
+                  << peakRssKb() / 1024.0;
+        for (int stage = 0; stage < 2 * NUM_STAGES; ++stage)
+            std::cout << "\t-";
+        std::cout << std::endl;
+
+        // Run each configuration.
+        NullBuffer nullBuffer;
+        for (auto const & mode : options.modes)
+            for (auto radius : options.windowRadii)
+                for (auto threads : options.numThreads)
+                {
+                    BamRealignerOptions realignerOptions;
+                    realignerOptions.verbosity = 0;
+                    realignerOptions.inAlignmentPath = dataset.alignmentPath;
+                    realignerOptions.inReferencePath = dataset.referencePath;
+                    realignerOptions.inIntervalsPath = dataset.intervalsPath;
+                    realignerOptions.outAlignmentPath = prefix + "out.bam";
+                    realignerOptions.statsOutPath = prefix + "out.stats.tsv";
+                    realignerOptions.windowRadius = radius;
+                    realignerOptions.numThreads = threads;
+                    realignerOptions.streaming = (mode == "streaming");
+
+                    std::ostringstream config;
+                    config << mode << ",radius=" << radius << ",threads=" << threads;
+                    if (options.verbosity >= 1)
+                        std::cerr << "Running " << config.str() << " ...";
+
+                    // The per-stage peaks are of the whole process, sample them only when a single thread runs the
+                    // stages one after the other.
+                    bool sampleStageRss = (threads == 1 && !realignerOptions.pipeline);
+                    setStageRssSampling(sampleStageRss);
+
+                    double bestTime = 0;
+                    uint64_t peakRss = 0;
+                    std::map<std::string, double> sums, maxima;
+                    unsigned numWindows = 0;
+                    for (int i = 0; i < options.repeat; ++i)
+                    {
+                        std::streambuf * cerrBuffer = std::cerr.rdbuf();
+                        if (options.verbosity < 2)
+                            std::cerr.rdbuf(&nullBuffer);
+                        resetPeakRss();
+                        startTime = seqan::sysTime();
+                        try
+                        {
+                            BamRealignerApp app(realignerOptions);
+                            app.run();
+                        }
+                        catch (...)
+                        {
+                            std::cerr.rdbuf(cerrBuffer);
+                            throw;
+                        }
+                        double time = seqan::sysTime() - startTime;
+                        std::cerr.rdbuf(cerrBuffer);
+
+                        // Each stage resets the peak when sampling, so the run's peak is the largest stage peak or
+                        // the one since the last stage.
+                        std::map<std::string, double> runSums, runMaxima;
+                        unsigned runWindows = 0;
+                        readStatsSummary(runSums, runMaxima, runWindows, realignerOptions.statsOutPath);
+                        peakRss = std::max(peakRss, peakRssKb());
+                        for (int stage = 0; stage < NUM_STAGES; ++stage)
+                        {
+                            std::string column = std::string(stageName((StepStage)stage)) + "_rss_kb";
+                            peakRss = std::max(peakRss, (uint64_t)runMaxima[column]);
+                        }
+                        if (i == 0 || time < bestTime)
+                        {
+                            bestTime = time;
+                            sums.swap(runSums);
+                            maxima.swap(runMaxima);
+                            numWindows = runWindows;
+                        }
+                    }
+                    setStageRssSampling(false);
+                    if (options.verbosity >= 1)
+                        std::cerr << " OK\n";
+
+                    std::cout << config.str() << '\t' << bestTime << '\t' << sums["records"] << '\t' << numWindows
+                              << '\t' << sums["records"] / bestTime << '\t' << numWindows / bestTime << '\t'
+                              << peakRss / 1024.0;
+                    for (int stage = 0; stage < NUM_STAGES; ++stage)
+                        std::cout << '\t' << sums[std::string(stageName((StepStage)stage)) + "_wall"];
+                    for (int stage = 0; stage < NUM_STAGES; ++stage)
+                        if (sampleStageRss)
+                            std::cout << '\t' << maxima[std::string(stageName((StepStage)stage)) + "_rss_kb"] / 1024.0;
+                        else
+                            std::cout << "\t-";
+                    std::cout << std::endl;
+                }
+    }
+    catch (InvalidCommandLineArgumentsException const & err)
+    {
+        return 1;
+    }
+    catch (seqan::IOError const & err)
+    {
+        std::cerr << "\n" << err.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
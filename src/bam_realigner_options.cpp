@@ -34,9 +34,14 @@
 
 #include "bam_realigner_options.h"
 
+#include <iostream>
+#include <sstream>
+
 #include <seqan/arg_parse.h>
 #include <seqan/bam_io.h>
-#include <seqan/simple_intervals_io.h>
+
+#include "cram_io.h"
+#include "target_reader.h"
 
 // ----------------------------------------------------------------------------
 // Class BamRealignerOptions
@@ -51,9 +56,41 @@ void BamRealignerOptions::print(std::ostream & out) const
         << "INPUT REFERENCE \t" << inReferencePath << "\n"
         << "INPUT ALIGNMENT \t" << inAlignmentPath << "\n"
         << "INPUT INTERVALS \t" << inIntervalsPath << "\n"
+        << "DISCOVER TARGETS\t" << (discoverTargets ? "YES" : "NO") << "\n"
         << "\n"
         << "OUTPUT ALIGNMENT\t" << outAlignmentPath << "\n"
-        << "OUTPUT MSAS     \t" << outMsasPath << "\n";
+        << "OUTPUT MSAS     \t" << outMsasPath << "\n"
+        << "OUTPUT MSAS BIN \t" << outMsasBinPath << "\n"
+        << "OUTPUT STATS    \t" << statsOutPath << "\n"
+        << "OUTPUT SKIPPED  \t" << skippedWindowsOutPath << "\n"
+        << "\n"
+        << "WINDOW RADIUS   \t" << windowRadius << "\n"
+        << "MERGE DISTANCE  \t" << mergeDistance << "\n"
+        << "MAX CLUSTER SPAN\t" << maxClusterSpan << "\n"
+        << "PRESCREEN       \t" << (prescreen ? "YES" : "NO") << "\n"
+        << "MIN INDEL READS \t" << prescreenMinIndelReads << "\n"
+        << "MIN CLIP READS  \t" << prescreenMinClippedReads << "\n"
+        << "MIN ENTROPY     \t" << prescreenMinEntropy << "\n"
+        << "MAX DEPTH       \t" << maxDepth << "\n"
+        << "SEED            \t" << seed << "\n"
+        << "MAX WINDOW SECS \t" << maxWindowSeconds << "\n"
+        << "MAX WINDOW READS\t" << maxWindowReads << "\n"
+        << "MAX WINDOW BP   \t" << maxWindowBp << "\n"
+        << "ENGINE          \t" << (engine == ENGINE_BANDED ? "banded" :
+                                   engine == ENGINE_CONSENSUS ? "consensus" : "seqan") << "\n"
+        << "MIN BAND        \t" << minBand << "\n"
+        << "MAX BAND        \t" << maxBand << "\n"
+        << "RESCUE CLIPS    \t" << (rescueClips ? "YES" : "NO") << "\n"
+        << "STREAMING       \t" << (streaming ? "YES" : "NO") << "\n"
+        << "SHARD           \t" << (shardIndex + 1) << "/" << numShards << "\n"
+        << "MATE FIX DIST   \t" << mateFixDistance << "\n"
+        << "\n"
+        << "THREADS         \t" << numThreads << "\n"
+        << "REF CACHE CHUNKS\t" << referenceCacheChunks << "\n"
+        << "PRELOAD REF     \t" << (preloadReference ? "YES" : "NO") << "\n"
+        << "PIPELINE        \t" << (pipeline ? "YES" : "NO") << "\n"
+        << "IO THREADS      \t" << numIOThreads << "\n"
+        << "COMPRESSION     \t" << compressionLevel << "\n";
 }
 
 // ----------------------------------------------------------------------------
@@ -74,6 +111,7 @@ BamRealignerOptions parseCommandLine(int argc, char ** argv)
 
     // Define usage line and long description.
     addUsageLine(parser, "--in-alignment ALI.bam --in-reference REF.fa --in-intervals INT.bed --out-alignment aln.bam [--out-msas MSAS.txt]");
+    addUsageLine(parser, "--in-alignment ALI.bam --in-reference REF.fa --discover-targets --out-alignment aln.bam");
     addDescription(parser, "Read realignments from BAM files.");
 
     addOption(parser, seqan::ArgParseOption("q",  "quiet",        "Quiet output"));
@@ -83,30 +121,55 @@ BamRealignerOptions parseCommandLine(int argc, char ** argv)
     // Define Options -- Section Input / Output Optiosn
     addSection(parser, "Input / Output Options");
 
-    addOption(parser, seqan::ArgParseOption("", "in-alignment", "Input alignment file.",
+    addOption(parser, seqan::ArgParseOption("", "in-alignment", "Input alignment file, CRAM files (with .crai "
+                                            "index) need a build with htslib.",
                                             seqan::ArgParseArgument::INPUT_FILE, "BAM"));
     setRequired(parser, "in-alignment", true);
-    setValidValues(parser, "in-alignment", seqan::BamFileIn::getFileExtensions());
+    std::vector<std::string> inAlignmentExtensions = seqan::BamFileIn::getFileExtensions();
+    inAlignmentExtensions.push_back(".cram");
+    setValidValues(parser, "in-alignment", inAlignmentExtensions);
 
     addOption(parser, seqan::ArgParseOption("", "in-reference", "Input reference file.",
                                             seqan::ArgParseArgument::INPUT_FILE, "FASTA"));
     setRequired(parser, "in-reference", true);
     setValidValues(parser, "in-reference", "fa fasta");
 
-    addOption(parser, seqan::ArgParseOption("", "in-intervals", "Input Picard-style intervals file.",
-                                            seqan::ArgParseArgument::INPUT_FILE, "FASTA"));
-    setRequired(parser, "in-intervals", true);
-    setValidValues(parser, "in-intervals", seqan::SimpleIntervalsFileIn::getFileExtensions());
+    addOption(parser, seqan::ArgParseOption("", "in-intervals", "Input targets file: BED, VCF (only the indel sites "
+                                            "are used) or Picard-style intervals.",
+                                            seqan::ArgParseArgument::INPUT_FILE, "TARGETS"));
+    setValidValues(parser, "in-intervals", targetFileExtensions());
 
-    addOption(parser, seqan::ArgParseOption("", "out-alignment", "Output BAM file.",
+    addOption(parser, seqan::ArgParseOption("", "discover-targets", "Sweep the input BAM file once and add targets "
+                                            "where records have indels or columns cluster with many mismatches."));
+
+    addOption(parser, seqan::ArgParseOption("", "out-alignment", "Output BAM file, or CRAM file encoded against "
+                                            "the input reference (needs a build with htslib).",
                                             seqan::ArgParseArgument::OUTPUT_FILE, "BAM"));
     setRequired(parser, "out-alignment", true);
-    setValidValues(parser, "out-alignment", seqan::BamFileOut::getFileExtensions());
+    std::vector<std::string> outAlignmentExtensions = seqan::BamFileOut::getFileExtensions();
+    outAlignmentExtensions.push_back(".cram");
+    setValidValues(parser, "out-alignment", outAlignmentExtensions);
 
     addOption(parser, seqan::ArgParseOption("", "out-msas", "Output text file with before/after MSAs.",
                                             seqan::ArgParseArgument::OUTPUT_FILE, "TXT"));
     setValidValues(parser, "out-msas", "txt txt.gz");
 
+    addOption(parser, seqan::ArgParseOption("", "out-msas-bin", "Output binary file with before/after MSAs, much "
+                                            "cheaper to write than --out-msas.  Convert to text with "
+                                            "\"bam_realigner render-msas\".",
+                                            seqan::ArgParseArgument::OUTPUT_FILE, "MSAB"));
+    setValidValues(parser, "out-msas-bin", "msab");
+
+    addOption(parser, seqan::ArgParseOption("", "stats-out", "Output TSV file with counters and per-stage timings "
+                                            "of each window, followed by sum, mean and percentile rows.",
+                                            seqan::ArgParseArgument::OUTPUT_FILE, "TSV"));
+    setValidValues(parser, "stats-out", "tsv");
+
+    addOption(parser, seqan::ArgParseOption("", "skipped-windows-out", "Output TSV file with the windows passed "
+                                            "through unchanged for exceeding a window budget.",
+                                            seqan::ArgParseArgument::OUTPUT_FILE, "TSV"));
+    setValidValues(parser, "skipped-windows-out", "tsv");
+
     // Define Options -- Algorithm Parameters
     addSection(parser, "Algorithm Parameters");
 
@@ -114,6 +177,144 @@ BamRealignerOptions parseCommandLine(int argc, char ** argv)
                                             seqan::ArgParseArgument::INTEGER, "LEN"));
     setDefaultValue(parser, "window-radius", 10);
 
+    addOption(parser, seqan::ArgParseOption("", "merge-distance", "Merge padded target intervals that are at most "
+                                            "this many bases apart into one window.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "merge-distance", "0");
+    setDefaultValue(parser, "merge-distance", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "max-cluster-span", "Do not merge target intervals into windows "
+                                            "spanning more than this many bases, 0 for no limit.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "max-cluster-span", "0");
+    setDefaultValue(parser, "max-cluster-span", 5000);
+
+    addOption(parser, seqan::ArgParseOption("", "no-prescreen", "Realign all windows, also those without indel "
+                                            "evidence."));
+
+    addOption(parser, seqan::ArgParseOption("", "prescreen-min-indel-reads", "Realign windows with at least this "
+                                            "many reads with indels.", seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "prescreen-min-indel-reads", "0");
+    setDefaultValue(parser, "prescreen-min-indel-reads", 1);
+
+    addOption(parser, seqan::ArgParseOption("", "prescreen-min-clipped-reads", "Realign windows with at least this "
+                                            "many soft-clipped reads.", seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "prescreen-min-clipped-reads", "0");
+    setDefaultValue(parser, "prescreen-min-clipped-reads", 2);
+
+    addOption(parser, seqan::ArgParseOption("", "prescreen-min-entropy", "Realign windows with a column whose base "
+                                            "distribution has at least this entropy (in bits).",
+                                            seqan::ArgParseArgument::DOUBLE, "BITS"));
+    setMinValue(parser, "prescreen-min-entropy", "0");
+    setDefaultValue(parser, "prescreen-min-entropy", 0.6);
+
+    addOption(parser, seqan::ArgParseOption("", "max-depth", "Build the consensus of each window from at most "
+                                            "this many records, the others are aligned against the consensus "
+                                            "afterwards.  0 for no limit.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "max-depth", "0");
+    setDefaultValue(parser, "max-depth", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "seed", "Seed for downsampling.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setDefaultValue(parser, "seed", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "max-window-seconds", "Pass windows through unchanged whose "
+                                            "realignment takes longer than this, 0 for no limit.  Checked between "
+                                            "the realignment passes and rounds of a window, a single pass of SeqAn's "
+                                            "reAlignment() is not interrupted.",
+                                            seqan::ArgParseArgument::DOUBLE, "SEC"));
+    setMinValue(parser, "max-window-seconds", "0");
+    setDefaultValue(parser, "max-window-seconds", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "max-window-reads", "Pass windows through unchanged with more than "
+                                            "this many records to realign (after --max-depth), 0 for no limit.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "max-window-reads", "0");
+    setDefaultValue(parser, "max-window-reads", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "max-window-bp", "Pass windows through unchanged whose span, "
+                                            "extended by the records, is longer than this, 0 for no limit.",
+                                            seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "max-window-bp", "0");
+    setDefaultValue(parser, "max-window-bp", 0);
+
+    addOption(parser, seqan::ArgParseOption("", "engine", "Realignment algorithm, \"seqan\" for SeqAn's "
+                                            "reAlignment(), \"banded\" for vectorized banded alignment of the "
+                                            "reads against their consensus and \"consensus\" for placing the reads "
+                                            "on haplotypes with the window's indels.",
+                                            seqan::ArgParseArgument::STRING, "ENGINE"));
+    setValidValues(parser, "engine", "seqan banded consensus");
+    setDefaultValue(parser, "engine", "seqan");
+
+    addOption(parser, seqan::ArgParseOption("", "min-band", "Smallest band for realignment.  The band of each "
+                                            "window is derived from its largest indel.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "min-band", "1");
+    setDefaultValue(parser, "min-band", 4);
+
+    addOption(parser, seqan::ArgParseOption("", "max-band", "Largest band for realignment, the band is widened up to "
+                                            "this value while alignments reach its edge.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "max-band", "1");
+    setDefaultValue(parser, "max-band", 64);
+
+    addOption(parser, seqan::ArgParseOption("", "rescue-clips", "After realignment, align soft-clipped reads with "
+                                            "their clipped ends against the consensus and un-clip the ends that "
+                                            "align well."));
+
+    addOption(parser, seqan::ArgParseOption("", "streaming", "Read the input alignment file once from start to end "
+                                            "and write out all records, realigned or not, in coordinate order.  "
+                                            "Does not require a BAI index."));
+
+    addOption(parser, seqan::ArgParseOption("", "shard", "Only process the windows of the I-th of N shards (I from 1 "
+                                            "to N).  The windows are cut into N consecutive shards of about the "
+                                            "same number of reads, estimated from the BAI index.  The shard BAM "
+                                            "files can be concatenated with \"bam_realigner merge\".  Mates in "
+                                            "windows of other shards are not updated.",
+                                            seqan::ArgParseArgument::STRING, "I/N"));
+    setDefaultValue(parser, "shard", "1/1");
+
+    addOption(parser, seqan::ArgParseOption("", "mate-fix-distance", "Hold back output records this many bases for "
+                                            "updating PNEXT and TLEN of the mates of records moved in other "
+                                            "windows.  Mates in the same window are always updated, 0 disables "
+                                            "the rest.", seqan::ArgParseArgument::INTEGER, "LEN"));
+    setMinValue(parser, "mate-fix-distance", "0");
+    setDefaultValue(parser, "mate-fix-distance", 1000);
+
+    // Define Options -- Performance Parameters
+    addSection(parser, "Performance Parameters");
+
+    addOption(parser, seqan::ArgParseOption("", "threads", "Number of threads to use for realigning regions.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "threads", "1");
+    setDefaultValue(parser, "threads", 1);
+
+    addOption(parser, seqan::ArgParseOption("", "reference-cache-chunks", "Number of 64kbp reference chunks to keep "
+                                            "in memory per thread.", seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "reference-cache-chunks", "1");
+    setDefaultValue(parser, "reference-cache-chunks", 64);
+
+    addOption(parser, seqan::ArgParseOption("", "preload-reference", "Read the whole reference into memory at "
+                                            "startup, shared by all threads."));
+
+    addOption(parser, seqan::ArgParseOption("", "pipeline", "With one thread, load the records and reference of the "
+                                            "next window and write out the previous window in background threads "
+                                            "while realigning the current one."));
+
+    addOption(parser, seqan::ArgParseOption("", "io-threads", "Number of threads for compressing the output BAM "
+                                            "file and, with --streaming, decompressing the input BAM file ahead "
+                                            "of reading.", seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "io-threads", "1");
+    setDefaultValue(parser, "io-threads", 1);
+
+    addOption(parser, seqan::ArgParseOption("", "compression-level", "zlib compression level of the output BAM "
+                                            "file, 0 writes uncompressed blocks and 1 is fastest.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "compression-level", "0");
+    setMaxValue(parser, "compression-level", "9");
+    setDefaultValue(parser, "compression-level", 6);
+
     // Parse command line.
     seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
 
@@ -129,10 +330,177 @@ BamRealignerOptions parseCommandLine(int argc, char ** argv)
     getOptionValue(result.inAlignmentPath, parser, "in-alignment");
     getOptionValue(result.inReferencePath, parser, "in-reference");
     getOptionValue(result.inIntervalsPath, parser, "in-intervals");
+    result.discoverTargets = isSet(parser, "discover-targets");
+    if (result.inIntervalsPath.empty() && !result.discoverTargets)
+    {
+        std::cerr << "bam_realigner: --in-intervals or --discover-targets is required.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
     getOptionValue(result.outAlignmentPath, parser, "out-alignment");
     getOptionValue(result.outMsasPath, parser, "out-msas");
+    getOptionValue(result.outMsasBinPath, parser, "out-msas-bin");
+    getOptionValue(result.statsOutPath, parser, "stats-out");
+    getOptionValue(result.skippedWindowsOutPath, parser, "skipped-windows-out");
 
     getOptionValue(result.windowRadius, parser, "window-radius");
+    getOptionValue(result.mergeDistance, parser, "merge-distance");
+    getOptionValue(result.maxClusterSpan, parser, "max-cluster-span");
+    result.prescreen = !isSet(parser, "no-prescreen");
+    getOptionValue(result.prescreenMinIndelReads, parser, "prescreen-min-indel-reads");
+    getOptionValue(result.prescreenMinClippedReads, parser, "prescreen-min-clipped-reads");
+    getOptionValue(result.prescreenMinEntropy, parser, "prescreen-min-entropy");
+    getOptionValue(result.maxDepth, parser, "max-depth");
+    getOptionValue(result.seed, parser, "seed");
+    getOptionValue(result.maxWindowSeconds, parser, "max-window-seconds");
+    getOptionValue(result.maxWindowReads, parser, "max-window-reads");
+    getOptionValue(result.maxWindowBp, parser, "max-window-bp");
+    std::string engine;
+    getOptionValue(engine, parser, "engine");
+    if (engine == "banded")
+        result.engine = BamRealignerOptions::ENGINE_BANDED;
+    else if (engine == "consensus")
+        result.engine = BamRealignerOptions::ENGINE_CONSENSUS;
+    else
+        result.engine = BamRealignerOptions::ENGINE_SEQAN;
+    getOptionValue(result.minBand, parser, "min-band");
+    getOptionValue(result.maxBand, parser, "max-band");
+    if (result.minBand > result.maxBand)
+    {
+        std::cerr << "bam_realigner: --min-band must not be larger than --max-band.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
+    result.rescueClips = isSet(parser, "rescue-clips");
+    result.streaming = isSet(parser, "streaming");
+    std::string shard;
+    getOptionValue(shard, parser, "shard");
+    std::istringstream shardStream(shard);
+    char slash = 0;
+    if (!(shardStream >> result.shardIndex >> slash >> result.numShards) || !shardStream.eof() || slash != '/' ||
+        result.shardIndex < 1 || result.shardIndex > result.numShards)
+    {
+        std::cerr << "bam_realigner: --shard must be I/N with 1 <= I <= N.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
+    result.shardIndex -= 1;
+    getOptionValue(result.mateFixDistance, parser, "mate-fix-distance");
+    if (result.numShards > 1 && result.streaming)
+    {
+        std::cerr << "bam_realigner: --shard cannot be combined with --streaming.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
+    if (result.numShards > 1 && isCramPath(result.inAlignmentPath))
+    {
+        std::cerr << "bam_realigner: --shard needs BAM input, the shards are cut using the BAI index.\n";
+        throw InvalidCommandLineArgumentsException();
+    }
+
+    getOptionValue(result.numThreads, parser, "threads");
+    getOptionValue(result.referenceCacheChunks, parser, "reference-cache-chunks");
+    result.preloadReference = isSet(parser, "preload-reference");
+    result.pipeline = isSet(parser, "pipeline");
+    getOptionValue(result.numIOThreads, parser, "io-threads");
+    getOptionValue(result.compressionLevel, parser, "compression-level");
+
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Function parseMergeCommandLine()
+// ----------------------------------------------------------------------------
+
+MergeOptions parseMergeCommandLine(int argc, char ** argv)
+{
+    MergeOptions result;
+
+    // Setup ArgumentParser.
+    seqan::ArgumentParser parser("bam_realigner merge");
+
+    // Set short description, version, and date.
+    setShortDescription(parser, "Concatenate shard BAM files");
+    setVersion(parser, "0.1");
+    setDate(parser, "October 2014");
+
+    // Define usage line and long description.
+    addUsageLine(parser, "--out-alignment OUT.bam SHARD1.bam SHARD2.bam ...");
+    addDescription(parser, "Concatenate the BAM files written with --shard 1/N to --shard N/N, given in this order, "
+                   "into one sorted BAM file.  The compressed blocks are copied without recompressing.  The "
+                   "records are not changed, so mates that were in windows of other shards are not updated.");
+
+    addOption(parser, seqan::ArgParseOption("q",  "quiet",        "Quiet output"));
+    addOption(parser, seqan::ArgParseOption("v",  "verbose",      "Verbose output"));
+
+    addArgument(parser, seqan::ArgParseArgument(seqan::ArgParseArgument::INPUT_FILE, "SHARD", true));
+
+    addOption(parser, seqan::ArgParseOption("", "out-alignment", "Output BAM file.",
+                                            seqan::ArgParseArgument::OUTPUT_FILE, "BAM"));
+    setRequired(parser, "out-alignment", true);
+    setValidValues(parser, "out-alignment", "bam");
+
+    // Parse command line.
+    seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
+    if (res != seqan::ArgumentParser::PARSE_OK)
+        throw InvalidCommandLineArgumentsException();
+
+    // Extract option values.
+    result.verbosity = isSet(parser, "quiet") ? 0 : result.verbosity;
+    result.verbosity = isSet(parser, "verbose") ? 2 : result.verbosity;
+
+    result.inAlignmentPaths.resize(getArgumentValueCount(parser, 0));
+    for (unsigned i = 0; i < result.inAlignmentPaths.size(); ++i)
+        getArgumentValue(result.inAlignmentPaths[i], parser, 0, i);
+    getOptionValue(result.outAlignmentPath, parser, "out-alignment");
+
+    return result;
+}
+
+// ----------------------------------------------------------------------------
+// Function parseRenderMsasCommandLine()
+// ----------------------------------------------------------------------------
+
+RenderMsasOptions parseRenderMsasCommandLine(int argc, char ** argv)
+{
+    RenderMsasOptions result;
+
+    // Setup ArgumentParser.
+    seqan::ArgumentParser parser("bam_realigner render-msas");
+
+    // Set short description, version, and date.
+    setShortDescription(parser, "Render binary MSA dump as text");
+    setVersion(parser, "0.1");
+    setDate(parser, "October 2014");
+
+    // Define usage line and long description.
+    addUsageLine(parser, "--out-msas MSAS.txt MSAS.msab");
+    addDescription(parser, "Convert a binary MSA dump written with --out-msas-bin into the text format of "
+                   "--out-msas.");
+
+    addOption(parser, seqan::ArgParseOption("q",  "quiet",        "Quiet output"));
+    addOption(parser, seqan::ArgParseOption("v",  "verbose",      "Verbose output"));
+
+    addArgument(parser, seqan::ArgParseArgument(seqan::ArgParseArgument::INPUT_FILE, "MSAB"));
+
+    addOption(parser, seqan::ArgParseOption("", "out-msas", "Output text file with MSAs.",
+                                            seqan::ArgParseArgument::OUTPUT_FILE, "TXT"));
+    setRequired(parser, "out-msas", true);
+    setValidValues(parser, "out-msas", "txt txt.gz");
+
+    addOption(parser, seqan::ArgParseOption("", "io-threads", "Number of threads for decompressing the input file.",
+                                            seqan::ArgParseArgument::INTEGER, "NUM"));
+    setMinValue(parser, "io-threads", "1");
+    setDefaultValue(parser, "io-threads", 1);
+
+    // Parse command line.
+    seqan::ArgumentParser::ParseResult res = seqan::parse(parser, argc, argv);
+    if (res != seqan::ArgumentParser::PARSE_OK)
+        throw InvalidCommandLineArgumentsException();
+
+    // Extract option values.
+    result.verbosity = isSet(parser, "quiet") ? 0 : result.verbosity;
+    result.verbosity = isSet(parser, "verbose") ? 2 : result.verbosity;
+
+    getArgumentValue(result.inMsasBinPath, parser, 0);
+    getOptionValue(result.outMsasPath, parser, "out-msas");
+    getOptionValue(result.numIOThreads, parser, "io-threads");
 
     return result;
 }
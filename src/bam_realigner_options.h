@@ -38,6 +38,7 @@
 #include <iosfwd>
 #include <string>
 #include <stdexcept>
+#include <vector>
 
 // ----------------------------------------------------------------------------
 // Class InvalidArgumentsException
@@ -57,6 +58,17 @@ public:
 class BamRealignerOptions
 {
 public:
+    // The realignment algorithms.
+    enum Engine
+    {
+        // SeqAn's reAlignment() on the FragmentStore.
+        ENGINE_SEQAN,
+        // Vectorized banded alignment of the reads against their consensus.
+        ENGINE_BANDED,
+        // Ungapped placement of the reads on candidate haplotypes with the indels seen in the window.
+        ENGINE_CONSENSUS
+    };
+
     // Verbosity: 0 - quiet, 1 - normal, 2 - verbose, 3 - very verbose.
     int verbosity;
 
@@ -64,17 +76,86 @@ public:
     std::string inAlignmentPath;
     // Input reference (.fasta), will build FAI index for it.
     std::string inReferencePath;
-    // Input intervals file (.bed)
+    // Input targets file: BED, VCF (indel sites) or Picard-style intervals.
     std::string inIntervalsPath;
     // Output BAM file.
     std::string outAlignmentPath;
     // Output text file with MSAs.
     std::string outMsasPath;
+    // Output binary MSA dump file.
+    std::string outMsasBinPath;
+    // Path to output TSV file with per-window counters and timings.
+    std::string statsOutPath;
+    // Path to output TSV file with the windows passed through for exceeding a limit.
+    std::string skippedWindowsOutPath;
+
+    // Discover further targets from indels and mismatch clusters in the input BAM file.
+    bool discoverTargets;
 
     // Additional radius around target intervals to extract reads from.
     int windowRadius;
+    // Padded target intervals at most this many bases apart are merged into one window.
+    int mergeDistance;
+    // Largest span of a window built from merged target intervals, 0 for no limit.
+    int maxClusterSpan;
+
+    // Pre-screen windows and pass through those without indel evidence.
+    bool prescreen;
+    // A window is realigned if it has at least this many reads with indels, ...
+    int prescreenMinIndelReads;
+    // ... or at least this many soft-clipped reads, ...
+    int prescreenMinClippedReads;
+    // ... or a column whose base distribution has at least this Shannon entropy (in bits).
+    double prescreenMinEntropy;
+
+    // Realign at most this many records per window, 0 for no limit.
+    int maxDepth;
+    // Seed for downsampling.
+    int seed;
+    // Budgets of a window, 0 for no limit.  Windows with more records to realign or a longer span are passed through
+    // unchanged, as are windows whose realignment takes longer than maxWindowSeconds.
+    double maxWindowSeconds;
+    int maxWindowReads;
+    int maxWindowBp;
+
+    // The realignment algorithm to use.
+    Engine engine;
+    // Bounds of the band for realignment, the band of each window is derived from its largest indel and widened up
+    // to maxBand if it turns out too narrow.
+    int minBand;
+    int maxBand;
+    // Un-clip soft-clipped tails that align well to the consensus after realignment.
+    bool rescueClips;
+
+    // Read the input BAM file sequentially and write out all records instead of only the realigned ones.
+    bool streaming;
+    // Only process the windows of shard shardIndex (0-based) out of numShards shards of about the same number of
+    // reads.
+    int shardIndex;
+    int numShards;
+    // Hold back output records this many bases for updating the mates of records moved in other windows.
+    int mateFixDistance;
 
-    BamRealignerOptions() : verbosity(1), windowRadius(100)
+    // Number of threads to use for realigning regions in parallel.
+    int numThreads;
+    // Number of reference chunks to keep in the reference cache of each thread.
+    int referenceCacheChunks;
+    // Read the whole reference into memory at startup.
+    bool preloadReference;
+    // With one thread, load the next window and write the previous one in background threads during realignment.
+    bool pipeline;
+    // Number of threads for (de)compressing BGZF blocks of the input and output BAM files.
+    int numIOThreads;
+    // zlib compression level of the output BAM file, 0 for uncompressed blocks.
+    int compressionLevel;
+
+    BamRealignerOptions() :
+            verbosity(1), discoverTargets(false), windowRadius(100), mergeDistance(0), maxClusterSpan(5000),
+            prescreen(true), prescreenMinIndelReads(1), prescreenMinClippedReads(2), prescreenMinEntropy(0.6),
+            maxDepth(0), seed(0), maxWindowSeconds(0), maxWindowReads(0), maxWindowBp(0), engine(ENGINE_SEQAN),
+            minBand(4), maxBand(64), rescueClips(false), streaming(false), shardIndex(0), numShards(1),
+            mateFixDistance(1000), numThreads(1), referenceCacheChunks(64), preloadReference(false), pipeline(false),
+            numIOThreads(1), compressionLevel(6)
     {}
 
     void print(std::ostream & out) const;
@@ -86,4 +167,63 @@ public:
 
 BamRealignerOptions parseCommandLine(int argc, char ** argv);
 
+// ----------------------------------------------------------------------------
+// Class MergeOptions
+// ----------------------------------------------------------------------------
+
+// Options of the merge subcommand.
+
+class MergeOptions
+{
+public:
+    // Verbosity: 0 - quiet, 1 - normal, 2 - verbose, 3 - very verbose.
+    int verbosity;
+
+    // The shard BAM files in genomic order and the merged output BAM file.
+    std::vector<std::string> inAlignmentPaths;
+    std::string outAlignmentPath;
+
+    MergeOptions() : verbosity(1)
+    {}
+};
+
+// ----------------------------------------------------------------------------
+// Function parseMergeCommandLine()
+// ----------------------------------------------------------------------------
+
+// Parse the arguments following "merge".
+
+MergeOptions parseMergeCommandLine(int argc, char ** argv);
+
+// ----------------------------------------------------------------------------
+// Class RenderMsasOptions
+// ----------------------------------------------------------------------------
+
+// Options of the render-msas subcommand.
+
+class RenderMsasOptions
+{
+public:
+    // Verbosity: 0 - quiet, 1 - normal, 2 - verbose, 3 - very verbose.
+    int verbosity;
+
+    // The binary MSA dump file and the text MSA output file.
+    std::string inMsasBinPath;
+    std::string outMsasPath;
+
+    // Number of threads for decompressing the input file.
+    int numIOThreads;
+
+    RenderMsasOptions() : verbosity(1), numIOThreads(1)
+    {}
+};
+
+// ----------------------------------------------------------------------------
+// Function parseRenderMsasCommandLine()
+// ----------------------------------------------------------------------------
+
+// Parse the arguments following "render-msas".
+
+RenderMsasOptions parseRenderMsasCommandLine(int argc, char ** argv);
+
 #endif  // #ifndef BAM_REALIGNER_SRC_BAM_REALIGNER_OPTIONS_H_
@@ -0,0 +1,109 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "bam_writer.h"
+
+#include "bgzf_io.h"
+#include "cram_io.h"
+
+namespace {  // anonymous namespace
+
+// Size from which encoded records are handed to the BGZF writer.
+unsigned const FLUSH_SIZE = 64 * 1024;
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class BamWriter
+// ---------------------------------------------------------------------------
+
+BamWriter::BamWriter(seqan::BamFileOut & bamFileOut, std::string const & path, std::string const & referencePath,
+                     int numThreads, int compressionLevel) :
+        bamFileOut(bamFileOut), writeBamFileOut(false)
+{
+    if (isCramPath(path))
+    {
+        cramWriter.reset(new CramFileOut(path, referencePath, numThreads, compressionLevel));
+    }
+    else if (isBamPath(path))
+    {
+        writer.reset(new BgzfWriter(path, numThreads, compressionLevel));
+    }
+    else
+    {
+        if (!open(bamFileOut, path.c_str()))
+            throw seqan::IOError("Could not open output file.");
+        writeBamFileOut = true;
+    }
+}
+
+BamWriter::~BamWriter()  // for pimpl
+{}
+
+void BamWriter::writeHeader(seqan::BamHeader const & header)
+{
+    if (cramWriter)
+        return cramWriter->writeHeader(header, bamFileOut);
+    if (writeBamFileOut)
+        return seqan::writeRecord(bamFileOut, header);
+    write(buffer, header, seqan::context(bamFileOut), seqan::Bam());
+    flush();
+}
+
+void BamWriter::writeRecord(seqan::BamAlignmentRecord const & record)
+{
+    if (cramWriter)
+        return cramWriter->writeRecord(record);
+    if (writeBamFileOut)
+        return seqan::writeRecord(bamFileOut, record);
+    write(buffer, record, seqan::context(bamFileOut), seqan::Bam());
+    if (length(buffer) >= FLUSH_SIZE)
+        flush();
+}
+
+void BamWriter::close()
+{
+    if (cramWriter)
+        return cramWriter->close();
+    if (writeBamFileOut)
+        return seqan::close(bamFileOut);
+    flush();
+    writer->close();
+}
+
+void BamWriter::flush()
+{
+    writer->write(toCString(buffer), length(buffer));
+    clear(buffer);
+}
@@ -0,0 +1,81 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef BAM_WRITER_H_
+#define BAM_WRITER_H_
+
+#include <memory>
+#include <string>
+
+#include <seqan/bam_io.h>
+
+class BgzfWriter;
+class CramFileOut;
+
+// ---------------------------------------------------------------------------
+// Class BamWriter
+// ---------------------------------------------------------------------------
+
+// Writes a BAM file with BgzfWriter, so the blocks are compressed in parallel.  The records are encoded with the
+// context (reference names and lengths) of bamFileOut, which is not opened itself.  Paths ending in .cram are written
+// as CRAM with CramFileOut instead, encoded against the FASTA file at referencePath.  Other formats (e.g. SAM) are
+// written by opening bamFileOut itself.  Throws seqan::IOError on errors.
+
+class BamWriter
+{
+public:
+    BamWriter(seqan::BamFileOut & bamFileOut, std::string const & path, std::string const & referencePath,
+              int numThreads, int compressionLevel);
+    ~BamWriter();  // for pimpl
+
+    void writeHeader(seqan::BamHeader const & header);
+    void writeRecord(seqan::BamAlignmentRecord const & record);
+
+    // Write out all buffered data and close the file.
+    void close();
+
+private:
+    // Hand the encoded data to the BGZF writer.
+    void flush();
+
+    seqan::BamFileOut & bamFileOut;
+    seqan::CharString buffer;
+    std::unique_ptr<BgzfWriter> writer;
+    // Used instead of writer for CRAM output.
+    std::unique_ptr<CramFileOut> cramWriter;
+    // Whether bamFileOut is opened and written instead of writer, for formats other than BAM and CRAM.
+    bool writeBamFileOut;
+};
+
+#endif  // #ifndef BAM_WRITER_H_
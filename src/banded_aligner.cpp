@@ -0,0 +1,341 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "banded_aligner.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Compile the DP kernel for several instruction sets and select the best one at runtime, where supported by the
+// compiler and platform.  Elsewhere, the generic vector code is lowered to whatever the target supports.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+#define BANDED_TARGET_CLONES __attribute__((target_clones("avx2", "sse4.1", "default")))
+#else
+#define BANDED_TARGET_CLONES
+#endif
+
+namespace {  // anonymous namespace
+
+// Vector of one 32 bit value per lane.  The buffers are plain int32_t arrays, accessed with load() and store().
+typedef int32_t TVec __attribute__((vector_size(32)));
+unsigned const LANES = sizeof(TVec) / sizeof(int32_t);
+
+// Scoring scheme, a gap of length l costs GAP_OPEN + (l - 1) * GAP_EXTEND.
+int32_t const MATCH = 2;
+int32_t const MISMATCH = -4;
+int32_t const N_SCORE = -1;
+int32_t const GAP_OPEN = -6;
+int32_t const GAP_EXTEND = -1;
+int32_t const NEG_INF = -(1 << 28);
+
+// Codes of N, of positions outside of the sequence and of positions behind the end of shorter reads.
+int32_t const CODE_N = 4;
+int32_t const SEQ_PAD = 8;
+int32_t const READ_PAD = 9;
+
+// Bits of the traceback matrix: source of H (0 diagonal, 1 E, 2 F) and whether E/F extend a gap.
+uint8_t const DIR_SOURCE = 3;
+uint8_t const DIR_FROM_E = 1;
+uint8_t const DIR_FROM_F = 2;
+uint8_t const DIR_E_EXTEND = 4;
+uint8_t const DIR_F_EXTEND = 8;
+
+// ---------------------------------------------------------------------------
+// Class BandedBatch
+// ---------------------------------------------------------------------------
+
+// The DP matrices of up to LANES reads.  Cell (i, k) of a lane is the alignment of the first i read characters
+// ending after sequence position j = windowBegin + i + k, where windowBegin is the diagonal minus the bandwidth.
+
+class BandedBatch
+{
+public:
+    // Number of rows (longest read length) and band width.
+    unsigned numRows;
+    unsigned width;
+    // Read characters by row and sequence characters by i + k - 1, transposed to LANES values per position.
+    std::vector<int32_t> readT;
+    std::vector<int32_t> seqT;
+    // Row 0 of H, LANES values per k.
+    std::vector<int32_t> row0;
+    // Read length, begin of the sequence window and the required end k for global alignments (-1 otherwise).
+    int32_t lengths[LANES];
+    int32_t windowBegin[LANES];
+    int32_t globalEndK[LANES];
+    // Traceback bits, LANES per cell, row by row.
+    std::vector<uint8_t> dirs;
+    // Score and k of the best end cell per lane.
+    int32_t endScore[LANES];
+    int32_t endK[LANES];
+    // Buffers for two rows of H and F.
+    std::vector<int32_t> buffer;
+};
+
+// Unaligned vector load and store.
+#define BANDED_LOAD(dst, ptr) std::memcpy(&(dst), (ptr), sizeof(TVec))
+#define BANDED_STORE(ptr, src) std::memcpy((ptr), &(src), sizeof(TVec))
+
+// Fill the DP matrices of batch, the vectorized part of the alignment.
+BANDED_TARGET_CLONES
+void fillBatch(BandedBatch & batch)
+{
+    unsigned const n = batch.numRows, w = batch.width;
+    int32_t * hPrev = &batch.buffer[0];
+    int32_t * hCur = hPrev + (w + 1) * LANES;
+    int32_t * fPrev = hCur + (w + 1) * LANES;
+    int32_t * fCur = fPrev + (w + 1) * LANES;
+
+    TVec const zero = {};
+    TVec const negInf = zero + NEG_INF;
+    TVec const match = zero + MATCH, mismatch = zero + MISMATCH, nScore = zero + N_SCORE;
+    TVec const fromE = zero + DIR_FROM_E, fromF = zero + DIR_FROM_F;
+    std::copy(batch.row0.begin(), batch.row0.end(), hPrev);
+    for (unsigned k = 0; k < w; ++k)
+        BANDED_STORE(fPrev + k * LANES, negInf);
+    for (auto row : { hPrev, hCur, fPrev, fCur })
+        BANDED_STORE(row + w * LANES, negInf);  // sentinels right of the band
+
+    for (unsigned l = 0; l < LANES; ++l)
+        batch.endScore[l] = NEG_INF, batch.endK[l] = 0;
+
+    for (unsigned i = 1; i <= n; ++i)
+    {
+        TVec rc;
+        BANDED_LOAD(rc, &batch.readT[(i - 1) * LANES]);
+        TVec const rcIsN = (rc == CODE_N);
+        TVec e = negInf, hLeft = negInf;
+        uint8_t * rowDirs = &batch.dirs[(size_t)i * w * LANES];
+
+        for (unsigned k = 0; k < w; ++k)
+        {
+            TVec sc, hDiag, hUp, fUp;
+            BANDED_LOAD(sc, &batch.seqT[(i + k - 1) * LANES]);
+            BANDED_LOAD(hDiag, hPrev + k * LANES);
+            BANDED_LOAD(hUp, hPrev + (k + 1) * LANES);
+            BANDED_LOAD(fUp, fPrev + (k + 1) * LANES);
+            TVec const invalid = (sc == SEQ_PAD);
+            TVec sub = (rc == sc) ? match : mismatch;
+            sub = (rcIsN | (sc == CODE_N)) ? nScore : sub;
+
+            // E: gap in read, from the left in the same row.
+            TVec const eOpen = hLeft + GAP_OPEN, eExtend = e + GAP_EXTEND;
+            TVec const eIsExtend = (eExtend > eOpen);
+            e = eIsExtend ? eExtend : eOpen;
+            e = invalid ? negInf : e;
+
+            // F: gap in sequence, from the row above.
+            TVec const fOpen = hUp + GAP_OPEN, fExtend = fUp + GAP_EXTEND;
+            TVec const fIsExtend = (fExtend > fOpen);
+            TVec f = fIsExtend ? fExtend : fOpen;
+            f = (f > negInf) ? f : negInf;
+
+            // H, preferring the diagonal over E over F on ties so gaps are placed leftmost.
+            TVec h = invalid ? negInf : hDiag + sub;
+            TVec source = zero;
+            TVec mask = (e > h);
+            h = mask ? e : h;
+            source = mask ? fromE : source;
+            mask = (f > h);
+            h = mask ? f : h;
+            source = mask ? fromF : source;
+
+            TVec const dir = source | (eIsExtend & DIR_E_EXTEND) | (fIsExtend & DIR_F_EXTEND);
+            for (unsigned l = 0; l < LANES; ++l)
+                rowDirs[k * LANES + l] = (uint8_t)dir[l];
+
+            BANDED_STORE(hCur + k * LANES, h);
+            BANDED_STORE(fCur + k * LANES, f);
+            hLeft = h;
+        }
+
+        // Pick the end cell of the reads ending in this row.
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            if (batch.lengths[l] != (int32_t)i)
+                continue;
+            if (batch.globalEndK[l] >= 0)
+            {
+                batch.endK[l] = batch.globalEndK[l];
+                batch.endScore[l] = hCur[batch.globalEndK[l] * LANES + l];
+                continue;
+            }
+            for (unsigned k = 0; k < w; ++k)
+                if (hCur[k * LANES + l] > batch.endScore[l])
+                    batch.endScore[l] = hCur[k * LANES + l], batch.endK[l] = k;
+        }
+
+        std::swap(hPrev, hCur);
+        std::swap(fPrev, fCur);
+    }
+}
+
+// Compute the alignment of lane l of batch from the traceback bits.
+void traceBack(BandedAlignment & result, BandedBatch const & batch, unsigned l, bool global)
+{
+    unsigned const w = batch.width;
+    result.ok = (batch.endScore[l] > NEG_INF / 2);
+    result.score = batch.endScore[l];
+    result.ops.clear();
+    result.touchesBandEdge = false;
+    if (!result.ok)
+        return;
+
+    std::vector<AlignmentOp> ops;  // reversed
+    int i = batch.lengths[l], k = batch.endK[l];
+    uint8_t state = 0;  // 0 for H, else DIR_FROM_E or DIR_FROM_F
+    while (i > 0)
+    {
+        if (k == 0 || k + 1 == (int)w)
+            result.touchesBandEdge = true;
+        uint8_t dir = batch.dirs[((size_t)i * w + k) * LANES + l];
+        if (state == 0)
+            state = dir & DIR_SOURCE;
+        if (state == 0)
+        {
+            appendAlignmentOp(ops, 'M', 1);
+            --i;
+        }
+        else if (state == DIR_FROM_E)
+        {
+            appendAlignmentOp(ops, 'D', 1);
+            state = (dir & DIR_E_EXTEND) ? DIR_FROM_E : 0;
+            --k;
+        }
+        else
+        {
+            appendAlignmentOp(ops, 'I', 1);
+            state = (dir & DIR_F_EXTEND) ? DIR_FROM_F : 0;
+            --i;
+            ++k;
+        }
+    }
+
+    int beginPos = batch.windowBegin[l] + k;
+    if (global && beginPos > 0)
+        appendAlignmentOp(ops, 'D', beginPos);  // leading gap in read
+    result.beginPos = global ? 0 : beginPos;
+    result.ops.assign(ops.rbegin(), ops.rend());
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function appendAlignmentOp()
+// ---------------------------------------------------------------------------
+
+void appendAlignmentOp(std::vector<AlignmentOp> & ops, char operation, unsigned count)
+{
+    if (count == 0)
+        return;
+    if (!ops.empty() && ops.back().operation == operation)
+        ops.back().count += count;
+    else
+        ops.push_back(AlignmentOp(operation, count));
+}
+
+// ---------------------------------------------------------------------------
+// Function alignBanded()
+// ---------------------------------------------------------------------------
+
+void alignBanded(std::vector<BandedAlignment> & results,
+                 std::vector<BandedAlignmentTask> const & tasks,
+                 uint8_t const * seq,
+                 unsigned seqLength,
+                 int bandwidth)
+{
+    results.resize(tasks.size());
+
+    BandedBatch batch;
+    batch.width = 2 * bandwidth + 1;
+    for (unsigned batchBegin = 0; batchBegin < tasks.size(); batchBegin += LANES)
+    {
+        unsigned batchEnd = std::min((unsigned)tasks.size(), batchBegin + LANES);
+
+        // Set up lanes, unused lanes get empty reads.
+        batch.numRows = 0;
+        for (unsigned l = 0; l < LANES; ++l)
+        {
+            BandedAlignmentTask const * task = (batchBegin + l < batchEnd) ? &tasks[batchBegin + l] : nullptr;
+            batch.lengths[l] = task ? task->readLength : 0;
+            batch.windowBegin[l] = task ? task->diagonal - bandwidth : 0;
+            int endK = seqLength - batch.lengths[l] - batch.windowBegin[l];
+            batch.globalEndK[l] = (task && task->global) ? endK : -1;
+            if (batch.globalEndK[l] >= (int)batch.width)
+                batch.globalEndK[l] = -1, batch.lengths[l] = 0;  // end not within band
+            if (task && task->global && endK < 0)
+                batch.lengths[l] = 0;
+            batch.numRows = std::max(batch.numRows, (unsigned)batch.lengths[l]);
+        }
+
+        unsigned const n = batch.numRows, w = batch.width;
+        batch.readT.assign(n * LANES, READ_PAD);
+        batch.seqT.assign((n + w) * LANES, SEQ_PAD);
+        batch.row0.assign(w * LANES, NEG_INF);
+        batch.dirs.resize((size_t)(n + 1) * w * LANES);
+        batch.buffer.resize(4 * (w + 1) * LANES);
+        for (unsigned l = 0; l < LANES && batchBegin + l < batchEnd; ++l)
+        {
+            BandedAlignmentTask const & task = tasks[batchBegin + l];
+            for (int i = 0; i < batch.lengths[l]; ++i)
+                batch.readT[i * LANES + l] = task.read[i];
+            for (unsigned p = 0; p < n + w; ++p)
+            {
+                int j = batch.windowBegin[l] + (int)p;
+                if (j >= 0 && j < (int)seqLength)
+                    batch.seqT[p * LANES + l] = seq[j];
+            }
+            for (unsigned k = 0; k < w; ++k)
+            {
+                int j = batch.windowBegin[l] + (int)k;
+                if (j < 0 || j > (int)seqLength)
+                    continue;
+                if (!task.global)
+                    batch.row0[k * LANES + l] = 0;
+                else
+                    batch.row0[k * LANES + l] = (j == 0) ? 0 : GAP_OPEN + (j - 1) * GAP_EXTEND;
+            }
+        }
+
+        if (n > 0)
+            fillBatch(batch);
+
+        for (unsigned l = 0; batchBegin + l < batchEnd; ++l)
+        {
+            if (batch.lengths[l] == 0)
+                results[batchBegin + l] = BandedAlignment();
+            else
+                traceBack(results[batchBegin + l], batch, l, tasks[batchBegin + l].global);
+        }
+    }
+}
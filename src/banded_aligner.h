@@ -0,0 +1,122 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef BANDED_ALIGNER_H_
+#define BANDED_ALIGNER_H_
+
+#include <cstdint>
+#include <vector>
+
+// The banded alignment kernel works on plain sequences of codes 0..3 for A, C, G, T and 4 for N and does not depend
+// on SeqAn.
+
+// ---------------------------------------------------------------------------
+// Class AlignmentOp
+// ---------------------------------------------------------------------------
+
+// An alignment operation of a read against a sequence, 'M', 'I' or 'D' as in SAM CIGAR strings.
+
+class AlignmentOp
+{
+public:
+    char operation;
+    unsigned count;
+
+    AlignmentOp(char operation = 'M', unsigned count = 0) : operation(operation), count(count)
+    {}
+};
+
+// Append operation to ops, merging with the last one.
+void appendAlignmentOp(std::vector<AlignmentOp> & ops, char operation, unsigned count);
+
+// ---------------------------------------------------------------------------
+// Class BandedAlignmentTask
+// ---------------------------------------------------------------------------
+
+// A read to align against the sequence.
+
+class BandedAlignmentTask
+{
+public:
+    // The read.
+    uint8_t const * read;
+    unsigned readLength;
+    // Expected position of the read's first base in the sequence, the band is centered around this diagonal.
+    int diagonal;
+    // Whether to align the read to the whole sequence instead of to an infix (diagonal must be 0).
+    bool global;
+
+    BandedAlignmentTask() : read(nullptr), readLength(0), diagonal(0), global(false)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Class BandedAlignment
+// ---------------------------------------------------------------------------
+
+// The result of aligning a read.
+
+class BandedAlignment
+{
+public:
+    // Whether an alignment was found within the band.
+    bool ok;
+    // Begin position in the sequence and alignment operations.
+    int beginPos;
+    std::vector<AlignmentOp> ops;
+    // Alignment score.
+    int score;
+    // Whether the alignment touches the band's border, so a wider band might give a better alignment.
+    bool touchesBandEdge;
+
+    BandedAlignment() : ok(false), beginPos(0), score(0), touchesBandEdge(false)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Function alignBanded()
+// ---------------------------------------------------------------------------
+
+// Align each read of tasks against seq, within bandwidth diagonals left and right of the task's diagonal, with affine
+// gap costs.  Reads are aligned completely, against an infix of seq or against the whole of seq if task.global.
+// Gaps are placed leftmost.  The reads are aligned in batches with one read per vector lane, the kernel is compiled
+// for AVX2, SSE4.1 and generic CPUs and the best version is selected at runtime where supported.
+
+void alignBanded(std::vector<BandedAlignment> & results,
+                 std::vector<BandedAlignmentTask> const & tasks,
+                 uint8_t const * seq,
+                 unsigned seqLength,
+                 int bandwidth);
+
+#endif  // #ifndef BANDED_ALIGNER_H_
@@ -0,0 +1,274 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "banded_realigner.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {  // anonymous namespace
+
+// Smallest number of reads for changing a consensus column or inserting into the consensus.
+unsigned const MIN_CONSENSUS_COVERAGE = 2;
+
+// Number of counters per consensus column: the bases A, C, G, T, N and deletions.
+unsigned const NUM_COUNTS = 6;
+unsigned const DELETION = 5;
+
+// Compute the consensus of the reads aligned against backbone by majority vote.  consPos[p] is the position of
+// backbone position p in the consensus (or of the next kept one if p is deleted) and kept[p] is false if p is deleted.
+// Returns the number of inserted and deleted bases.
+unsigned buildConsensus(std::vector<uint8_t> & cons,
+                        std::vector<int> & consPos,
+                        std::vector<bool> & kept,
+                        std::vector<uint8_t> const & backbone,
+                        std::vector<BandedRealignerRead> const & reads)
+{
+    int const m = backbone.size();
+    std::vector<unsigned> counts(m * NUM_COUNTS, 0);
+    // Number of reads with aligned columns p - 1 and p, as differences first.
+    std::vector<int> spanning(m + 1, 0);
+    // Inserted sequences before backbone position p.
+    std::map<int, std::vector<std::vector<uint8_t>>> insertions;
+
+    for (auto const & read : reads)
+    {
+        if (!read.aligned)
+            continue;
+        int p = read.beginPos;
+        unsigned i = 0;
+        for (unsigned o = 0; o < read.ops.size(); ++o)
+        {
+            AlignmentOp const & op = read.ops[o];
+            for (unsigned t = 0; t < op.count && op.operation != 'I'; ++t, ++p)
+                if (p >= 0 && p < m)
+                    ++counts[p * NUM_COUNTS + ((op.operation == 'M') ? read.seq[i + t] : DELETION)];
+            if (op.operation == 'I' && p > read.beginPos && o + 1 < read.ops.size())
+                insertions[p].push_back(std::vector<uint8_t>(read.seq.begin() + i, read.seq.begin() + i + op.count));
+            if (op.operation != 'D')
+                i += op.count;
+        }
+        if (p - read.beginPos >= 2)
+        {
+            ++spanning[std::max(0, std::min(m, read.beginPos + 1))];
+            --spanning[std::max(0, std::min(m, p))];
+        }
+    }
+    for (int p = 1; p <= m; ++p)
+        spanning[p] += spanning[p - 1];
+
+    unsigned indelBases = 0;
+    cons.clear();
+    consPos.assign(m + 1, 0);
+    kept.assign(m, true);
+    for (int p = 0; p < m; ++p)
+    {
+        // Insert the most common inserted sequence before p if more than half of the spanning reads have one.
+        auto it = insertions.find(p);
+        if (it != insertions.end() && spanning[p] >= (int)MIN_CONSENSUS_COVERAGE &&
+            2 * it->second.size() > (unsigned)spanning[p])
+        {
+            std::map<size_t, unsigned> lengthCounts;
+            for (auto const & ins : it->second)
+                ++lengthCounts[ins.size()];
+            size_t length = 0;
+            unsigned bestCount = 0;
+            for (auto const & el : lengthCounts)
+                if (el.second > bestCount)
+                    length = el.first, bestCount = el.second;
+            for (size_t offset = 0; offset < length; ++offset)
+            {
+                unsigned baseCounts[NUM_COUNTS] = { 0 };
+                for (auto const & ins : it->second)
+                    if (ins.size() == length)
+                        ++baseCounts[ins[offset]];
+                cons.push_back(std::max_element(baseCounts, baseCounts + 4) - baseCounts);
+            }
+            indelBases += length;
+        }
+        consPos[p] = cons.size();
+
+        // Keep, delete or replace the backbone base.
+        unsigned const * column = &counts[p * NUM_COUNTS];
+        unsigned coverage = 0;
+        for (unsigned c = 0; c < NUM_COUNTS; ++c)
+            coverage += column[c];
+        uint8_t base = backbone[p];
+        if (coverage >= MIN_CONSENSUS_COVERAGE)
+        {
+            if (2 * column[DELETION] > coverage)
+            {
+                kept[p] = false;
+                ++indelBases;
+                continue;
+            }
+            uint8_t best = std::max_element(column, column + 4) - column;
+            if (column[best] > column[base])
+                base = best;
+        }
+        cons.push_back(base);
+    }
+    consPos[m] = cons.size();
+    return indelBases;
+}
+
+// Project the alignment of read against the backbone onto the consensus built by buildConsensus().  Bases aligned to
+// deleted backbone columns become insertions and consensus insertions spanned by the read become deletions.
+void projectAlignment(BandedRealignerRead & read, std::vector<int> const & consPos, std::vector<bool> const & kept)
+{
+    int const m = kept.size();
+    int p = read.beginPos;
+    int c = (p < 0) ? p : consPos[std::min(m, p)] + std::max(0, p - m);
+    read.beginPos = c;
+
+    std::vector<AlignmentOp> ops;
+    for (auto const & op : read.ops)
+    {
+        if (op.operation == 'I')
+        {
+            appendAlignmentOp(ops, 'I', op.count);
+            continue;
+        }
+        for (unsigned t = 0; t < op.count; ++t, ++p)
+        {
+            if (p < 0 || p >= m)  // outside of the backbone, kept as is
+            {
+                appendAlignmentOp(ops, op.operation, 1);
+                ++c;
+                continue;
+            }
+            if (c < consPos[p])
+                appendAlignmentOp(ops, 'D', consPos[p] - c);  // consensus insertion
+            c = consPos[p];
+            if (kept[p])
+            {
+                appendAlignmentOp(ops, op.operation, 1);
+                ++c;
+            }
+            else if (op.operation == 'M')
+            {
+                appendAlignmentOp(ops, 'I', 1);
+            }
+        }
+    }
+    read.ops.swap(ops);
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function realignBanded()
+// ---------------------------------------------------------------------------
+
+bool realignBanded(std::vector<uint8_t> & consensus,
+                   BandedAlignment & refAlignment,
+                   std::vector<BandedRealignerRead> & reads,
+                   std::vector<uint8_t> const & ref,
+                   int bandwidth,
+                   unsigned maxRounds,
+                   BandedRealignerStats & stats,
+                   std::function<bool()> const & stop)
+{
+    std::vector<BandedRealignerRead> current = reads;
+    std::vector<uint8_t> backbone = ref, cons;
+    std::vector<int> consPos;
+    std::vector<bool> kept;
+    std::vector<BandedAlignmentTask> tasks;
+    std::vector<unsigned> taskReads;
+    std::vector<BandedAlignment> results;
+    unsigned totalIndelBases = 0;
+
+    for (unsigned round = 0; round < maxRounds; ++round)
+    {
+        if (stop && stop())
+            return false;
+        unsigned indelBases = buildConsensus(cons, consPos, kept, backbone, current);
+        if (cons.empty() || (round > 0 && cons == backbone))
+            break;  // converged or nothing to align against, the reads stay aligned against backbone
+        totalIndelBases += indelBases;
+
+        // Realign all reads against the consensus, around their projected previous position.  Reads whose alignment
+        // fails keep the projected one.
+        tasks.clear();
+        taskReads.clear();
+        for (unsigned r = 0; r < current.size(); ++r)
+        {
+            BandedRealignerRead & read = current[r];
+            if (!read.aligned)
+                continue;
+            projectAlignment(read, consPos, kept);
+            if (read.seq.empty())
+                continue;
+            BandedAlignmentTask task;
+            task.read = &read.seq[0];
+            task.readLength = read.seq.size();
+            task.diagonal = read.beginPos;
+            tasks.push_back(task);
+            taskReads.push_back(r);
+        }
+        alignBanded(results, tasks, &cons[0], cons.size(), bandwidth);
+
+        ++stats.rounds;
+        stats.alignments += tasks.size();
+        stats.bandEdgeHits = 0;
+        for (unsigned t = 0; t < tasks.size(); ++t)
+        {
+            if (!results[t].ok)
+                continue;  // keep the projected alignment
+            BandedRealignerRead & read = current[taskReads[t]];
+            read.beginPos = results[t].beginPos;
+            read.ops.swap(results[t].ops);
+            stats.bandEdgeHits += results[t].touchesBandEdge;
+        }
+        backbone.swap(cons);
+    }
+
+    // Align the reference globally against the consensus, the band must cover all consensus indels.
+    if (stop && stop())
+        return false;
+    BandedAlignmentTask task;
+    task.read = ref.empty() ? nullptr : &ref[0];
+    task.readLength = ref.size();
+    task.global = true;
+    std::vector<BandedAlignmentTask> refTasks(1, task);
+    alignBanded(results, refTasks, backbone.empty() ? nullptr : &backbone[0], backbone.size(),
+                bandwidth + totalIndelBases);
+    if (!results[0].ok)
+        return false;
+
+    refAlignment = results[0];
+    consensus.swap(backbone);
+    reads.swap(current);
+    return true;
+}
@@ -0,0 +1,103 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef BANDED_REALIGNER_H_
+#define BANDED_REALIGNER_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "banded_aligner.h"
+
+// ---------------------------------------------------------------------------
+// Class BandedRealignerRead
+// ---------------------------------------------------------------------------
+
+// A read and its alignment, relative to the reference before and to the consensus after realignment.
+
+class BandedRealignerRead
+{
+public:
+    // The aligned part of the read, as codes 0..4 for A, C, G, T, N.
+    std::vector<uint8_t> seq;
+    // Whether the read is aligned, begin position and alignment operations ('M', 'I' and 'D').
+    bool aligned;
+    int beginPos;
+    std::vector<AlignmentOp> ops;
+
+    BandedRealignerRead() : aligned(false), beginPos(0)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Class BandedRealignerStats
+// ---------------------------------------------------------------------------
+
+// Counters of one realignBanded() call.
+
+class BandedRealignerStats
+{
+public:
+    // Number of consensus rounds and of read alignments computed.
+    unsigned rounds;
+    unsigned alignments;
+    // Number of read alignments touching the band's edge in the last round.
+    unsigned bandEdgeHits;
+
+    BandedRealignerStats() : rounds(0), alignments(0), bandEdgeHits(0)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Function realignBanded()
+// ---------------------------------------------------------------------------
+
+// Realign reads against a consensus of the reads, starting with their alignments against ref.  Each round computes
+// the consensus by majority vote from the current alignments and realigns all reads against it with alignBanded(),
+// until the consensus does not change or after maxRounds rounds.  Writes the consensus and the global alignment of
+// ref against it and updates the reads' alignments to be relative to the consensus.  Returns false if ref could not
+// be aligned against the consensus, reads and consensus are not changed in this case.  If given, stop is called
+// before each round and the realignment is given up (returning false) as soon as it returns true.
+
+bool realignBanded(std::vector<uint8_t> & consensus,
+                   BandedAlignment & refAlignment,
+                   std::vector<BandedRealignerRead> & reads,
+                   std::vector<uint8_t> const & ref,
+                   int bandwidth,
+                   unsigned maxRounds,
+                   BandedRealignerStats & stats,
+                   std::function<bool()> const & stop = std::function<bool()>());
+
+#endif  // #ifndef BANDED_REALIGNER_H_
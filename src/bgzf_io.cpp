@@ -0,0 +1,569 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "bgzf_io.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include <seqan/basic.h>
+#include <seqan/stream.h>
+
+namespace {  // anonymous namespace
+
+// Largest size of a BGZF block and of the data compressed into one block (leaving room for incompressible data).
+size_t const BGZF_MAX_BLOCK_SIZE = 65536;
+size_t const BGZF_BLOCK_DATA_SIZE = 0xff00;
+// Size of the header (with the BC extra subfield only) and of the footer (CRC32 and uncompressed size).
+size_t const BGZF_HEADER_SIZE = 18;
+size_t const BGZF_FOOTER_SIZE = 8;
+// The empty block at the end of BGZF files.
+char const BGZF_EOF[28] = { 31, -117, 8, 4, 0, 0, 0, 0, 0, -1, 6, 0, 66, 67, 2, 0, 27, 0, 3, 0,
+                           0, 0, 0, 0, 0, 0, 0, 0 };
+
+// Number of blocks in flight per worker thread.
+unsigned const JOBS_PER_THREAD = 4;
+
+inline void storeUInt16(char * dest, uint32_t value)
+{
+    dest[0] = value & 0xff;
+    dest[1] = (value >> 8) & 0xff;
+}
+
+inline void storeUInt32(char * dest, uint32_t value)
+{
+    storeUInt16(dest, value);
+    storeUInt16(dest + 2, value >> 16);
+}
+
+inline uint32_t loadUInt16(char const * src)
+{
+    return (uint32_t)(unsigned char)src[0] | ((uint32_t)(unsigned char)src[1] << 8);
+}
+
+inline uint32_t loadUInt32(char const * src)
+{
+    return loadUInt16(src) | (loadUInt16(src + 2) << 16);
+}
+
+// ---------------------------------------------------------------------------
+// Class BgzfJob
+// ---------------------------------------------------------------------------
+
+// A block to compress or decompress.
+
+class BgzfJob
+{
+public:
+    std::vector<char> input;
+    std::vector<char> output;
+    bool done;
+    // Error message if processing failed.
+    std::string error;
+
+    BgzfJob() : done(false)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Class BgzfPipeline
+// ---------------------------------------------------------------------------
+
+// Processes jobs in worker threads in any order, the owner takes them out in submission order.  Without worker
+// threads, jobs are processed in submit().
+
+class BgzfPipeline
+{
+public:
+    BgzfPipeline(int numThreads, std::function<void(BgzfJob &)> process) : process(process), stop(false)
+    {
+        for (int i = 0; numThreads > 1 && i < numThreads; ++i)
+            threads.push_back(std::thread([this]() { work(); }));
+    }
+
+    ~BgzfPipeline()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv.notify_all();
+        for (auto & thread : threads)
+            thread.join();
+    }
+
+    // Number of worker threads.
+    unsigned numThreads() const
+    {
+        return threads.size();
+    }
+
+    // Number of jobs that were not taken out yet.
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return jobs.size();
+    }
+
+    // Whether the oldest job is done.
+    bool frontDone()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !jobs.empty() && jobs.front()->done;
+    }
+
+    void submit(std::unique_ptr<BgzfJob> job)
+    {
+        if (threads.empty())
+        {
+            run(*job);
+            jobs.push_back(std::move(job));
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(job.get());
+            jobs.push_back(std::move(job));
+        }
+        cv.notify_all();
+    }
+
+    // Wait for the oldest job and take it out, throws seqan::IOError if it failed.
+    std::unique_ptr<BgzfJob> next()
+    {
+        std::unique_ptr<BgzfJob> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return jobs.front()->done; });
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        if (!job->error.empty())
+            throw seqan::IOError(job->error.c_str());
+        return job;
+    }
+
+private:
+    void run(BgzfJob & job)
+    {
+        try
+        {
+            process(job);
+        }
+        catch (std::exception const & e)
+        {
+            job.error = e.what();
+        }
+        job.done = true;
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            BgzfJob * job = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this]() { return stop || !queue.empty(); });
+                if (stop)
+                    return;
+                job = queue.front();
+                queue.pop_front();
+            }
+            try
+            {
+                process(*job);
+            }
+            catch (std::exception const & e)
+            {
+                job->error = e.what();
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job->done = true;
+            }
+            cv.notify_all();
+        }
+    }
+
+    std::function<void(BgzfJob &)> process;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // All jobs in submission order and the ones not started yet.
+    std::deque<std::unique_ptr<BgzfJob>> jobs;
+    std::deque<BgzfJob *> queue;
+    bool stop;
+    std::vector<std::thread> threads;
+};
+
+// Compress job.input into a BGZF block in job.output.
+void compressBlock(BgzfJob & job, int level)
+{
+    job.output.resize(BGZF_MAX_BLOCK_SIZE);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        throw seqan::IOError("Could not initialize BGZF compression.");
+    zs.next_in = reinterpret_cast<Bytef *>(job.input.data());
+    zs.avail_in = job.input.size();
+    zs.next_out = reinterpret_cast<Bytef *>(&job.output[BGZF_HEADER_SIZE]);
+    zs.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+    int res = deflate(&zs, Z_FINISH);
+    size_t compressedSize = zs.total_out;
+    deflateEnd(&zs);
+    if (res != Z_STREAM_END)
+        throw seqan::IOError("Could not compress BGZF block.");
+
+    size_t blockSize = BGZF_HEADER_SIZE + compressedSize + BGZF_FOOTER_SIZE;
+    char * header = &job.output[0];
+    memcpy(header, BGZF_EOF, BGZF_HEADER_SIZE);
+    storeUInt16(header + 16, blockSize - 1);
+    char * footer = &job.output[BGZF_HEADER_SIZE + compressedSize];
+    storeUInt32(footer, crc32(crc32(0, nullptr, 0), reinterpret_cast<Bytef const *>(job.input.data()),
+                              job.input.size()));
+    storeUInt32(footer + 4, job.input.size());
+    job.output.resize(blockSize);
+}
+
+// Decompress the BGZF block in job.input into job.output.
+void decompressBlock(BgzfJob & job)
+{
+    decompressBgzfBlock(job.output, job.input);
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class BgzfWriterImpl
+// ---------------------------------------------------------------------------
+
+class BgzfWriterImpl
+{
+public:
+    BgzfWriterImpl(std::string const & path, int numThreads, int level) :
+            pipeline(numThreads, [level](BgzfJob & job) { compressBlock(job, level); }),
+            maxInFlight(std::max(1u, JOBS_PER_THREAD * pipeline.numThreads())), closed(false)
+    {
+        file.open(path.c_str(), std::ios::binary | std::ios::out);
+        if (!file.good())
+            throw seqan::IOError("Could not open output BAM file.");
+    }
+
+    void write(char const * data, size_t length)
+    {
+        while (length > 0)
+        {
+            size_t n = std::min(length, BGZF_BLOCK_DATA_SIZE - block.size());
+            block.insert(block.end(), data, data + n);
+            data += n;
+            length -= n;
+            if (block.size() == BGZF_BLOCK_DATA_SIZE)
+                submitBlock();
+        }
+    }
+
+    void flush()
+    {
+        if (!block.empty())
+            submitBlock();
+    }
+
+    void writeBlocks(char const * data, size_t length)
+    {
+        flush();
+        writeDone(true);
+        file.write(data, length);
+        if (!file.good())
+            throw seqan::IOError("Could not write BGZF file.");
+    }
+
+    void close()
+    {
+        if (closed)
+            return;
+        closed = true;
+        flush();
+        writeDone(true);
+        file.write(BGZF_EOF, sizeof(BGZF_EOF));
+        file.close();
+        if (file.fail())
+            throw seqan::IOError("Could not write BGZF file.");
+    }
+
+private:
+    // Hand the current block to the pipeline.
+    void submitBlock()
+    {
+        std::unique_ptr<BgzfJob> job(new BgzfJob);
+        job->input.swap(block);
+        pipeline.submit(std::move(job));
+        writeDone(false);
+    }
+
+    // Write out the compressed blocks that are done, waiting if too many are in flight, or all blocks.
+    void writeDone(bool all)
+    {
+        while (true)
+        {
+            size_t inFlight = pipeline.size();
+            if (inFlight == 0 || (!all && inFlight <= maxInFlight && !pipeline.frontDone()))
+                break;
+            std::unique_ptr<BgzfJob> job = pipeline.next();
+            file.write(job->output.data(), job->output.size());
+            if (!file.good())
+                throw seqan::IOError("Could not write BGZF file.");
+        }
+    }
+
+    std::ofstream file;
+    BgzfPipeline pipeline;
+    size_t maxInFlight;
+    // Data of the next block.
+    std::vector<char> block;
+    bool closed;
+};
+
+// ---------------------------------------------------------------------------
+// Function isBamPath()
+// ---------------------------------------------------------------------------
+
+bool isBamPath(std::string const & path)
+{
+    std::string const suffix = ".bam";
+    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// ---------------------------------------------------------------------------
+// Class BgzfWriter
+// ---------------------------------------------------------------------------
+
+BgzfWriter::BgzfWriter(std::string const & path, int numThreads, int level) :
+        impl(new BgzfWriterImpl(path, numThreads, level))
+{}
+
+BgzfWriter::~BgzfWriter()
+{
+    try
+    {
+        impl->close();
+    }
+    catch (seqan::IOError const &)
+    {
+        // Errors are reported by an explicit close().
+    }
+}
+
+void BgzfWriter::write(char const * data, size_t length)
+{
+    impl->write(data, length);
+}
+
+void BgzfWriter::flush()
+{
+    impl->flush();
+}
+
+void BgzfWriter::writeBlocks(char const * data, size_t length)
+{
+    impl->writeBlocks(data, length);
+}
+
+void BgzfWriter::close()
+{
+    impl->close();
+}
+
+// ---------------------------------------------------------------------------
+// Class BgzfBlockReader
+// ---------------------------------------------------------------------------
+
+BgzfBlockReader::BgzfBlockReader(std::string const & path)
+{
+    file.open(path.c_str(), std::ios::binary | std::ios::in);
+    if (!file.good())
+    {
+        std::string msg = "Could not open BAM file " + path + ".";
+        throw seqan::IOError(msg.c_str());
+    }
+}
+
+bool BgzfBlockReader::readBlock(std::vector<char> & block)
+{
+    block.resize(12);
+    if (!file.read(&block[0], 12))
+    {
+        if (file.gcount() == 0)
+            return false;
+        throw seqan::IOError("Truncated BGZF block.");
+    }
+    if ((unsigned char)block[0] != 31 || (unsigned char)block[1] != 139 || !(block[3] & 4))
+        throw seqan::IOError("Invalid BGZF block header.");
+    size_t extraLength = loadUInt16(&block[10]);
+    block.resize(12 + extraLength);
+    if (!file.read(&block[12], extraLength))
+        throw seqan::IOError("Truncated BGZF block.");
+
+    // Find the BC subfield with the block size.
+    size_t blockSize = 0;
+    for (size_t pos = 12; pos + 4 <= 12 + extraLength; pos += 4 + loadUInt16(&block[pos + 2]))
+        if (block[pos] == 'B' && block[pos + 1] == 'C' && loadUInt16(&block[pos + 2]) == 2)
+            blockSize = loadUInt16(&block[pos + 4]) + 1;
+    if (blockSize < 12 + extraLength + BGZF_FOOTER_SIZE)
+        throw seqan::IOError("Invalid BGZF block header.");
+
+    size_t headerSize = block.size();
+    block.resize(blockSize);
+    if (!file.read(&block[headerSize], blockSize - headerSize))
+        throw seqan::IOError("Truncated BGZF block.");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Function decompressBgzfBlock()
+// ---------------------------------------------------------------------------
+
+void decompressBgzfBlock(std::vector<char> & data, std::vector<char> const & block)
+{
+    size_t headerSize = 12 + loadUInt16(&block[10]);
+    if (block.size() < headerSize + BGZF_FOOTER_SIZE)
+        throw seqan::IOError("Invalid BGZF block.");
+    char const * footer = &block[block.size() - BGZF_FOOTER_SIZE];
+    data.resize(bgzfBlockDataSize(block));
+    if (data.empty())
+        return;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK)
+        throw seqan::IOError("Could not initialize BGZF decompression.");
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(&block[headerSize]));
+    zs.avail_in = block.size() - headerSize - BGZF_FOOTER_SIZE;
+    zs.next_out = reinterpret_cast<Bytef *>(data.data());
+    zs.avail_out = data.size();
+    int res = inflate(&zs, Z_FINISH);
+    inflateEnd(&zs);
+    if (res != Z_STREAM_END || zs.total_out != data.size())
+        throw seqan::IOError("Could not decompress BGZF block.");
+    if (crc32(crc32(0, nullptr, 0), reinterpret_cast<Bytef const *>(data.data()), data.size()) != loadUInt32(footer))
+        throw seqan::IOError("CRC mismatch in BGZF block.");
+}
+
+// ---------------------------------------------------------------------------
+// Function bgzfBlockDataSize()
+// ---------------------------------------------------------------------------
+
+size_t bgzfBlockDataSize(std::vector<char> const & block)
+{
+    return loadUInt32(&block[block.size() - 4]);
+}
+
+// ---------------------------------------------------------------------------
+// Class BgzfInputBufferImpl
+// ---------------------------------------------------------------------------
+
+class BgzfInputBufferImpl
+{
+public:
+    BgzfInputBufferImpl(std::string const & path, int numThreads) :
+            reader(path), pipeline(numThreads, decompressBlock),
+            readAhead(std::max(1u, JOBS_PER_THREAD * pipeline.numThreads())), atEnd(false)
+    {}
+
+    // Make the next non-empty decompressed block current, returns false at the end of the file.
+    bool nextBlock()
+    {
+        do
+        {
+            fill();
+            if (pipeline.size() == 0)
+                return false;
+            current.swap(pipeline.next()->output);
+        }
+        while (current.empty());
+        return true;
+    }
+
+    // The current decompressed block.
+    std::vector<char> current;
+
+private:
+    // Read blocks ahead and submit them for decompression.
+    void fill()
+    {
+        while (!atEnd && pipeline.size() < readAhead)
+        {
+            std::unique_ptr<BgzfJob> job(new BgzfJob);
+            if (!reader.readBlock(job->input))
+                atEnd = true;
+            else
+                pipeline.submit(std::move(job));
+        }
+    }
+
+    BgzfBlockReader reader;
+    BgzfPipeline pipeline;
+    size_t readAhead;
+    bool atEnd;
+};
+
+// ---------------------------------------------------------------------------
+// Class BgzfInputBuffer
+// ---------------------------------------------------------------------------
+
+BgzfInputBuffer::BgzfInputBuffer(std::string const & path, int numThreads) :
+        impl(new BgzfInputBufferImpl(path, numThreads))
+{}
+
+BgzfInputBuffer::~BgzfInputBuffer()
+{}
+
+BgzfInputBuffer::int_type BgzfInputBuffer::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    if (!impl->nextBlock())
+        return traits_type::eof();
+    char * data = impl->current.data();
+    setg(data, data, data + impl->current.size());
+    return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,145 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef BGZF_IO_H_
+#define BGZF_IO_H_
+
+#include <cstddef>
+#include <fstream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+class BgzfWriterImpl;
+class BgzfInputBufferImpl;
+
+// BGZF is the blocked gzip format of BAM files: a series of gzip members of at most 64 KiB each, which can be
+// compressed and decompressed independently.  The classes below use this to (de)compress blocks in worker threads.
+
+// ---------------------------------------------------------------------------
+// Function isBamPath()
+// ---------------------------------------------------------------------------
+
+// Returns whether path names a BAM file (.bam), the only alignment format that the classes below may be used for.
+// Other formats (e.g. SAM) have to be read and written through SeqAn's BamFileIn and BamFileOut.
+
+bool isBamPath(std::string const & path);
+
+// ---------------------------------------------------------------------------
+// Class BgzfWriter
+// ---------------------------------------------------------------------------
+
+// Writes a BGZF file.  The data is cut into blocks that are compressed by numThreads worker threads (in the calling
+// thread for numThreads <= 1) with the given zlib compression level, 0 for storing uncompressed blocks.  The blocks
+// are written out in order.  Throws seqan::IOError on errors.
+
+class BgzfWriter
+{
+public:
+    BgzfWriter(std::string const & path, int numThreads, int level);
+    ~BgzfWriter();  // for pimpl, calls close()
+
+    // Append data.
+    void write(char const * data, size_t length);
+
+    // End the current block, the following data starts a new one.
+    void flush();
+
+    // Append complete BGZF blocks as they are, e.g. as read by BgzfBlockReader.  The current block is ended first.
+    void writeBlocks(char const * data, size_t length);
+
+    // Write out all data and the end-of-file marker block and close the file.
+    void close();
+
+private:
+    std::unique_ptr<BgzfWriterImpl> impl;
+};
+
+// ---------------------------------------------------------------------------
+// Class BgzfBlockReader
+// ---------------------------------------------------------------------------
+
+// Reads the compressed blocks of a BGZF file one by one.  Throws seqan::IOError on errors.
+
+class BgzfBlockReader
+{
+public:
+    explicit BgzfBlockReader(std::string const & path);
+
+    // Read the next block into block, returns false at the end of the file.
+    bool readBlock(std::vector<char> & block);
+
+private:
+    std::ifstream file;
+};
+
+// ---------------------------------------------------------------------------
+// Function decompressBgzfBlock()
+// ---------------------------------------------------------------------------
+
+// Decompress a block as read by BgzfBlockReader into data.  Throws seqan::IOError on errors.
+
+void decompressBgzfBlock(std::vector<char> & data, std::vector<char> const & block);
+
+// ---------------------------------------------------------------------------
+// Function bgzfBlockDataSize()
+// ---------------------------------------------------------------------------
+
+// Returns the uncompressed size of the data in a block as read by BgzfBlockReader, 0 for the end-of-file block.
+
+size_t bgzfBlockDataSize(std::vector<char> const & block);
+
+// ---------------------------------------------------------------------------
+// Class BgzfInputBuffer
+// ---------------------------------------------------------------------------
+
+// Stream buffer with the decompressed contents of a BGZF file, for reading sequentially through a std::istream.  The
+// blocks ahead of the reading position are decompressed by numThreads worker threads.  Seeking is not supported.
+// Throws seqan::IOError on errors.
+
+class BgzfInputBuffer : public std::streambuf
+{
+public:
+    BgzfInputBuffer(std::string const & path, int numThreads);
+    ~BgzfInputBuffer();  // for pimpl
+
+protected:
+    int_type underflow() override;
+
+private:
+    std::unique_ptr<BgzfInputBufferImpl> impl;
+};
+
+#endif  // #ifndef BGZF_IO_H_
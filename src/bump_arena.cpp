@@ -0,0 +1,96 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "bump_arena.h"
+
+#include <algorithm>
+
+// ---------------------------------------------------------------------------
+// Class BumpArena
+// ---------------------------------------------------------------------------
+
+void * BumpArena::allocate(size_t bytes, size_t alignment)
+{
+    while (true)
+    {
+        if (current < blocks.size())
+        {
+            size_t pos = (offset + alignment - 1) & ~(alignment - 1);
+            if (pos + bytes <= blockSizes[current])
+            {
+                offset = pos + bytes;
+                return blocks[current].get() + pos;
+            }
+            if (current + 1 == blocks.size())
+            {
+                // Add a new block, at least twice as large as the last one.
+                size_t size = std::max(bytes, 2 * blockSizes.back());
+                blocks.push_back(std::unique_ptr<char[]>(new char[size]));
+                blockSizes.push_back(size);
+            }
+            ++current;
+            offset = 0;
+        }
+        else
+        {
+            size_t size = std::max(bytes, initialBlockSize);
+            blocks.push_back(std::unique_ptr<char[]>(new char[size]));
+            blockSizes.push_back(size);
+            current = blocks.size() - 1;
+            offset = 0;
+        }
+    }
+}
+
+void BumpArena::reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = capacity();
+        blocks.clear();
+        blockSizes.clear();
+        blocks.push_back(std::unique_ptr<char[]>(new char[total]));
+        blockSizes.push_back(total);
+    }
+    current = 0;
+    offset = 0;
+}
+
+size_t BumpArena::capacity() const
+{
+    size_t total = 0;
+    for (auto size : blockSizes)
+        total += size;
+    return total;
+}
@@ -0,0 +1,125 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef BUMP_ARENA_H_
+#define BUMP_ARENA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// ---------------------------------------------------------------------------
+// Class BumpArena
+// ---------------------------------------------------------------------------
+
+// Memory for short-lived temporaries.  Allocations are served by bumping an offset into a block, freeing single
+// allocations is a no-op and reset() releases all of them at once.  After a reset, the blocks are merged into one, so
+// a following run with the same memory needs is served from a single block without calling malloc.
+
+class BumpArena
+{
+public:
+    explicit BumpArena(size_t initialBlockSize = 64 * 1024) :
+            initialBlockSize(initialBlockSize), current(0), offset(0)
+    {}
+
+    // Returns bytes of memory aligned to alignment, which must be a power of two not larger than
+    // alignof(std::max_align_t).
+    void * allocate(size_t bytes, size_t alignment);
+
+    // Release all allocations.
+    void reset();
+
+    // Returns the total size of the blocks.
+    size_t capacity() const;
+
+private:
+    // Size of the first block.
+    size_t initialBlockSize;
+    // The blocks and their sizes.
+    std::vector<std::unique_ptr<char[]>> blocks;
+    std::vector<size_t> blockSizes;
+    // Index of the block allocations are served from and offset of the free space in it.
+    size_t current;
+    size_t offset;
+};
+
+// ---------------------------------------------------------------------------
+// Class BumpAllocator
+// ---------------------------------------------------------------------------
+
+// Standard allocator that allocates from a BumpArena, for containers of per-window temporaries.  The containers must
+// be destroyed before the arena is reset.
+
+template <typename T>
+class BumpAllocator
+{
+public:
+    typedef T value_type;
+
+    BumpAllocator(BumpArena & arena) : arena(&arena)
+    {}
+
+    template <typename U>
+    BumpAllocator(BumpAllocator<U> const & other) : arena(other.arena)
+    {}
+
+    T * allocate(size_t n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t)
+    {}
+
+    BumpArena * arena;
+};
+
+template <typename T, typename U>
+inline bool operator==(BumpAllocator<T> const & lhs, BumpAllocator<U> const & rhs)
+{
+    return lhs.arena == rhs.arena;
+}
+
+template <typename T, typename U>
+inline bool operator!=(BumpAllocator<T> const & lhs, BumpAllocator<U> const & rhs)
+{
+    return lhs.arena != rhs.arena;
+}
+
+// Vector allocating from a BumpArena.
+template <typename T>
+using BumpVector = std::vector<T, BumpAllocator<T>>;
+
+#endif  // #ifndef BUMP_ARENA_H_
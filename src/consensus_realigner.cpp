@@ -0,0 +1,387 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "consensus_realigner.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <utility>
+
+// Compile the mismatch kernel for several instruction sets and select the best one at runtime, see banded_aligner.cpp.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 6) && defined(__x86_64__) && defined(__linux__)
+#define CONSENSUS_TARGET_CLONES __attribute__((target_clones("avx2", "sse4.1", "default")))
+#else
+#define CONSENSUS_TARGET_CLONES
+#endif
+
+namespace {  // anonymous namespace
+
+// Vector of one byte per lane, for comparing bases and masking qualities.
+typedef uint8_t TBytes __attribute__((vector_size(32)));
+unsigned const LANES = sizeof(TBytes);
+
+// Code of N, mismatches against N are not counted.
+uint8_t const CODE_N = 4;
+
+// Number of haplotypes evaluated per window, the reference excluded.
+unsigned const MAX_HAPLOTYPES = 8;
+
+// Reads are placed within SEARCH_RADIUS plus the allele's length of their expected position.
+int const SEARCH_RADIUS = 10;
+
+// ---------------------------------------------------------------------------
+// Class IndelAllele
+// ---------------------------------------------------------------------------
+
+// An insertion or deletion at position pos of the reference.
+
+class IndelAllele
+{
+public:
+    int pos;
+    // 'I' or 'D', the number of inserted or deleted bases and the inserted bases.
+    char operation;
+    unsigned length;
+    std::vector<uint8_t> inserted;
+
+    IndelAllele() : pos(0), operation('D'), length(0)
+    {}
+
+    bool operator<(IndelAllele const & other) const
+    {
+        return std::make_pair(std::make_pair(pos, operation), std::make_pair(length, inserted)) <
+                std::make_pair(std::make_pair(other.pos, other.operation), std::make_pair(other.length,
+                                                                                          other.inserted));
+    }
+};
+
+// ---------------------------------------------------------------------------
+// Function mismatchSum()
+// ---------------------------------------------------------------------------
+
+// Sum of the qualities of read bases mismatching seq, N in either sequence is not counted.  LANES bases are compared
+// at once.
+
+CONSENSUS_TARGET_CLONES
+int mismatchSum(uint8_t const * read, uint8_t const * qual, uint8_t const * seq, unsigned length)
+{
+    TBytes const n = { 0 };
+    TBytes const codeN = n + CODE_N;
+
+    int sum = 0;
+    unsigned i = 0;
+    for (; i + LANES <= length; i += LANES)
+    {
+        TBytes r, q, s;
+        memcpy(&r, read + i, sizeof(TBytes));
+        memcpy(&q, qual + i, sizeof(TBytes));
+        memcpy(&s, seq + i, sizeof(TBytes));
+        TBytes masked = q & (TBytes)((r != s) & (r != codeN) & (s != codeN));
+        for (unsigned l = 0; l < LANES; ++l)
+            sum += masked[l];
+    }
+    for (; i < length; ++i)
+        if (read[i] != seq[i] && read[i] != CODE_N && seq[i] != CODE_N)
+            sum += qual[i];
+    return sum;
+}
+
+// Place read ungapped in seq with begin positions in [lo, hi], return the smallest mismatch sum and set bestPos.
+// Returns INT_MAX if the read does not fit in seq.
+
+int bestPlacement(int & bestPos, ConsensusRealignerRead const & read, std::vector<uint8_t> const & seq, int lo, int hi)
+{
+    int const length = read.seq.size();
+    lo = std::max(lo, 0);
+    hi = std::min(hi, (int)seq.size() - length);
+
+    int best = INT_MAX;
+    for (int pos = lo; pos <= hi; ++pos)
+    {
+        int sum = mismatchSum(&read.seq[0], &read.qual[0], &seq[pos], length);
+        if (sum < best)  // leftmost placement on ties
+        {
+            best = sum;
+            bestPos = pos;
+        }
+    }
+    return best;
+}
+
+// Mismatch sum of read's original alignment against ref, gaps are not counted.
+
+int alignerMismatchSum(ConsensusRealignerRead const & read, std::vector<uint8_t> const & ref)
+{
+    int sum = 0;
+    int refPos = read.beginPos;
+    unsigned readPos = 0;
+    for (auto const & op : read.ops)
+    {
+        if (op.operation == 'M')
+        {
+            sum += mismatchSum(&read.seq[readPos], &read.qual[readPos], &ref[refPos], op.count);
+            readPos += op.count;
+            refPos += op.count;
+        }
+        else if (op.operation == 'I')
+        {
+            readPos += op.count;
+        }
+        else
+        {
+            refPos += op.count;
+        }
+    }
+    return sum;
+}
+
+// Whether read's alignment lies within ref.
+
+bool fitsReference(ConsensusRealignerRead const & read, std::vector<uint8_t> const & ref)
+{
+    if (!read.aligned || read.seq.empty() || read.beginPos < 0)
+        return false;
+    unsigned readLength = 0, refLength = 0;
+    for (auto const & op : read.ops)
+    {
+        if (op.operation != 'D')
+            readLength += op.count;
+        if (op.operation != 'I')
+            refLength += op.count;
+    }
+    return readLength == read.seq.size() && read.beginPos + refLength <= ref.size();
+}
+
+// Collect the indel alleles of the reads' alignments with their number of occurrences.
+
+void collectAlleles(std::map<IndelAllele, unsigned> & alleles, std::vector<ConsensusRealignerRead> const & reads,
+                    std::vector<bool> const & usable)
+{
+    for (unsigned i = 0; i < reads.size(); ++i)
+    {
+        if (!usable[i])
+            continue;
+        int refPos = reads[i].beginPos;
+        unsigned readPos = 0;
+        for (auto const & op : reads[i].ops)
+        {
+            if (op.operation != 'M' && refPos != reads[i].beginPos)  // indels at the read borders are not anchored
+            {
+                IndelAllele allele;
+                allele.pos = refPos;
+                allele.operation = op.operation;
+                allele.length = op.count;
+                if (op.operation == 'I')
+                    allele.inserted.assign(reads[i].seq.begin() + readPos, reads[i].seq.begin() + readPos + op.count);
+                alleles[allele] += 1;
+            }
+            if (op.operation != 'D')
+                readPos += op.count;
+            if (op.operation != 'I')
+                refPos += op.count;
+        }
+    }
+}
+
+// Build the haplotype of allele from ref.
+
+void buildHaplotype(std::vector<uint8_t> & haplotype, IndelAllele const & allele, std::vector<uint8_t> const & ref)
+{
+    haplotype.assign(ref.begin(), ref.begin() + allele.pos);
+    if (allele.operation == 'I')
+    {
+        haplotype.insert(haplotype.end(), allele.inserted.begin(), allele.inserted.end());
+        haplotype.insert(haplotype.end(), ref.begin() + allele.pos, ref.end());
+    }
+    else
+    {
+        haplotype.insert(haplotype.end(), ref.begin() + std::min(ref.size(), (size_t)(allele.pos + allele.length)),
+                         ref.end());
+    }
+}
+
+// Position in the haplotype of allele of reference position refPos.
+
+int toHaplotypePosition(IndelAllele const & allele, int refPos)
+{
+    if (refPos < allele.pos)
+        return refPos;
+    if (allele.operation == 'I')
+        return refPos + allele.length;
+    return std::max(allele.pos, refPos - (int)allele.length);
+}
+
+// Translate the ungapped placement at hapPos in the haplotype of allele to an alignment against the reference.
+// Returns false for placements that begin or end within an insertion.
+
+bool toReferenceAlignment(int & beginPos, std::vector<AlignmentOp> & ops, IndelAllele const & allele, int hapPos,
+                          unsigned length)
+{
+    ops.clear();
+    int const hapEnd = hapPos + length;
+    if (hapEnd <= allele.pos)  // left of the allele
+    {
+        beginPos = hapPos;
+        appendAlignmentOp(ops, 'M', length);
+        return true;
+    }
+    if (allele.operation == 'I')
+    {
+        int const insEnd = allele.pos + allele.length;
+        if (hapPos >= insEnd)  // right of the insertion
+        {
+            beginPos = hapPos - allele.length;
+            appendAlignmentOp(ops, 'M', length);
+            return true;
+        }
+        if (hapPos >= allele.pos || hapEnd <= insEnd)
+            return false;
+        beginPos = hapPos;
+        appendAlignmentOp(ops, 'M', allele.pos - hapPos);
+        appendAlignmentOp(ops, 'I', allele.length);
+        appendAlignmentOp(ops, 'M', hapEnd - insEnd);
+        return true;
+    }
+    if (hapPos >= allele.pos)  // right of the deletion
+    {
+        beginPos = hapPos + allele.length;
+        appendAlignmentOp(ops, 'M', length);
+        return true;
+    }
+    beginPos = hapPos;
+    appendAlignmentOp(ops, 'M', allele.pos - hapPos);
+    appendAlignmentOp(ops, 'D', allele.length);
+    appendAlignmentOp(ops, 'M', hapEnd - allele.pos);
+    return true;
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function realignConsensus()
+// ---------------------------------------------------------------------------
+
+bool realignConsensus(std::vector<ConsensusRealignerRead> & reads,
+                      std::vector<uint8_t> const & ref,
+                      double minLod,
+                      ConsensusRealignerStats & stats,
+                      std::function<bool()> const & stop)
+{
+    stats = ConsensusRealignerStats();
+
+    // Score the original alignments, only the voting reads count for choosing the haplotype.
+    std::vector<bool> usable(reads.size()), voting(reads.size());
+    std::vector<int> alignerSums(reads.size(), 0);
+    long long totalAlignerSum = 0;
+    for (unsigned i = 0; i < reads.size(); ++i)
+    {
+        usable[i] = fitsReference(reads[i], ref) && reads[i].qual.size() == reads[i].seq.size();
+        voting[i] = usable[i] && reads[i].votes;
+        if (!usable[i])
+            continue;
+        alignerSums[i] = alignerMismatchSum(reads[i], ref);
+        if (voting[i])
+            totalAlignerSum += alignerSums[i];
+    }
+
+    // Pick the most frequent alleles, ties broken by position for reproducible results.
+    std::map<IndelAllele, unsigned> alleleCounts;
+    collectAlleles(alleleCounts, reads, voting);
+    stats.alleles = alleleCounts.size();
+    std::vector<std::pair<unsigned, IndelAllele> > candidates;
+    for (auto const & entry : alleleCounts)
+        candidates.push_back(std::make_pair(entry.second, entry.first));
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](std::pair<unsigned, IndelAllele> const & lhs, std::pair<unsigned, IndelAllele> const & rhs) {
+                         return lhs.first > rhs.first;
+                     });
+    if (candidates.size() > MAX_HAPLOTYPES)
+        candidates.resize(MAX_HAPLOTYPES);
+    stats.haplotypes = candidates.size();
+
+    // Score each read against each haplotype, a read contributes the better of its placement and its original
+    // alignment.
+    std::vector<uint8_t> haplotype;
+    long long bestSum = totalAlignerSum;
+    int best = -1;
+    for (unsigned c = 0; c < candidates.size(); ++c)
+    {
+        if (stop && stop())
+            return false;
+        IndelAllele const & allele = candidates[c].second;
+        buildHaplotype(haplotype, allele, ref);
+        int const radius = SEARCH_RADIUS + allele.length;
+
+        long long sum = 0;
+        for (unsigned i = 0; i < reads.size() && sum < bestSum; ++i)
+        {
+            if (!voting[i])
+                continue;
+            int expected = toHaplotypePosition(allele, reads[i].beginPos), pos = 0;
+            sum += std::min(alignerSums[i], bestPlacement(pos, reads[i], haplotype, expected - radius,
+                                                          expected + radius));
+        }
+        if (sum < bestSum)
+        {
+            bestSum = sum;
+            best = c;
+        }
+    }
+
+    stats.improvement = (totalAlignerSum - bestSum) / 10.0;
+    if (best == -1 || stats.improvement < minLod)
+        return false;
+
+    // Realign the reads that fit the winning haplotype better than their original alignment.
+    IndelAllele const & allele = candidates[best].second;
+    buildHaplotype(haplotype, allele, ref);
+    int const radius = SEARCH_RADIUS + allele.length;
+    std::vector<AlignmentOp> ops;
+    for (unsigned i = 0; i < reads.size(); ++i)
+    {
+        if (!usable[i])
+            continue;
+        int expected = toHaplotypePosition(allele, reads[i].beginPos), pos = 0, beginPos = 0;
+        int sum = bestPlacement(pos, reads[i], haplotype, expected - radius, expected + radius);
+        if (sum >= alignerSums[i] || !toReferenceAlignment(beginPos, ops, allele, pos, reads[i].seq.size()))
+            continue;
+        reads[i].beginPos = beginPos;
+        reads[i].ops = ops;
+        reads[i].realigned = true;
+        stats.realignedReads += 1;
+    }
+    return stats.realignedReads != 0;
+}
@@ -0,0 +1,108 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef CONSENSUS_REALIGNER_H_
+#define CONSENSUS_REALIGNER_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "banded_aligner.h"
+
+// ---------------------------------------------------------------------------
+// Class ConsensusRealignerRead
+// ---------------------------------------------------------------------------
+
+// A read and its alignment against the reference.
+
+class ConsensusRealignerRead
+{
+public:
+    // The aligned part of the read, as codes 0..4 for A, C, G, T, N, and its base qualities (phred scale).
+    std::vector<uint8_t> seq;
+    std::vector<uint8_t> qual;
+    // Whether the read is aligned, begin position and alignment operations ('M', 'I' and 'D').
+    bool aligned;
+    int beginPos;
+    std::vector<AlignmentOp> ops;
+    // Whether the read takes part in choosing the haplotype, otherwise it is only placed on the winning one (e.g. for
+    // the reads held back by downsampling).
+    bool votes;
+    // Set by realignConsensus() for reads that were moved to the winning haplotype.
+    bool realigned;
+
+    ConsensusRealignerRead() : aligned(false), beginPos(0), votes(true), realigned(false)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Class ConsensusRealignerStats
+// ---------------------------------------------------------------------------
+
+// Counters of one realignConsensus() call.
+
+class ConsensusRealignerStats
+{
+public:
+    // Number of distinct indel alleles and of evaluated alternative haplotypes.
+    unsigned alleles;
+    unsigned haplotypes;
+    // Improvement of the best haplotype over the original alignments, in LOD units.
+    double improvement;
+    // Number of realigned reads.
+    unsigned realignedReads;
+
+    ConsensusRealignerStats() : alleles(0), haplotypes(0), improvement(0), realignedReads(0)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Function realignConsensus()
+// ---------------------------------------------------------------------------
+
+// Realign reads against candidate haplotypes, as done by the GATK IndelRealigner.  Each of the most frequent indel
+// alleles in the reads' alignments gives one haplotype, the reference with this indel.  Each read is placed ungapped
+// at the offset with the smallest sum of mismatching base qualities around its original position.  If the best
+// haplotype improves the sum over the voting reads by at least minLod (in units of 10 phred), all reads that fit it
+// better than their original alignment are realigned to it.  Returns whether reads were realigned.  If given, stop is
+// called before scoring each haplotype and no reads are realigned (returning false) as soon as it returns true.
+
+bool realignConsensus(std::vector<ConsensusRealignerRead> & reads,
+                      std::vector<uint8_t> const & ref,
+                      double minLod,
+                      ConsensusRealignerStats & stats,
+                      std::function<bool()> const & stop = std::function<bool()>());
+
+#endif  // #ifndef CONSENSUS_REALIGNER_H_
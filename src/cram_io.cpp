@@ -0,0 +1,464 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "cram_io.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef BAM_REALIGNER_HAVE_HTSLIB
+#include <htslib/sam.h>
+#endif  // #ifdef BAM_REALIGNER_HAVE_HTSLIB
+
+#ifdef BAM_REALIGNER_HAVE_HTSLIB
+
+namespace {  // anonymous namespace
+
+// Names of the SAM header record types, indexed by seqan::BamHeaderRecordType.
+char const * const HEADER_TYPES[] = { "@HD", "@SQ", "@RG", "@PG", "@CO" };
+
+// Append the SAM text of header to out.  Comments are stored as one tag with empty key.  As in BAM output, the
+// references are taken from the context of contextFile if header has no @SQ records.
+void headerToText(std::string & out, seqan::BamHeader const & header, seqan::BamFileOut & contextFile)
+{
+    bool hasReferences = false;
+    for (unsigned i = 0; i < length(header); ++i)
+    {
+        hasReferences = hasReferences || header[i].type == seqan::BAM_HEADER_REFERENCE;
+        out += HEADER_TYPES[header[i].type];
+        for (auto const & tag : header[i].tags)
+        {
+            out += '\t';
+            if (!empty(tag.i1))
+                out.append(toCString(tag.i1)).append(":");
+            out += toCString(tag.i2);
+        }
+        out += '\n';
+    }
+    if (hasReferences)
+        return;
+    for (unsigned rID = 0; rID < length(contigNames(context(contextFile))); ++rID)
+        out.append("@SQ\tSN:").append(toCString(contigNames(context(contextFile))[rID])).append("\tLN:")
+           .append(std::to_string(contigLengths(context(contextFile))[rID])).append("\n");
+}
+
+// Parse the SAM header text into header.
+void textToHeader(seqan::BamHeader & header, char const * text)
+{
+    std::istringstream in(text);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.size() < 3 || line[0] != '@')
+            continue;
+        seqan::BamHeaderRecord record;
+        unsigned type = 0;
+        while (type < 5 && line.compare(0, 3, HEADER_TYPES[type]) != 0)
+            ++type;
+        if (type == 5)
+            continue;  // skip unknown record type
+        record.type = static_cast<seqan::BamHeaderRecordType>(type);
+        if (record.type == seqan::BAM_HEADER_COMMENT)
+        {
+            appendValue(record.tags, seqan::BamHeaderRecord::TTag("", line.size() > 4 ? line.substr(4) : ""));
+        }
+        else
+        {
+            std::istringstream fields(line.substr(3));
+            std::string field;
+            while (std::getline(fields, field, '\t'))
+                if (field.size() >= 3 && field[2] == ':')
+                    appendValue(record.tags, seqan::BamHeaderRecord::TTag(field.substr(0, 2), field.substr(3)));
+        }
+        appendValue(header, record);
+    }
+}
+
+// Convert the htslib record b to record.  The tags are stored raw as in BAM by both.
+void toSeqAnRecord(seqan::BamAlignmentRecord & record, bam1_t const * b)
+{
+    record.qName = bam_get_qname(b);
+    record.flag = b->core.flag;
+    record.rID = b->core.tid;
+    record.beginPos = b->core.pos;
+    record.mapQ = b->core.qual;
+    record.bin = b->core.bin;
+
+    clear(record.cigar);
+    uint32_t const * cigar = bam_get_cigar(b);
+    for (unsigned i = 0; i < b->core.n_cigar; ++i)
+        appendValue(record.cigar, seqan::CigarElement<>(BAM_CIGAR_STR[bam_cigar_op(cigar[i])],
+                                                        bam_cigar_oplen(cigar[i])));
+
+    record.rNextId = b->core.mtid;
+    record.pNext = b->core.mpos;
+    record.tLen = b->core.isize;
+
+    uint8_t const * seq = bam_get_seq(b);
+    uint8_t const * qual = bam_get_qual(b);
+    resize(record.seq, b->core.l_qseq);
+    for (int i = 0; i < b->core.l_qseq; ++i)
+        record.seq[i] = seq_nt16_str[bam_seqi(seq, i)];
+    clear(record.qual);
+    if (b->core.l_qseq > 0 && qual[0] != 0xff)
+    {
+        resize(record.qual, b->core.l_qseq);
+        for (int i = 0; i < b->core.l_qseq; ++i)
+            record.qual[i] = static_cast<char>(qual[i] + '!');
+    }
+
+    uint8_t const * aux = bam_get_aux(b);
+    int auxLength = bam_get_l_aux(b);
+    resize(record.tags, auxLength);
+    std::copy(aux, aux + auxLength, begin(record.tags, seqan::Standard()));
+}
+
+// Convert record to the htslib record b, using buffers for the CIGAR, sequence and qualities.
+void toHtsRecord(bam1_t * b, seqan::BamAlignmentRecord const & record, std::vector<uint32_t> & cigar,
+                 std::string & seq, std::string & qual)
+{
+    cigar.clear();
+    for (auto const & el : record.cigar)
+        cigar.push_back(bam_cigar_gen(el.count, bam_cigar_table[static_cast<unsigned char>(el.operation)]));
+    seq.clear();
+    for (unsigned i = 0; i < length(record.seq); ++i)
+        seq.push_back(static_cast<char>(record.seq[i]));
+    qual.clear();
+    for (auto c : record.qual)
+        qual.push_back(static_cast<char>(c - '!'));
+
+    if (bam_set1(b, length(record.qName), toCString(record.qName), record.flag, record.rID, record.beginPos,
+                 record.mapQ, cigar.size(), cigar.data(), record.rNextId, record.pNext, record.tLen, seq.size(),
+                 seq.data(), qual.empty() ? nullptr : qual.data(), length(record.tags)) < 0)
+        throw seqan::IOError("Could not convert record for CRAM output.");
+    // bam_set1() only reserves room for the tags, copy them in the raw BAM encoding.
+    std::copy(begin(record.tags, seqan::Standard()), end(record.tags, seqan::Standard()), b->data + b->l_data);
+    b->l_data += length(record.tags);
+}
+
+// Open path with the given htslib mode and reference, throws seqan::IOError on errors.
+htsFile * openHtsFile(std::string const & path, char const * mode, std::string const & referencePath, int numThreads)
+{
+    htsFile * fp = hts_open(path.c_str(), mode);
+    if (!fp)
+    {
+        std::string msg = "Could not open CRAM file " + path;
+        throw seqan::IOError(msg.c_str());
+    }
+    if (hts_set_fai_filename(fp, referencePath.c_str()) != 0 || (numThreads > 1 && hts_set_threads(fp, numThreads)))
+    {
+        hts_close(fp);
+        throw seqan::IOError("Could not set up CRAM file.");
+    }
+    return fp;
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class CramFileInImpl
+// ---------------------------------------------------------------------------
+
+class CramFileInImpl
+{
+public:
+    CramFileInImpl(std::string const & path, std::string const & referencePath, int numThreads) :
+            path(path), fp(openHtsFile(path, "rc", referencePath, numThreads)), hdr(nullptr), idx(nullptr),
+            itr(nullptr), b(bam_init1())
+    {}
+
+    ~CramFileInImpl()
+    {
+        bam_destroy1(b);
+        if (itr)
+            hts_itr_destroy(itr);
+        if (idx)
+            hts_idx_destroy(idx);
+        if (hdr)
+            sam_hdr_destroy(hdr);
+        hts_close(fp);
+    }
+
+    void readHeader(seqan::BamHeader & header, seqan::BamFileIn & contextFile);
+    void loadIndex();
+    void jumpTo(int rID, int beginPos);
+    bool readRecord(seqan::BamAlignmentRecord & record);
+
+private:
+    std::string path;
+    htsFile * fp;
+    sam_hdr_t * hdr;
+    hts_idx_t * idx;
+    // Iterator of the last jumpTo(), nullptr before.
+    hts_itr_t * itr;
+    // Buffer for the record read last.
+    bam1_t * b;
+};
+
+void CramFileInImpl::readHeader(seqan::BamHeader & header, seqan::BamFileIn & contextFile)
+{
+    hdr = sam_hdr_read(fp);
+    if (!hdr)
+        throw seqan::IOError("Could not read CRAM header.");
+    clear(header);
+    textToHeader(header, sam_hdr_str(hdr));
+    for (int rID = 0; rID < sam_hdr_nref(hdr); ++rID)
+    {
+        appendName(contigNamesCache(context(contextFile)), sam_hdr_tid2name(hdr, rID));
+        appendValue(contigLengths(context(contextFile)), sam_hdr_tid2len(hdr, rID));
+    }
+}
+
+void CramFileInImpl::loadIndex()
+{
+    idx = sam_index_load(fp, path.c_str());
+    if (!idx)
+        throw seqan::IOError("Could not open CRAI file.");
+}
+
+void CramFileInImpl::jumpTo(int rID, int beginPos)
+{
+    if (itr)
+        hts_itr_destroy(itr);
+    itr = sam_itr_queryi(idx, rID, beginPos, HTS_POS_MAX);
+    if (!itr)
+        throw seqan::IOError("Problem jumping in file.\n");
+}
+
+bool CramFileInImpl::readRecord(seqan::BamAlignmentRecord & record)
+{
+    int res = itr ? sam_itr_next(fp, itr, b) : sam_read1(fp, hdr, b);
+    if (res == -1)
+        return false;  // end of file or contig
+    if (res < -1)
+        throw seqan::IOError("Could not read CRAM record.");
+    toSeqAnRecord(record, b);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Class CramFileOutImpl
+// ---------------------------------------------------------------------------
+
+class CramFileOutImpl
+{
+public:
+    CramFileOutImpl(std::string const & path, std::string const & referencePath, int numThreads,
+                    int compressionLevel) :
+            fp(openHtsFile(path, "wc", referencePath, numThreads)), hdr(nullptr), b(bam_init1())
+    {
+        if (hts_set_opt(fp, HTS_OPT_COMPRESSION_LEVEL, compressionLevel) != 0)
+        {
+            hts_close(fp);
+            bam_destroy1(b);
+            throw seqan::IOError("Could not set CRAM compression level.");
+        }
+    }
+
+    ~CramFileOutImpl()
+    {
+        // Only reached without close() on errors, so the result does not matter.
+        if (hdr)
+            sam_hdr_destroy(hdr);
+        if (fp)
+            hts_close(fp);
+        bam_destroy1(b);
+    }
+
+    void writeHeader(seqan::BamHeader const & header, seqan::BamFileOut & contextFile);
+    void writeRecord(seqan::BamAlignmentRecord const & record);
+    void close();
+
+private:
+    htsFile * fp;
+    sam_hdr_t * hdr;
+    bam1_t * b;
+
+    // Buffers for converting records.
+    std::vector<uint32_t> cigar;
+    std::string seq;
+    std::string qual;
+};
+
+void CramFileOutImpl::writeHeader(seqan::BamHeader const & header, seqan::BamFileOut & contextFile)
+{
+    std::string text;
+    headerToText(text, header, contextFile);
+    hdr = sam_hdr_parse(text.size(), text.c_str());
+    if (!hdr || sam_hdr_write(fp, hdr) != 0)
+        throw seqan::IOError("Could not write CRAM header.");
+}
+
+void CramFileOutImpl::writeRecord(seqan::BamAlignmentRecord const & record)
+{
+    toHtsRecord(b, record, cigar, seq, qual);
+    if (sam_write1(fp, hdr, b) < 0)
+        throw seqan::IOError("Could not write CRAM record.");
+}
+
+void CramFileOutImpl::close()
+{
+    if (!fp)
+        return;
+    int res = hts_close(fp);
+    fp = nullptr;
+    if (hdr)
+        sam_hdr_destroy(hdr);
+    hdr = nullptr;
+    if (res != 0)
+        throw seqan::IOError("Could not close CRAM file.");
+}
+
+#else  // #ifdef BAM_REALIGNER_HAVE_HTSLIB
+
+namespace {  // anonymous namespace
+
+char const * const NO_HTSLIB_MSG = "CRAM files need a build with htslib (cmake -DBAM_REALIGNER_WITH_HTSLIB=ON).";
+
+}  // anonymous namespace
+
+// Without htslib, the constructors throw and the members are never called.
+
+class CramFileInImpl
+{
+public:
+    CramFileInImpl(std::string const &, std::string const &, int)
+    {
+        throw seqan::IOError(NO_HTSLIB_MSG);
+    }
+
+    void readHeader(seqan::BamHeader &, seqan::BamFileIn &) {}
+    void loadIndex() {}
+    void jumpTo(int, int) {}
+    bool readRecord(seqan::BamAlignmentRecord &) { return false; }
+};
+
+class CramFileOutImpl
+{
+public:
+    CramFileOutImpl(std::string const &, std::string const &, int, int)
+    {
+        throw seqan::IOError(NO_HTSLIB_MSG);
+    }
+
+    void writeHeader(seqan::BamHeader const &, seqan::BamFileOut &) {}
+    void writeRecord(seqan::BamAlignmentRecord const &) {}
+    void close() {}
+};
+
+#endif  // #ifdef BAM_REALIGNER_HAVE_HTSLIB
+
+// ---------------------------------------------------------------------------
+// Function isCramPath()
+// ---------------------------------------------------------------------------
+
+bool isCramPath(std::string const & path)
+{
+    std::string const suffix = ".cram";
+    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// ---------------------------------------------------------------------------
+// Class CramFileIn
+// ---------------------------------------------------------------------------
+
+CramFileIn::CramFileIn(std::string const & path, std::string const & referencePath, int numThreads) :
+        impl(new CramFileInImpl(path, referencePath, numThreads))
+{}
+
+CramFileIn::~CramFileIn()  // for pimpl
+{}
+
+void CramFileIn::readHeader(seqan::BamHeader & header, seqan::BamFileIn & contextFile)
+{
+    impl->readHeader(header, contextFile);
+}
+
+void CramFileIn::loadIndex()
+{
+    impl->loadIndex();
+}
+
+void CramFileIn::jumpTo(int rID, int beginPos)
+{
+    impl->jumpTo(rID, beginPos);
+}
+
+bool CramFileIn::readRecord(seqan::BamAlignmentRecord & record)
+{
+    return impl->readRecord(record);
+}
+
+// ---------------------------------------------------------------------------
+// Class CramFileOut
+// ---------------------------------------------------------------------------
+
+CramFileOut::CramFileOut(std::string const & path, std::string const & referencePath, int numThreads,
+                         int compressionLevel) :
+        impl(new CramFileOutImpl(path, referencePath, numThreads, compressionLevel))
+{}
+
+CramFileOut::~CramFileOut()  // for pimpl
+{}
+
+void CramFileOut::writeHeader(seqan::BamHeader const & header, seqan::BamFileOut & contextFile)
+{
+    impl->writeHeader(header, contextFile);
+}
+
+void CramFileOut::writeRecord(seqan::BamAlignmentRecord const & record)
+{
+    impl->writeRecord(record);
+}
+
+void CramFileOut::close()
+{
+    impl->close();
+}
+
+// ---------------------------------------------------------------------------
+// Function readNextRecord()
+// ---------------------------------------------------------------------------
+
+bool readNextRecord(seqan::BamAlignmentRecord & record, seqan::BamFileIn & bamFileIn, CramFileIn * cramFileIn)
+{
+    if (cramFileIn)
+        return cramFileIn->readRecord(record);
+    if (atEnd(bamFileIn))
+        return false;
+    readRecord(record, bamFileIn);
+    return true;
+}
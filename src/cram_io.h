@@ -0,0 +1,122 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef CRAM_IO_H_
+#define CRAM_IO_H_
+
+#include <memory>
+#include <string>
+
+#include <seqan/bam_io.h>
+
+class CramFileInImpl;
+class CramFileOutImpl;
+
+// CRAM files are read and written with htslib, SeqAn has no CRAM support.  htslib is only used when building with
+// -DBAM_REALIGNER_WITH_HTSLIB=ON, otherwise opening a CRAM file throws seqan::IOError.  Records are converted from and
+// to seqan::BamAlignmentRecord, so the realigner itself is not affected.  The reference names and lengths of the
+// header are stored in the context of an unopened seqan::BamFileIn, as for BAM input, so target files and rIDs are
+// resolved the same way.
+
+// ---------------------------------------------------------------------------
+// Function isCramPath()
+// ---------------------------------------------------------------------------
+
+// Returns whether path names a CRAM file (.cram).
+
+bool isCramPath(std::string const & path);
+
+// ---------------------------------------------------------------------------
+// Class CramFileIn
+// ---------------------------------------------------------------------------
+
+// Reads a CRAM file, decoding the sequences against the FASTA file at referencePath (with the .fai index also used
+// by FaiIndex).  Up to numThreads threads decode the containers.  Throws seqan::IOError on errors.
+
+class CramFileIn
+{
+public:
+    CramFileIn(std::string const & path, std::string const & referencePath, int numThreads);
+    ~CramFileIn();  // for pimpl
+
+    // Read the header and append its reference names and lengths to the context of contextFile, which is not opened.
+    void readHeader(seqan::BamHeader & header, seqan::BamFileIn & contextFile);
+    // Load the CRAI index (path + ".crai"), required for jumpTo().
+    void loadIndex();
+
+    // Continue reading from the first record on contig rID ending right of beginPos.  The following reads return the
+    // records up to the end of the contig.
+    void jumpTo(int rID, int beginPos);
+    // Read the next record, returns false at the end of the file or of the contig jumped to.
+    bool readRecord(seqan::BamAlignmentRecord & record);
+
+private:
+    std::unique_ptr<CramFileInImpl> impl;
+};
+
+// ---------------------------------------------------------------------------
+// Class CramFileOut
+// ---------------------------------------------------------------------------
+
+// Writes a CRAM file, encoding the sequences against the FASTA file at referencePath.  Up to numThreads threads
+// encode the containers with the given compression level.  Throws seqan::IOError on errors.
+
+class CramFileOut
+{
+public:
+    CramFileOut(std::string const & path, std::string const & referencePath, int numThreads, int compressionLevel);
+    ~CramFileOut();  // for pimpl
+
+    // Write header, with the references from the context of contextFile (which is not opened) if it has no @SQ
+    // records.
+    void writeHeader(seqan::BamHeader const & header, seqan::BamFileOut & contextFile);
+    void writeRecord(seqan::BamAlignmentRecord const & record);
+
+    // Write out all buffered data and close the file.
+    void close();
+
+private:
+    std::unique_ptr<CramFileOutImpl> impl;
+};
+
+// ---------------------------------------------------------------------------
+// Function readNextRecord()
+// ---------------------------------------------------------------------------
+
+// Read the next record from cramFileIn if it is not nullptr and from bamFileIn otherwise.  Returns false at the end
+// of the input.
+
+bool readNextRecord(seqan::BamAlignmentRecord & record, seqan::BamFileIn & bamFileIn, CramFileIn * cramFileIn);
+
+#endif  // #ifndef CRAM_IO_H_
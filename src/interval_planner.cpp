@@ -0,0 +1,91 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "interval_planner.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "bam_realigner_options.h"
+
+// ---------------------------------------------------------------------------
+// Function planWindows()
+// ---------------------------------------------------------------------------
+
+void planWindows(std::vector<RealignmentWindow> & windows,
+                 std::vector<seqan::GenomicRegion> const & targets,
+                 BamRealignerOptions const & options)
+{
+    windows.clear();
+
+    std::vector<seqan::GenomicRegion> sorted(targets);
+    std::sort(sorted.begin(), sorted.end(),
+              [](seqan::GenomicRegion const & lhs, seqan::GenomicRegion const & rhs) {
+                  return (std::make_tuple(lhs.rID, lhs.beginPos, lhs.endPos) <
+                          std::make_tuple(rhs.rID, rhs.beginPos, rhs.endPos));
+              });
+
+    for (auto const & target : sorted)
+    {
+        RealignmentWindow window;
+        window.region = target;
+        window.region.beginPos = (target.beginPos > (unsigned)options.windowRadius) ?
+                (target.beginPos - options.windowRadius) : 0;
+        window.region.endPos = target.endPos + options.windowRadius;
+        window.numTargets = 1;
+
+        if (!windows.empty())
+        {
+            RealignmentWindow & prev = windows.back();
+            unsigned endPos = std::max(prev.region.endPos, window.region.endPos);
+            if (prev.region.rID == window.region.rID &&
+                window.region.beginPos <= prev.region.endPos + options.mergeDistance &&
+                (options.maxClusterSpan == 0 || endPos - prev.region.beginPos <= (unsigned)options.maxClusterSpan))
+            {
+                prev.region.endPos = endPos;
+                prev.numTargets += 1;
+                continue;
+            }
+        }
+
+        windows.push_back(window);
+    }
+
+    // Link each window to the previous one on the same contig.
+    for (unsigned i = 0; i < windows.size(); ++i)
+    {
+        if (i > 0 && windows[i - 1].region.rID == windows[i].region.rID)
+            windows[i].prevEndPos = windows[i - 1].region.endPos;
+    }
+}
@@ -0,0 +1,77 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef INTERVAL_PLANNER_H_
+#define INTERVAL_PLANNER_H_
+
+#include <vector>
+
+#include <seqan/seq_io.h>
+
+class BamRealignerOptions;
+
+// ---------------------------------------------------------------------------
+// Class RealignmentWindow
+// ---------------------------------------------------------------------------
+
+// A window to realign, built from one or more padded target regions.
+
+class RealignmentWindow
+{
+public:
+    // The padded window, rID is set.  The records overlapping with it are realigned in this window.
+    seqan::GenomicRegion region;
+    // End position of the previous window on the same contig, 0 if there is none.  Records overlapping with the
+    // previous window (beginning left of this position) are realigned there, so each record is realigned once.
+    int prevEndPos;
+    // Number of target regions merged into this window.
+    unsigned numTargets;
+
+    RealignmentWindow() : prevEndPos(0), numTargets(0)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Function planWindows()
+// ---------------------------------------------------------------------------
+
+// Sort the target regions (rID must be set) and pad them by options.windowRadius.  Padded regions that overlap or
+// are at most options.mergeDistance apart are merged as long as the merged window does not span more than
+// options.maxClusterSpan bases.
+
+void planWindows(std::vector<RealignmentWindow> & windows,
+                 std::vector<seqan::GenomicRegion> const & targets,
+                 BamRealignerOptions const & options);
+
+#endif  // #ifndef INTERVAL_PLANNER_H_
@@ -0,0 +1,264 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "mate_fixer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include "bam_writer.h"
+
+namespace {  // anonymous namespace
+
+// Genomic position (rID, pos) for comparisons, unaligned records with rID -1 are sorted to the end.
+typedef std::pair<unsigned, int> TGenomicPos;
+
+inline TGenomicPos genomicPos(int rID, int pos)
+{
+    return TGenomicPos((unsigned)rID, pos);
+}
+
+inline unsigned segmentFlags(unsigned flag)
+{
+    return flag & (seqan::BAM_FLAG_FIRST | seqan::BAM_FLAG_LAST);
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Mate Functions
+// ---------------------------------------------------------------------------
+
+uint64_t hashReadName(seqan::CharString const & name)
+{
+    // FNV-1a
+    uint64_t result = 14695981039346656037ull;
+    for (unsigned i = 0; i < length(name); ++i)
+        result = (result ^ (unsigned char)name[i]) * 1099511628211ull;
+    return result;
+}
+
+bool isPrimaryWithAlignedMate(seqan::BamAlignmentRecord const & record)
+{
+    unsigned const excluded = seqan::BAM_FLAG_UNMAPPED | seqan::BAM_FLAG_NEXT_UNMAPPED | seqan::BAM_FLAG_SECONDARY |
+            seqan::BAM_FLAG_SUPPLEMENTARY;
+    return (record.flag & seqan::BAM_FLAG_MULTIPLE) && !(record.flag & excluded);
+}
+
+bool isOtherSegment(seqan::BamAlignmentRecord const & record, unsigned mateFlag)
+{
+    unsigned segment = segmentFlags(record.flag);
+    return segment != 0 && segmentFlags(mateFlag) != 0 && segment != segmentFlags(mateFlag);
+}
+
+int templateLength(int beginPos, int endPos, int mateBeginPos, int mateEndPos, bool firstSegment)
+{
+    int length = std::max(endPos, mateEndPos) - std::min(beginPos, mateBeginPos);
+    bool leftmost = beginPos < mateBeginPos || (beginPos == mateBeginPos && firstSegment);
+    return leftmost ? length : -length;
+}
+
+// ---------------------------------------------------------------------------
+// Class MateFixerImpl
+// ---------------------------------------------------------------------------
+
+class MateFixerImpl
+{
+public:
+    MateFixerImpl(BamWriter & writer, int maxDistance) :
+            writer(writer), maxDistance(maxDistance), numAdded(0), furthestPos(0, 0), flushedPos(0, 0),
+            sweptPos(0, 0), numPatched(0), numUnmatched(0), numLate(0)
+    {}
+
+    void addMoves(std::vector<MateMove> const & newMoves)
+    {
+        if (maxDistance == 0)
+            return;
+        for (auto const & move : newMoves)
+            if (genomicPos(move.mateRID, move.mateBeginPos) < flushedPos)
+                ++numLate;  // mate is written out already
+            else
+                moves.insert(std::make_pair(move.nameHash, PendingMove(move)));
+    }
+
+    void writeRecord(seqan::BamAlignmentRecord & record)
+    {
+        if (maxDistance == 0)
+        {
+            writer.writeRecord(record);
+            return;
+        }
+
+        TGenomicPos pos = genomicPos(record.rID, record.beginPos);
+        furthestPos = std::max(furthestPos, pos);
+        TKey key(pos.first, pos.second, numAdded++);
+        buffer.insert(std::make_pair(key, std::move(record)));
+        flush(TGenomicPos(furthestPos.first, furthestPos.second - maxDistance));
+    }
+
+    void close()
+    {
+        flush(genomicPos(-1, seqan::maxValue<int>()));
+        numUnmatched += std::count_if(moves.begin(), moves.end(),
+                                      [](std::pair<uint64_t const, PendingMove> const & el) {
+                                          return !el.second.matched;
+                                      });
+        moves.clear();
+    }
+
+    void printStats(std::ostream & out) const
+    {
+        out << "    updated " << numPatched << " mates of moved records, " << (numUnmatched + numLate)
+            << " mates not found within " << maxDistance << " bases\n";
+    }
+
+private:
+    // Sort key of the held back records, ties are broken by the order of insertion.
+    typedef std::tuple<unsigned, int, uint64_t> TKey;
+
+    // A move waiting for its mate, kept until the mate's position is written out, also after a match so the
+    // supplementary records of the mate are updated as well.
+    class PendingMove
+    {
+    public:
+        MateMove move;
+        bool matched;
+
+        explicit PendingMove(MateMove const & move) : move(move), matched(false)
+        {}
+    };
+
+    // Write out the held back records left of pos.
+    void flush(TGenomicPos pos)
+    {
+        auto it = buffer.begin();
+        for (; it != buffer.end() && genomicPos(std::get<0>(it->first), std::get<1>(it->first)) < pos; ++it)
+        {
+            applyMoves(it->second);
+            writer.writeRecord(it->second);
+        }
+        buffer.erase(buffer.begin(), it);
+        flushedPos = std::max(flushedPos, pos);
+
+        // Drop the moves whose mate position is written out, at most once per maxDistance.
+        if (moves.empty() || flushedPos < TGenomicPos(sweptPos.first, sweptPos.second + maxDistance))
+            return;
+        sweptPos = flushedPos;
+        for (auto it = moves.begin(); it != moves.end(); )
+            if (genomicPos(it->second.move.mateRID, it->second.move.mateBeginPos) < flushedPos)
+            {
+                numUnmatched += !it->second.matched;
+                it = moves.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+    }
+
+    // Update PNEXT and TLEN of record if it is the mate of a moved record.
+    void applyMoves(seqan::BamAlignmentRecord & record)
+    {
+        if (moves.empty() || !(record.flag & seqan::BAM_FLAG_MULTIPLE))
+            return;
+        auto range = moves.equal_range(hashReadName(record.qName));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            MateMove const & move = it->second.move;
+            if (!isOtherSegment(record, move.flag) || record.rNextId != move.rID || record.pNext != move.oldBeginPos)
+                continue;
+            record.pNext = move.beginPos;
+            if (record.rID == move.rID && !(record.flag & seqan::BAM_FLAG_UNMAPPED))
+                record.tLen = templateLength(record.beginPos, record.beginPos + getAlignmentLengthInRef(record),
+                                             move.beginPos, move.endPos, record.flag & seqan::BAM_FLAG_FIRST);
+            it->second.matched = true;
+            ++numPatched;
+            break;
+        }
+    }
+
+    BamWriter & writer;
+    int maxDistance;
+
+    // The held back records, sorted by coordinate.
+    std::map<TKey, seqan::BamAlignmentRecord> buffer;
+    uint64_t numAdded;
+    // Position of the furthest added record, everything left of flushedPos is written out, and the position of
+    // the last sweep over the moves.
+    TGenomicPos furthestPos;
+    TGenomicPos flushedPos;
+    TGenomicPos sweptPos;
+
+    // The moves waiting for their mates, by hash of the read name.
+    std::unordered_multimap<uint64_t, PendingMove> moves;
+
+    // Counters.
+    uint64_t numPatched;
+    uint64_t numUnmatched;
+    uint64_t numLate;
+};
+
+// ---------------------------------------------------------------------------
+// Class MateFixer
+// ---------------------------------------------------------------------------
+
+MateFixer::MateFixer(BamWriter & writer, int maxDistance) :
+        impl(new MateFixerImpl(writer, maxDistance))
+{}
+
+MateFixer::~MateFixer()  // for pimpl
+{}
+
+void MateFixer::addMoves(std::vector<MateMove> const & moves)
+{
+    impl->addMoves(moves);
+}
+
+void MateFixer::writeRecord(seqan::BamAlignmentRecord & record)
+{
+    impl->writeRecord(record);
+}
+
+void MateFixer::close()
+{
+    impl->close();
+}
+
+void MateFixer::printStats(std::ostream & out) const
+{
+    impl->printStats(out);
+}
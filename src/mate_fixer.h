@@ -0,0 +1,126 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef MATE_FIXER_H_
+#define MATE_FIXER_H_
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include <seqan/bam_io.h>
+
+class BamWriter;
+class MateFixerImpl;
+
+// ---------------------------------------------------------------------------
+// Class MateMove
+// ---------------------------------------------------------------------------
+
+// A paired record moved by realignment whose mate was not in the same window, so the mate's PNEXT and TLEN still
+// refer to the old position.
+
+class MateMove
+{
+public:
+    // Hash of the read name, see hashReadName().
+    uint64_t nameHash;
+    // Flag of the moved record, for telling first and last segment apart.
+    unsigned flag;
+    // Contig, old begin position and new extents of the moved record.
+    int rID;
+    int oldBeginPos;
+    int beginPos;
+    int endPos;
+    // Position of the mate, from RNEXT and PNEXT of the moved record.
+    int mateRID;
+    int mateBeginPos;
+
+    MateMove() : nameHash(0), flag(0), rID(-1), oldBeginPos(-1), beginPos(-1), endPos(-1), mateRID(-1),
+                 mateBeginPos(-1)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Mate Functions
+// ---------------------------------------------------------------------------
+
+// Returns a hash of the read name for finding mates.
+uint64_t hashReadName(seqan::CharString const & name);
+
+// Returns whether record is the primary record of a segment whose mate is aligned, i.e. whether the mate's PNEXT
+// points to record.
+bool isPrimaryWithAlignedMate(seqan::BamAlignmentRecord const & record);
+
+// Returns whether record and mate are the two segments of a pair (ignoring the read name).
+bool isOtherSegment(seqan::BamAlignmentRecord const & record, unsigned mateFlag);
+
+// Returns TLEN for a record and its mate on the same contig: the distance from the leftmost begin to the rightmost
+// end of the two, positive for the leftmost record (for the first segment if both begin at the same position).
+int templateLength(int beginPos, int endPos, int mateBeginPos, int mateEndPos, bool firstSegment);
+
+// ---------------------------------------------------------------------------
+// Class MateFixer
+// ---------------------------------------------------------------------------
+
+// Output stage updating PNEXT and TLEN of the mates of records moved in other windows, so no fixmate pass is needed
+// afterwards.  Records are held back maxDistance bases behind the furthest record added so far (and written out
+// sorted by coordinate), and the moves are applied to the mates as these are written out.  Moves whose mate does
+// not show up within maxDistance are dropped, so the memory is bounded by the records and moves within this
+// distance.  With maxDistance 0, records are written out directly and moves are ignored.
+
+class MateFixer
+{
+public:
+    MateFixer(BamWriter & writer, int maxDistance);
+    ~MateFixer();  // for pimpl
+
+    // Register the moves of a window, before adding its records.
+    void addMoves(std::vector<MateMove> const & moves);
+
+    // Add record for writing out, the record is moved from.
+    void writeRecord(seqan::BamAlignmentRecord & record);
+
+    // Write out all held back records.
+    void close();
+
+    // Print the number of updated mates and of the moves whose mate was not found.
+    void printStats(std::ostream & out) const;
+
+private:
+    std::unique_ptr<MateFixerImpl> impl;
+};
+
+#endif  // #ifndef MATE_FIXER_H_
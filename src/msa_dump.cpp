@@ -0,0 +1,256 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "msa_dump.h"
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <seqan/basic.h>
+#include <seqan/stream.h>
+
+#include "bam_realigner_options.h"
+#include "bgzf_io.h"
+
+namespace {  // anonymous namespace
+
+// Magic string at the beginning of a binary MSA dump.
+char const MSA_DUMP_MAGIC[4] = { 'M', 'S', 'A', '\1' };
+
+// Largest number of rows of a printed MSA, as for --out-msas.
+int const MAX_PRINTED_ROWS = 10000;
+
+inline void appendUInt32(std::string & out, uint32_t x)
+{
+    for (int i = 0; i < 4; ++i, x >>= 8)
+        out += (char)(x & 0xff);
+}
+
+template <typename TSeq>
+void appendSeq(std::string & out, TSeq const & seq)
+{
+    appendUInt32(out, length(seq));
+    for (unsigned i = 0; i < length(seq); ++i)
+        out += (char)ordValue(seqan::Dna5(seq[i]));
+}
+
+template <typename TGapAnchors>
+void appendGapAnchors(std::string & out, TGapAnchors const & gaps)
+{
+    appendUInt32(out, length(gaps));
+    for (unsigned i = 0; i < length(gaps); ++i)
+    {
+        appendUInt32(out, gaps[i].seqPos);
+        appendUInt32(out, gaps[i].gapPos);
+    }
+}
+
+inline uint32_t readUInt32(std::istream & in)
+{
+    unsigned char buffer[4];
+    if (!in.read((char *)buffer, 4))
+        throw seqan::IOError("Unexpected end of binary MSA dump file.");
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t)buffer[3] << 24);
+}
+
+inline void readString(std::string & str, std::istream & in)
+{
+    str.resize(readUInt32(in));
+    if (!str.empty() && !in.read(&str[0], str.size()))
+        throw seqan::IOError("Unexpected end of binary MSA dump file.");
+}
+
+void readSeq(seqan::Dna5String & seq, std::string & buffer, std::istream & in)
+{
+    readString(buffer, in);
+    resize(seq, buffer.size());
+    for (unsigned i = 0; i < buffer.size(); ++i)
+    {
+        if ((unsigned char)buffer[i] > 4)
+            throw seqan::IOError("Invalid sequence in binary MSA dump file.");
+        seq[i] = "ACGTN"[(int)buffer[i]];
+    }
+}
+
+template <typename TGapAnchors>
+void readGapAnchors(TGapAnchors & gaps, std::istream & in)
+{
+    resize(gaps, readUInt32(in));
+    for (unsigned i = 0; i < length(gaps); ++i)
+    {
+        gaps[i].seqPos = readUInt32(in);
+        gaps[i].gapPos = readUInt32(in);
+    }
+}
+
+// Read the next MSA of in into store, as written by appendMsaDump().
+void readMsaDump(seqan::FragmentStore<> & store,
+                 std::string & contigName,
+                 std::string & title,
+                 int & beginPos,
+                 int & endPos,
+                 std::istream & in)
+{
+    readString(contigName, in);
+    readString(title, in);
+    beginPos = (int)readUInt32(in);
+    endPos = (int)readUInt32(in);
+
+    clearReads(store);
+    clear(store.readNameStore);
+    clear(store.alignedReadStore);
+    resize(store.contigStore, 1);
+    resize(store.contigNameStore, 1);
+    store.contigNameStore[0] = contigName.c_str();
+
+    std::string buffer;
+    readSeq(store.contigStore[0].seq, buffer, in);
+    readGapAnchors(store.contigStore[0].gaps, in);
+    seqan::Dna5String readSeqBuffer;
+    for (uint32_t i = 0, numReads = readUInt32(in); i < numReads; ++i)
+    {
+        readSeq(readSeqBuffer, buffer, in);
+        int readBeginPos = (int)readUInt32(in);
+        int readEndPos = (int)readUInt32(in);
+        auto readID = appendRead(store, readSeqBuffer);
+        auto alignmentID = appendAlignedRead(store, readID, 0, readBeginPos, readEndPos);
+        readGapAnchors(store.alignedReadStore[alignmentID].gaps, in);
+    }
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function appendMsaDump()
+// ---------------------------------------------------------------------------
+
+void appendMsaDump(std::string & out,
+                   seqan::FragmentStore<> const & store,
+                   char const * title,
+                   int beginPos,
+                   int endPos)
+{
+    std::string contigName = toCString(store.contigNameStore[0]);
+    appendUInt32(out, contigName.size());
+    out += contigName;
+    appendUInt32(out, strlen(title));
+    out += title;
+    appendUInt32(out, beginPos);
+    appendUInt32(out, endPos);
+
+    appendSeq(out, store.contigStore[0].seq);
+    appendGapAnchors(out, store.contigStore[0].gaps);
+    appendUInt32(out, length(store.alignedReadStore));
+    for (unsigned i = 0; i < length(store.alignedReadStore); ++i)
+    {
+        auto const & el = store.alignedReadStore[i];
+        appendSeq(out, store.readSeqStore[el.readId]);
+        appendUInt32(out, el.beginPos);
+        appendUInt32(out, el.endPos);
+        appendGapAnchors(out, el.gaps);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Class MsaDumpWriter
+// ---------------------------------------------------------------------------
+
+MsaDumpWriter::MsaDumpWriter(std::string const & path, int numThreads, int compressionLevel) :
+        writer(new BgzfWriter(path, numThreads, compressionLevel))
+{
+    writer->write(MSA_DUMP_MAGIC, sizeof(MSA_DUMP_MAGIC));
+}
+
+MsaDumpWriter::~MsaDumpWriter()  // for pimpl
+{}
+
+void MsaDumpWriter::write(std::string const & dump)
+{
+    writer->write(dump.data(), dump.size());
+}
+
+void MsaDumpWriter::close()
+{
+    writer->close();
+}
+
+// ---------------------------------------------------------------------------
+// Function renderMsas()
+// ---------------------------------------------------------------------------
+
+// The MSAs are laid out and printed exactly as by the realigner, one at a time, so the memory use is bounded by the
+// largest MSA.  layoutAlignment() sorts the alignments stably, so the dumped order gives the same layout.
+
+void renderMsas(RenderMsasOptions const & options)
+{
+    if (options.verbosity >= 1)
+        std::cerr << "Rendering " << options.inMsasBinPath << " to " << options.outMsasPath << " ...";
+
+    BgzfInputBuffer inBuffer(options.inMsasBinPath, options.numIOThreads);
+    std::istream in(&inBuffer);
+    char magic[sizeof(MSA_DUMP_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, MSA_DUMP_MAGIC, sizeof(magic)) != 0)
+    {
+        std::string msg = std::string("Not a binary MSA dump file: ") + options.inMsasBinPath;
+        throw seqan::IOError(msg.c_str());
+    }
+
+    seqan::VirtualStream<char, seqan::Output> out;
+    if (!open(out, options.outMsasPath.c_str()))
+    {
+        std::string msg = std::string("Could not open MSA output file ") + options.outMsasPath;
+        throw seqan::IOError(msg.c_str());
+    }
+
+    seqan::FragmentStore<> store;
+    std::string contigName, title;
+    int beginPos = 0, endPos = 0;
+    std::ostringstream text;
+    unsigned numMsas = 0;
+    for (; in.peek() != std::istream::traits_type::eof(); ++numMsas)
+    {
+        readMsaDump(store, contigName, title, beginPos, endPos, in);
+
+        text.str("");
+        text << ">" << contigName << " " << title << "\n";
+        seqan::AlignedReadLayout layout;
+        layoutAlignment(layout, store);
+        printAlignment(text, layout, store, 0, beginPos, endPos, 0, MAX_PRINTED_ROWS);
+        out << text.str();
+    }
+
+    if (options.verbosity >= 1)
+        std::cerr << " OK (" << numMsas << " MSAs)\n";
+}
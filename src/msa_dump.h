@@ -0,0 +1,98 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef MSA_DUMP_H_
+#define MSA_DUMP_H_
+
+#include <memory>
+#include <string>
+
+#include <seqan/store.h>
+
+class BgzfWriter;
+class RenderMsasOptions;
+
+// The binary MSA dump is a compact alternative to the text MSAs of --out-msas: it holds what printAlignment() needs
+// (the contig and read sequences with their gap anchors) instead of the laid out text, so writing it costs about as
+// much as copying the store.  The file is BGZF compressed and starts with "MSA\1", followed by the MSAs.  Each MSA
+// consists of the contig name, the title, the begin and end column to print, the contig sequence and gap anchors and
+// the number of reads, followed by the sequence, begin and end position and gap anchors of each read.  Strings are
+// stored as length and characters, sequences as one code (0..4 for ACGTN) per character, gap anchors as their number
+// followed by (seqPos, gapPos) pairs.  All integers are 32 bit little-endian.
+
+// ---------------------------------------------------------------------------
+// Function appendMsaDump()
+// ---------------------------------------------------------------------------
+
+// Append the MSA of the first contig of store in columns [beginPos, endPos) with the given title (e.g. "before
+// realignment") to out.
+
+void appendMsaDump(std::string & out,
+                   seqan::FragmentStore<> const & store,
+                   char const * title,
+                   int beginPos,
+                   int endPos);
+
+// ---------------------------------------------------------------------------
+// Class MsaDumpWriter
+// ---------------------------------------------------------------------------
+
+// Writes a binary MSA dump file with BgzfWriter, so the blocks are compressed in parallel.  Throws seqan::IOError on
+// errors.
+
+class MsaDumpWriter
+{
+public:
+    MsaDumpWriter(std::string const & path, int numThreads, int compressionLevel);
+    ~MsaDumpWriter();  // for pimpl
+
+    // Write MSAs as appended by appendMsaDump().
+    void write(std::string const & dump);
+
+    // Write out all buffered data and close the file.
+    void close();
+
+private:
+    std::unique_ptr<BgzfWriter> writer;
+};
+
+// ---------------------------------------------------------------------------
+// Function renderMsas()
+// ---------------------------------------------------------------------------
+
+// Render the MSAs of a binary MSA dump file to the text format of --out-msas.  Throws seqan::IOError on errors.
+
+void renderMsas(RenderMsasOptions const & options);
+
+#endif  // #ifndef MSA_DUMP_H_
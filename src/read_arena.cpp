@@ -0,0 +1,204 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "read_arena.h"
+
+#include <algorithm>
+
+namespace {  // anonymous namespace
+
+// Returns the 2 bit code of c, or 4 if c is not one of A, C, G, T.
+inline uint8_t baseCode(char c)
+{
+    switch (c)
+    {
+        case 'A':
+            return 0;
+        case 'C':
+            return 1;
+        case 'G':
+            return 2;
+        case 'T':
+            return 3;
+        default:
+            return 4;
+    }
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class ReadArena
+// ---------------------------------------------------------------------------
+
+void ReadArena::clear()
+{
+    entries.clear();
+    packedSeq.clear();
+    numBases = 0;
+    exceptions.clear();
+    cigars.clear();
+    raw.clear();
+}
+
+template <typename TString>
+uint64_t ReadArena::appendRaw(TString const & str)
+{
+    uint64_t offset = raw.size();
+    for (unsigned i = 0; i < length(str); ++i)
+        raw.push_back(str[i]);
+    return offset;
+}
+
+void ReadArena::append(seqan::BamAlignmentRecord const & record)
+{
+    Entry entry;
+    entry.rID = record.rID;
+    entry.beginPos = record.beginPos;
+    entry.flag = record.flag;
+    entry.mapQ = record.mapQ;
+    entry.bin = record.bin;
+    entry.rNextId = record.rNextId;
+    entry.pNext = record.pNext;
+    entry.tLen = record.tLen;
+
+    // Pack the sequence.
+    entry.seqOffset = numBases;
+    entry.seqLength = length(record.seq);
+    entry.exceptionsBegin = exceptions.size();
+    packedSeq.resize((numBases + entry.seqLength + 3) / 4, 0);
+    for (unsigned pos = 0; pos < entry.seqLength; ++pos, ++numBases)
+    {
+        char c = static_cast<char>(record.seq[pos]);
+        uint8_t code = baseCode(c);
+        if (code == 4)
+        {
+            exceptions.push_back(std::make_pair(pos, c));
+            code = 0;
+        }
+        packedSeq[numBases / 4] |= code << (2 * (numBases % 4));
+    }
+    entry.exceptionsEnd = exceptions.size();
+
+    entry.cigarOffset = cigars.size();
+    entry.cigarLength = length(record.cigar);
+    cigars.insert(cigars.end(), begin(record.cigar, seqan::Standard()), end(record.cigar, seqan::Standard()));
+
+    entry.nameLength = length(record.qName);
+    entry.nameOffset = appendRaw(record.qName);
+    entry.qualLength = length(record.qual);
+    entry.qualOffset = appendRaw(record.qual);
+    entry.tagsLength = length(record.tags);
+    entry.tagsOffset = appendRaw(record.tags);
+
+    entries.push_back(entry);
+}
+
+void ReadArena::get(seqan::BamAlignmentRecord & record, unsigned idx) const
+{
+    Entry const & entry = entries[idx];
+    seqan::clear(record);
+    record.rID = entry.rID;
+    record.beginPos = entry.beginPos;
+    record.flag = entry.flag;
+    record.mapQ = entry.mapQ;
+    record.bin = entry.bin;
+    record.rNextId = entry.rNextId;
+    record.pNext = entry.pNext;
+    record.tLen = entry.tLen;
+
+    // Unpack the sequence, restoring the exceptions.
+    getSeq(record.seq, idx);
+    for (unsigned i = entry.exceptionsBegin; i < entry.exceptionsEnd; ++i)
+        record.seq[exceptions[i].first] = exceptions[i].second;
+
+    getCigar(record.cigar, idx);
+    resize(record.qName, entry.nameLength);
+    std::copy(raw.begin() + entry.nameOffset, raw.begin() + entry.nameOffset + entry.nameLength,
+              begin(record.qName, seqan::Standard()));
+    resize(record.qual, entry.qualLength);
+    std::copy(raw.begin() + entry.qualOffset, raw.begin() + entry.qualOffset + entry.qualLength,
+              begin(record.qual, seqan::Standard()));
+    resize(record.tags, entry.tagsLength);
+    std::copy(raw.begin() + entry.tagsOffset, raw.begin() + entry.tagsOffset + entry.tagsLength,
+              begin(record.tags, seqan::Standard()));
+}
+
+uint64_t ReadArena::bytes() const
+{
+    return entries.capacity() * sizeof(Entry) + packedSeq.capacity() +
+            exceptions.capacity() * sizeof(std::pair<uint32_t, char>) + cigars.capacity() * sizeof(TCigarElement) +
+            raw.capacity();
+}
+
+uint8_t ReadArena::base(unsigned idx, unsigned pos) const
+{
+    Entry const & entry = entries[idx];
+    if (entry.exceptionsBegin != entry.exceptionsEnd)
+    {
+        auto first = exceptions.begin() + entry.exceptionsBegin, last = exceptions.begin() + entry.exceptionsEnd;
+        auto it = std::lower_bound(first, last, std::make_pair((uint32_t)pos, (char)0));
+        if (it != last && it->first == pos)
+            return 4;
+    }
+    uint64_t b = entry.seqOffset + pos;
+    return (packedSeq[b / 4] >> (2 * (b % 4))) & 3;
+}
+
+int ReadArena::alignmentLengthInRef(unsigned idx) const
+{
+    int result = 0;
+    for (unsigned i = 0; i < cigarLength(idx); ++i)
+    {
+        char op = cigar(idx)[i].operation;
+        if (op == 'M' || op == 'D' || op == 'N' || op == '=' || op == 'X')
+            result += cigar(idx)[i].count;
+    }
+    return result;
+}
+
+void ReadArena::getCigar(seqan::String<TCigarElement> & cigar, unsigned idx) const
+{
+    resize(cigar, cigarLength(idx));
+    std::copy(this->cigar(idx), this->cigar(idx) + cigarLength(idx), begin(cigar, seqan::Standard()));
+}
+
+void ReadArena::setAlignment(unsigned idx, int beginPos, seqan::String<TCigarElement> const & cigar)
+{
+    Entry & entry = entries[idx];
+    entry.beginPos = beginPos;
+    entry.cigarOffset = cigars.size();
+    entry.cigarLength = length(cigar);
+    cigars.insert(cigars.end(), begin(cigar, seqan::Standard()), end(cigar, seqan::Standard()));
+}
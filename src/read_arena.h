@@ -0,0 +1,184 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef READ_ARENA_H_
+#define READ_ARENA_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <seqan/bam_io.h>
+
+// ---------------------------------------------------------------------------
+// Class ReadArena
+// ---------------------------------------------------------------------------
+
+// Compact storage of the records of one window in a few contiguous buffers instead of one BamAlignmentRecord with
+// its own heap-allocated strings per read.  Sequences are packed with 2 bits per base, bases other than A, C, G, T are
+// kept as exceptions.  CIGAR strings are stored in one flat buffer.  Read names, qualities and tags are kept as raw
+// bytes and are only needed for converting back to records for writing.  clear() keeps the capacity, so an arena can
+// be reused across windows without allocating.
+
+class ReadArena
+{
+public:
+    typedef seqan::CigarElement<> TCigarElement;
+
+    ReadArena() : numBases(0)
+    {}
+
+    // Remove all reads, keeping the buffers' capacity.
+    void clear();
+
+    // Append record, which gets the index size() - 1.
+    void append(seqan::BamAlignmentRecord const & record);
+    // Write read idx to record.
+    void get(seqan::BamAlignmentRecord & record, unsigned idx) const;
+
+    unsigned size() const
+    {
+        return entries.size();
+    }
+
+    // Returns the estimated memory use of the buffers.
+    uint64_t bytes() const;
+
+    // Fixed fields.
+    int rID(unsigned idx) const
+    {
+        return entries[idx].rID;
+    }
+    int beginPos(unsigned idx) const
+    {
+        return entries[idx].beginPos;
+    }
+    unsigned flag(unsigned idx) const
+    {
+        return entries[idx].flag;
+    }
+    bool unmapped(unsigned idx) const
+    {
+        return entries[idx].flag & seqan::BAM_FLAG_UNMAPPED;
+    }
+
+    // Read name, not 0-terminated.
+    std::pair<char const *, unsigned> qName(unsigned idx) const
+    {
+        return std::make_pair(raw.data() + entries[idx].nameOffset, entries[idx].nameLength);
+    }
+    // Base qualities (phred + 33), seqLength(idx) or 0 characters.
+    std::pair<char const *, unsigned> qual(unsigned idx) const
+    {
+        return std::make_pair(raw.data() + entries[idx].qualOffset, entries[idx].qualLength);
+    }
+
+    // Sequence.
+    unsigned seqLength(unsigned idx) const
+    {
+        return entries[idx].seqLength;
+    }
+    // Returns the code (0..3 for A, C, G, T and 4 for all other characters) of base pos of read idx.
+    uint8_t base(unsigned idx, unsigned pos) const;
+    // Write the sequence of read idx to seq.
+    template <typename TSequence>
+    void getSeq(TSequence & seq, unsigned idx) const
+    {
+        resize(seq, seqLength(idx));
+        for (unsigned pos = 0; pos < seqLength(idx); ++pos)
+            seq[pos] = "ACGTN"[base(idx, pos)];
+    }
+
+    // Alignment, cigar() points into a buffer that is invalidated by setAlignment().
+    int alignmentLengthInRef(unsigned idx) const;
+    unsigned cigarLength(unsigned idx) const
+    {
+        return entries[idx].cigarLength;
+    }
+    TCigarElement const * cigar(unsigned idx) const
+    {
+        return cigars.data() + entries[idx].cigarOffset;
+    }
+    // Write the CIGAR string of read idx to cigar.
+    void getCigar(seqan::String<TCigarElement> & cigar, unsigned idx) const;
+    // Set the alignment of read idx.
+    void setAlignment(unsigned idx, int beginPos, seqan::String<TCigarElement> const & cigar);
+
+private:
+    // The fixed fields and the location of the variable-length fields of one read.
+    class Entry
+    {
+    public:
+        int32_t rID;
+        int32_t beginPos;
+        uint16_t flag;
+        uint8_t mapQ;
+        uint16_t bin;
+        int32_t rNextId;
+        int32_t pNext;
+        int32_t tLen;
+        // Position of the first base in packedSeq, in bases, and range of exceptions.
+        uint64_t seqOffset;
+        uint32_t seqLength;
+        uint32_t exceptionsBegin;
+        uint32_t exceptionsEnd;
+        // Range in cigars.
+        uint32_t cigarOffset;
+        uint32_t cigarLength;
+        // Ranges in raw.
+        uint64_t nameOffset;
+        uint32_t nameLength;
+        uint64_t qualOffset;
+        uint32_t qualLength;
+        uint64_t tagsOffset;
+        uint32_t tagsLength;
+    };
+
+    // Append the characters of str to raw, returns the offset.
+    template <typename TString>
+    uint64_t appendRaw(TString const & str);
+
+    std::vector<Entry> entries;
+    // Sequences with 4 bases per byte, the first one in the lowest bits, numBases bases in total.
+    std::vector<uint8_t> packedSeq;
+    uint64_t numBases;
+    // Positions (relative to the read) and characters of bases other than A, C, G, T.
+    std::vector<std::pair<uint32_t, char>> exceptions;
+    // CIGAR strings.
+    std::vector<TCigarElement> cigars;
+    // Read names, qualities and tags.
+    std::vector<char> raw;
+};
+
+#endif  // #ifndef READ_ARENA_H_
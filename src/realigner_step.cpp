@@ -34,7 +34,13 @@
 
 #include "realigner_step.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <map>
+#include <sstream>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
@@ -43,12 +49,331 @@
 #include <seqan/simple_intervals_io.h>
 #include <seqan/realign.h>
 #include <seqan/store.h>
-#include <seqan/misc/misc_interval_tree.h>
 
 #include "bam_realigner_options.h"
+#include "banded_realigner.h"
+#include "bump_arena.h"
+#include "consensus_realigner.h"
+#include "interval_planner.h"
+#include "mate_fixer.h"
+#include "msa_dump.h"
+#include "read_arena.h"
+#include "reference_provider.h"
 
 namespace {  // anonymous namespace
 
+// Smallest number of aligned bases for a column to be considered in the pre-screen's entropy computation.
+unsigned const MIN_ENTROPY_COVERAGE = 4;
+
+// Added to the largest indel of a window for the initial band.
+int const BAND_MARGIN = 4;
+// Largest number of consensus rounds of the banded engine.
+unsigned const BANDED_MAX_ROUNDS = 4;
+// Smallest improvement (in units of 10 phred) of a haplotype for the consensus engine to realign, as in GATK.
+double const CONSENSUS_MIN_LOD = 5.0;
+// Base quality assumed by the consensus engine for records without qualities, and the largest quality used.
+uint8_t const DEFAULT_QUALITY = 20;
+uint8_t const MAX_QUALITY = 60;
+
+// Clipped tails are only rescued with at least this many bases aligned to the consensus, at most this fraction of
+// mismatches among them and at most this many gaps (the indel that made the aligner clip the tail).
+unsigned const MIN_RESCUE_BASES = 4;
+double const MAX_RESCUE_MISMATCH_RATE = 0.1;
+unsigned const MAX_RESCUE_GAPS = 1;
+
+// Deletions of at least this length are written as 'N', as by SeqAn's getCigarString().
+unsigned const SPLICED_GAP_THRESHOLD = 20;
+
+// Alignment of a read against the contig, as input for filling the FragmentStore.
+class ContigAlignment
+{
+public:
+    // Begin position in the contig and CIGAR string, nullptr for unaligned reads.
+    int beginPos;
+    ReadArena::TCigarElement const * cigar;
+    unsigned cigarLength;
+
+    ContigAlignment(int beginPos = 0, ReadArena::TCigarElement const * cigar = nullptr, unsigned cigarLength = 0) :
+            beginPos(beginPos), cigar(cigar), cigarLength(cigarLength)
+    {}
+
+    ContigAlignment(int beginPos, seqan::String<ReadArena::TCigarElement> const & cigar) :
+            beginPos(beginPos), cigar(empty(cigar) ? nullptr : &cigar[0]), cigarLength(length(cigar))
+    {}
+};
+
+inline bool isClipping(char operation)
+{
+    return operation == 'S' || operation == 'H';
+}
+
+// Returns the length of the longest gap run in gaps, ignoring runs with a length in the sorted ignoredLengths.
+template <typename TGaps>
+unsigned maxGapRun(TGaps & gaps, std::vector<unsigned> const & ignoredLengths)
+{
+    unsigned result = 0;
+    for (auto it = begin(gaps, seqan::Standard()), itEnd = end(gaps, seqan::Standard()); it != itEnd; )
+    {
+        unsigned n = seqan::countGaps(it);
+        if (!std::binary_search(ignoredLengths.begin(), ignoredLengths.end(), n))
+            result = std::max(result, n);
+        it += n ? n : 1;
+    }
+    return result;
+}
+
+// Fill sourcePos with the number of characters of gaps before each view position and the total number as last entry.
+// The source position of view position v is sourcePos[v] (of the next character for gaps) and v is a gap iff
+// sourcePos[v + 1] == sourcePos[v].
+template <typename TGaps>
+void buildViewToSource(std::vector<unsigned> & sourcePos, TGaps & gaps)
+{
+    sourcePos.clear();
+    unsigned numChars = 0;
+    for (auto it = begin(gaps, seqan::Standard()), itEnd = end(gaps, seqan::Standard()); it != itEnd; )
+    {
+        unsigned n = seqan::countGaps(it);
+        bool isGapRun = (n != 0);
+        if (!isGapRun)
+            n = std::max(1u, (unsigned)seqan::countCharacters(it));
+        for (unsigned i = 0; i < n; ++i)
+            sourcePos.push_back(isGapRun ? numChars : numChars++);
+        it += n;
+    }
+    sourcePos.push_back(numChars);
+}
+
+// Write the CIGAR of readGaps against the contig to cigar, with the read starting at contig view position viewBegin
+// and cut at viewEnd.  contigSourcePos is the view to source table of the contig gaps by buildViewToSource(), view
+// positions outside of it count as contig gaps.  The result is that of getCigarString() on the contig gaps clipped
+// to the read, including its conversion of long deletions to 'N'.
+template <typename TReadGaps>
+void getAlignedCigar(seqan::String<ReadArena::TCigarElement> & cigar,
+                     TReadGaps & readGaps,
+                     std::vector<unsigned> const & contigSourcePos,
+                     int viewBegin,
+                     int viewEnd)
+{
+    clear(cigar);
+    char lastOp = 0;
+    unsigned numOps = 0;
+    int view = viewBegin, numViews = (int)contigSourcePos.size() - 1;
+    for (auto it = begin(readGaps, seqan::Standard()), itEnd = end(readGaps, seqan::Standard());
+         it != itEnd && view < viewEnd; )
+    {
+        unsigned n = seqan::countGaps(it);
+        bool isReadGap = (n != 0);
+        if (!isReadGap)
+            n = std::max(1u, (unsigned)seqan::countCharacters(it));
+        for (unsigned i = 0; i < n && view < viewEnd; ++i, ++view)
+        {
+            bool isContigGap = (view < 0 || view >= numViews || contigSourcePos[view + 1] == contigSourcePos[view]);
+            char op = isContigGap ? (isReadGap ? 'P' : 'I') : (isReadGap ? 'D' : 'M');
+            if (op != lastOp && numOps != 0)
+            {
+                appendValue(cigar, ReadArena::TCigarElement(lastOp, numOps));
+                numOps = 0;
+            }
+            lastOp = op;
+            ++numOps;
+        }
+        it += n;
+    }
+    if (numOps != 0)
+        appendValue(cigar, ReadArena::TCigarElement(lastOp, numOps));
+    for (auto & el : cigar)
+        if (el.operation == 'D' && el.count >= SPLICED_GAP_THRESHOLD)
+            el.operation = 'N';
+}
+
+// Returns the number of leading and trailing soft-clipped bases of cigar.  The clipping operations are
+// cigar[0..clipOps.first) and cigar[clipOps.second..cigarLength).
+std::pair<unsigned, unsigned> clippedBases(std::pair<unsigned, unsigned> & clipOps,
+                                           ReadArena::TCigarElement const * cigar,
+                                           unsigned cigarLength)
+{
+    unsigned b = 0, e = cigarLength, clipBegin = 0, clipEnd = 0;
+    for (; b < e && isClipping(cigar[b].operation); ++b)
+        clipBegin += (cigar[b].operation == 'S') ? cigar[b].count : 0;
+    for (; e > b && isClipping(cigar[e - 1].operation); --e)
+        clipEnd += (cigar[e - 1].operation == 'S') ? cigar[e - 1].count : 0;
+    clipOps = std::make_pair(b, e);
+    return std::make_pair(clipBegin, clipEnd);
+}
+
+// Convert the aligned part of read idx, without the clipping, to codes and alignment operations.  The clipping
+// operations are cigar[0..clipOps.first) and cigar[clipOps.second..).
+void toAlignedPart(std::vector<uint8_t> & seq,
+                   std::vector<AlignmentOp> & ops,
+                   std::pair<unsigned, unsigned> & clipOps,
+                   ReadArena const & arena,
+                   unsigned idx)
+{
+    ReadArena::TCigarElement const * cigar = arena.cigar(idx);
+    auto clipped = clippedBases(clipOps, cigar, arena.cigarLength(idx));
+    for (unsigned pos = clipped.first; pos + clipped.second < arena.seqLength(idx); ++pos)
+        seq.push_back(arena.base(idx, pos));
+    for (unsigned c = clipOps.first; c < clipOps.second; ++c)
+    {
+        char op = cigar[c].operation;
+        if (op == 'M' || op == '=' || op == 'X' || op == 'I' || op == 'D' || op == 'N')
+            appendAlignmentOp(ops, (op == 'I') ? 'I' : (op == 'D' || op == 'N') ? 'D' : 'M', cigar[c].count);
+    }
+}
+
+// Build the CIGAR string of ops with the clipping operations cigar[0..clipOps.first) and
+// cigar[clipOps.second..cigarLength).
+void withClipping(seqan::String<ReadArena::TCigarElement> & result,
+                  ReadArena::TCigarElement const * cigar,
+                  unsigned cigarLength,
+                  std::pair<unsigned, unsigned> const & clipOps,
+                  std::vector<AlignmentOp> const & ops)
+{
+    clear(result);
+    for (unsigned c = 0; c < clipOps.first; ++c)
+        appendValue(result, cigar[c]);
+    for (auto const & op : ops)
+        appendValue(result, ReadArena::TCigarElement(op.operation, op.count));
+    for (unsigned c = clipOps.second; c < cigarLength; ++c)
+        appendValue(result, cigar[c]);
+}
+
+// Build the CIGAR string of the aligned part's CIGAR string with the clipping operations of cigar as above.
+void withClipping(seqan::String<ReadArena::TCigarElement> & result,
+                  ReadArena::TCigarElement const * cigar,
+                  unsigned cigarLength,
+                  std::pair<unsigned, unsigned> const & clipOps,
+                  seqan::String<ReadArena::TCigarElement> const & aligned)
+{
+    clear(result);
+    for (unsigned c = 0; c < clipOps.first; ++c)
+        appendValue(result, cigar[c]);
+    append(result, aligned);
+    for (unsigned c = clipOps.second; c < cigarLength; ++c)
+        appendValue(result, cigar[c]);
+}
+
+// Append the operation to cigar, merging it into the last one if they are the same.
+void appendCigarOp(seqan::String<ReadArena::TCigarElement> & cigar, char operation, unsigned count)
+{
+    if (count == 0)
+        return;
+    if (!empty(cigar) && back(cigar).operation == operation)
+        back(cigar).count += count;
+    else
+        appendValue(cigar, ReadArena::TCigarElement(operation, count));
+}
+
+// Write the CIGAR against the reference of a read aligned with ops against the consensus, beginning at consensus
+// position consBegin, to cigar.  consView holds the contig view position of each consensus character and
+// contigSourcePos is the view to source table of the reference's gaps as for getAlignedCigar().  Contig columns
+// skipped between two consensus characters (gaps in the consensus) are deletions where the reference has a base.
+void projectToReference(seqan::String<ReadArena::TCigarElement> & cigar,
+                        std::vector<AlignmentOp> const & ops,
+                        unsigned consBegin,
+                        std::vector<int> const & consView,
+                        std::vector<unsigned> const & contigSourcePos)
+{
+    int numViews = (int)contigSourcePos.size() - 1;
+    auto isContigGap = [&](int view) {
+        return view < 0 || view >= numViews || contigSourcePos[view + 1] == contigSourcePos[view];
+    };
+
+    clear(cigar);
+    unsigned cons = consBegin;
+    int lastView = consView[consBegin] - 1;
+    for (auto const & op : ops)
+    {
+        for (unsigned i = 0; i < op.count; ++i)
+        {
+            if (op.operation == 'I')
+            {
+                appendCigarOp(cigar, 'I', 1);
+                continue;
+            }
+            int view = consView[cons++];
+            for (int v = lastView + 1; v < view; ++v)
+                if (!isContigGap(v))
+                    appendCigarOp(cigar, 'D', 1);
+            lastView = view;
+            if (op.operation == 'M')
+                appendCigarOp(cigar, isContigGap(view) ? 'I' : 'M', 1);
+            else if (!isContigGap(view))
+                appendCigarOp(cigar, 'D', 1);
+        }
+    }
+    for (auto & el : cigar)
+        if (el.operation == 'D' && el.count >= SPLICED_GAP_THRESHOLD)
+            el.operation = 'N';
+}
+
+// A column of the alignment of a read against the consensus: the operation and the read and consensus positions (-1
+// for gaps).
+class AlignmentColumn
+{
+public:
+    char operation;
+    int readPos;
+    int consPos;
+
+    AlignmentColumn(char operation, int readPos, int consPos) :
+            operation(operation), readPos(readPos), consPos(consPos)
+    {}
+};
+
+// Returns whether the columns [begin, end) of a clipped tail's alignment qualify for un-clipping.  The read is given as
+// codes like the consensus.
+bool isRescuable(std::vector<AlignmentColumn> const & columns,
+                 unsigned begin,
+                 unsigned end,
+                 std::vector<uint8_t> const & read,
+                 std::vector<uint8_t> const & consensus)
+{
+    unsigned numAligned = 0, numMismatches = 0, numGaps = 0;
+    for (unsigned i = begin; i < end; ++i)
+    {
+        AlignmentColumn const & col = columns[i];
+        if (col.operation == 'M')
+        {
+            ++numAligned;
+            numMismatches += (read[col.readPos] == 4 || read[col.readPos] != consensus[col.consPos]);
+        }
+        else if (i == begin || columns[i - 1].operation != col.operation)
+        {
+            ++numGaps;
+        }
+    }
+    return numAligned >= MIN_RESCUE_BASES && numMismatches <= MAX_RESCUE_MISMATCH_RATE * numAligned &&
+            numGaps <= MAX_RESCUE_GAPS;
+}
+
+// Deterministic hash of the read name and first/last flags of read idx, mixed with seed, used for downsampling.
+inline uint64_t readHash(ReadArena const & arena, unsigned idx, uint64_t seed)
+{
+    uint64_t hash = 14695981039346656037ULL ^ seed;  // FNV-1a
+    auto qName = arena.qName(idx);
+    for (unsigned i = 0; i < qName.second; ++i)
+        hash = (hash ^ (unsigned char)qName.first[i]) * 1099511628211ULL;
+    hash = (hash ^ (arena.flag(idx) & 0xC0)) * 1099511628211ULL;
+    hash ^= hash >> 33;  // finalizer, spreads the bits
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Key for grouping reads with the same original alignment for downsampling.
+inline std::string alignmentKey(ReadArena const & arena, unsigned idx)
+{
+    std::string result = std::to_string(arena.beginPos(idx));
+    for (unsigned i = 0; i < arena.cigarLength(idx); ++i)
+    {
+        result += ' ';
+        result += std::to_string(arena.cigar(idx)[i].count);
+        result += arena.cigar(idx)[i].operation;
+    }
+    return result;
+}
+
 }  // anonymous namespace
 
 
@@ -59,20 +384,14 @@ namespace {  // anonymous namespace
 class RealignerStepImpl
 {
 public:
-    RealignerStepImpl(seqan::BamFileOut & bamFileOut,
-                      seqan::VirtualStream<char, seqan::Output> & msasTxtOut,
-                      seqan::BamFileIn & bamFileIn,
-                      seqan::BamIndex<seqan::Bai> & baiIndex,
-                      seqan::FaiIndex & faiIndex,
-                      seqan::GenomicRegion const & region,
-                      BamRealignerOptions const & options) :
-            bamFileOut(bamFileOut), msasTxtOut(msasTxtOut), bamFileIn(bamFileIn), baiIndex(baiIndex),
-            faiIndex(faiIndex), region(region), options(options)
-    {
-        extendRegion();
-    }
+    RealignerStepImpl(ReferenceProvider & referenceProvider, BamRealignerOptions const & options) :
+            result(nullptr), referenceProvider(referenceProvider), options(options), maxIndelLength(0),
+            deadline(0)
+    {}
 
-    void run();
+    void run(RealignerStepResult & result,
+             std::vector<seqan::BamAlignmentRecord> & records,
+             RealignmentWindow const & window);
 
 private:
 
@@ -89,164 +408,798 @@ private:
     typedef TFragmentStore::TContigSeq TContigSeq;
     typedef seqan::Gaps<TContigSeq, seqan::AnchorGaps<TContig::TGapAnchors> > TContigGaps;
 
-    // Extend region by options.windowRadius.
-    void extendRegion()
-    {
-        region.beginPos -= options.windowRadius;
-        region.beginPos = std::max(0u, region.beginPos);
-        region.endPos += options.windowRadius;
-    }
-    // Extend region by extents of alignment.
-    void extendRegion(seqan::BamAlignmentRecord const & record)
+    // Extend region by extents of alignment of read idx.
+    void extendRegion(unsigned idx)
     {
-        if (record.rID != (int)region.rID)
+        if (arena.rID(idx) != (int)region.rID)
             return;  // do not update if on difference contig
-        region.beginPos = std::min((int)region.beginPos, record.beginPos);
-        region.endPos = std::max((int)region.endPos, (int)(record.beginPos + getAlignmentLengthInRef(record)));
+        int beginPos = arena.beginPos(idx), endPos = beginPos + arena.alignmentLengthInRef(idx);
+        if (options.rescueClips)
+        {
+            // Cover the clipped tails for rescueClippedTails().
+            std::pair<unsigned, unsigned> clipOps;
+            auto clipped = clippedBases(clipOps, arena.cigar(idx), arena.cigarLength(idx));
+            beginPos = std::max(0, beginPos - (int)clipped.first);
+            endPos += clipped.second;
+        }
+        region.beginPos = std::min((int)region.beginPos, beginPos);
+        region.endPos = std::max((int)region.endPos, endPos);
     }
 
+    // Realign the loaded window.
+    void realignWindow();
+    // Pass the window through unchanged because it exceeds a budget, detail is logged as the cause.
+    void abortWindow(char const * reason, std::string const & detail);
     // Load reference sequence.
     void loadReference();
-    // Load alignments;
-    void loadAlignments();
+    // Pre-screen the records for indel evidence, returns false if the window can be passed through unchanged.
+    bool needsRealignment();
+    // Downsample realignIdx to options.maxDepth.
+    void downsample();
+    // Get the codes of the sequence that the reads are aligned against after realignment and the contig view position
+    // of each character, relative to the reference pseudo-read as contigSourcePos.  This is the consensus in store for
+    // the SeqAn and banded engines after updateBamRecords().  The consensus engine leaves no consensus, the reference
+    // is used and contigSourcePos set to the identity then.
+    void getConsensus(std::vector<uint8_t> & consensus, std::vector<int> & consView);
+    // Returns the position in the consensus from getConsensus() of the reference position pos (or of the next one).
+    int consensusPos(std::vector<int> const & consView, int pos) const;
+    // Align the reads held back by downsample() against the consensus in store and update their alignments, for the
+    // SeqAn and banded engines after updateBamRecords().
+    void projectDownsampled();
+    // Align the soft-clipped reads with their clipped tails against the consensus and un-clip the tails that align
+    // well.
+    void rescueClippedTails();
     // Build FragmentStore from aligned records.
     void buildFragmentStore();
-    // Perform realignment on store.
-    void performRealignment();
-    // Update the BAM records from MSA stored in store.
+    // Fill store with the reference and the records' alignments.
+    void fillStoreFromRecords();
+    // Fill store with contig and the reads of realignIdx aligned against it as given by alignments.  If there is one
+    // more alignment than reads, the last one is for ref as the contig pseudo-read.
+    void fillStore(TContigSeq const & contig, BumpVector<ContigAlignment> const & alignments);
+    // Perform realignment on store, returns false if the deadline passed and the records are unchanged.
+    bool performRealignment();
+    // Realign the records with the banded engine starting with band and fill store with the result, returns false
+    // if the deadline passed.
+    bool performBandedRealignment(int band);
+    // Realign the records with the consensus engine, updating the records directly unless the deadline passed (then
+    // returns false).
+    bool performConsensusRealignment();
+    // Update the reads' alignments from MSA stored in store.
     void updateBamRecords();
-    // Write out BAM records.
+    // Write the BAM records and MSA text into the result.
     void writeBamRecords();
+    // Update PNEXT and TLEN of the moved records and their mates in the window, collect the moves of the records
+    // whose mates are outside.
+    void fixMates();
+
+    // Returns the estimated memory use of store.
+    uint64_t storeBytes() const;
+    // Returns the length of the longest gap run in the MSA of store that is not as long as one of indelLengths.
+    unsigned longestGapRun();
+
+    // Returns true if the window has a deadline and it has passed.
+    bool pastDeadline() const
+    {
+        return deadline != 0 && seqan::sysTime() > deadline;
+    }
+
+    // Returns an allocator for temporaries.
+    BumpAllocator<char> tempAlloc()
+    {
+        return BumpAllocator<char>(tempArena);
+    }
+
+    // Whether or not to print the MSAs to msasTxtOut.
+    bool printMsas() const
+    {
+        return !options.outMsasPath.empty();
+    }
+
+    // Whether or not to dump the MSAs to msasBin.
+    bool dumpMsas() const
+    {
+        return !options.outMsasBinPath.empty();
+    }
+
+    // Whether or not the MSAs are output in any form.
+    bool needMsas() const
+    {
+        return options.verbosity >= 2 || printMsas() || dumpMsas();
+    }
+
+    // Print the MSA of store in the columns [beginPos, endPos) with the given title to msasTxtOut and stderr and dump
+    // it to msasBin, as requested.
+    void outputMsa(char const * title, int beginPos, int endPos);
 
     // The reference sequence window.
     seqan::Dna5String ref;
-    // The alignment records overlapping with the window.
-    std::vector<seqan::BamAlignmentRecord> records;
-
-    // Output files.
-    seqan::BamFileOut & bamFileOut;
-    seqan::VirtualStream<char, seqan::Output> & msasTxtOut;
-    // Input BAM and FAI index.
-    seqan::BamFileIn & bamFileIn;
-    seqan::BamIndex<seqan::Bai> & baiIndex;
-    seqan::FaiIndex & faiIndex;
-    // The region to realign.
+    // The reads overlapping with the window.
+    ReadArena arena;
+    // Indices of the reads to realign, all reads or those sampled by downsample().
+    std::vector<unsigned> realignIdx;
+    // When downsampling, for each read the index of the sampled read with the same original alignment.
+    std::vector<unsigned> representativeIdx;
+    // Indices of the aligned reads held back by downsample().
+    std::vector<unsigned> heldBackIdx;
+    // View to source table of the contig gaps, built by updateBamRecords().
+    std::vector<unsigned> contigSourcePos;
+    // Begin and end position of each read before realignment.
+    std::vector<std::pair<int, int>> originalSpans;
+    // The primary paired records of the window by hash of the read name, used by fixMates().
+    std::unordered_multimap<uint64_t, unsigned> pairedIdx;
+
+    // Output of the current window, records are written here after realignment.
+    RealignerStepResult * result;
+    // Buffer for the MSA text output, moved into result at the end.
+    std::ostringstream msasTxtOut;
+    // Buffer for the binary MSA dump, moved into result at the end.
+    std::string msasBin;
+    // Provides the reference sequence.
+    ReferenceProvider & referenceProvider;
+    // The window to realign and the region, extended by the extents of the loaded alignments.
+    RealignmentWindow window;
     seqan::GenomicRegion region;
     // The used FragmentStore.
     seqan::FragmentStore<> store;
+    // Memory for the temporaries of one window.
+    BumpArena tempArena;
 
     // Options.
     BamRealignerOptions const & options;
+
+    // Length of the longest insertion or deletion of the records and the distinct lengths (sorted), set by fillStore().
+    unsigned maxIndelLength;
+    std::vector<unsigned> indelLengths;
+    // The time (as by seqan::sysTime()) after which the realignment of the window is given up, 0 for no limit.
+    double deadline;
 };
 
 void RealignerStepImpl::loadReference()
 {
     if (options.verbosity >= 2)
         std::cerr << "Loading reference...\n";
-    readRegion(ref, faiIndex, region);
+    referenceProvider.getRegion(ref, region);
     if (options.verbosity >= 2)
         std::cerr << "  => DONE\n";
 }
 
-void RealignerStepImpl::loadAlignments()
-{
-    if (options.verbosity >= 2)
-        std::cerr << "Loading alignments...\n";
+// The containers of the step are cleared at the start of each window, keeping their capacity, so a step reused for
+// many windows only allocates for windows that are larger than all previous ones.
 
-    // Translate region reference name to reference ID in BAM file.
-    if (!getIdByName(region.rID, nameStoreCache(context(bamFileIn)), region.seqName))
+void RealignerStepImpl::run(RealignerStepResult & result,
+                            std::vector<seqan::BamAlignmentRecord> & records,
+                            RealignmentWindow const & window)
+{
+    this->result = &result;
+    this->window = window;
+    region = window.region;
+    arena.clear();
+    realignIdx.clear();
+    representativeIdx.clear();
+    heldBackIdx.clear();
+    originalSpans.clear();
+    msasTxtOut.str("");
+    msasTxtOut.clear();
+    msasBin.clear();
+    maxIndelLength = 0;
+    tempArena.reset();
+
+    // Move the records into the arena.
+    for (auto const & record : records)
     {
-        std::string msg = std::string("Unknown reference ")  + toCString(region.seqName);
-        throw seqan::IOError(msg.c_str());
+        result.stats.alignmentBytes += bamRecordBytes(record);
+        arena.append(record);
+        originalSpans.push_back(std::make_pair(record.beginPos, record.beginPos + getAlignmentLengthInRef(record)));
+        extendRegion(arena.size() - 1);
     }
+    records.clear();
+    result.stats.numRecords = arena.size();
+    for (unsigned i = 0; i < arena.size(); ++i)
+        realignIdx.push_back(i);
+
+    realignWindow();
+}
 
-    // Jump to region using BAI file.
-    bool hasAlignments = false;
-    if (!jumpToRegion(bamFileIn, hasAlignments, region.rID, region.beginPos, region.endPos, baiIndex))
-        throw seqan::IOError("Problem jumping in file.\n");
-    if (!hasAlignments)
+void RealignerStepImpl::realignWindow()
+{
+    if (arena.size() == 0)
     {
         // Handle the case of no alignments in region.
         seqan::CharString buffer;
         region.toString(buffer);
         if (options.verbosity >= 1)
             std::cerr << "\nWARNING: No alignments in region " << buffer << "\n";
+    }
+    else if (options.verbosity >= 1)
+    {
+        std::cerr << "    loaded " << arena.size() << " records\n";
+    }
+
+    StepStats & stats = result->stats;
+    seqan::CharString buffer;
+    window.region.toString(buffer);
+    stats.region = toCString(buffer);
+    deadline = (options.maxWindowSeconds > 0) ? seqan::sysTime() + options.maxWindowSeconds : 0;
+
+    // Pass through windows that are too long before loading their reference.
+    unsigned span = region.endPos - region.beginPos;
+    if (options.maxWindowBp != 0 && span > (unsigned)options.maxWindowBp)
+    {
+        stats.span = span;
+        abortWindow("max-window-bp", "span of " + std::to_string(span) + " bp exceeds --max-window-bp");
         return;
     }
 
-    // Load alignments.
-    seqan::BamAlignmentRecord record;
-    seqan::GenomicRegion targetRegion = region;
-    while (true)
+    // Load reference sequence in regions.
     {
-        readRecord(record, bamFileIn);
-        if (record.rID == seqan::BamAlignmentRecord::INVALID_REFID)
-            break;  // done, no more aligned records
-        if (std::make_pair(record.rID, (int)(record.beginPos + getAlignmentLengthInRef(record))) <= std::make_pair((int)targetRegion.rID, (int)targetRegion.beginPos))
-            continue;  // skip record too far to the left
-        if (std::make_pair(record.rID, record.beginPos) >= std::make_pair((int)targetRegion.rID, (int)targetRegion.endPos))
-            break;  // done, no more records
-        extendRegion(record);
-        records.push_back(record);
+        StageTimer timer(stats, STAGE_LOAD_REFERENCE);
+        loadReference();
     }
+    stats.referenceBytes = length(ref);
+    stats.span = region.endPos - region.beginPos;
+
+    {
+        StageTimer timer(stats, STAGE_BUILD_STORE);
+        // Pass through windows without indel evidence.
+        if (!needsRealignment())
+        {
+            writeBamRecords();
+            return;
+        }
+        // Downsample deep windows.
+        downsample();
+        stats.numRealigned = realignIdx.size();
+        if (options.maxWindowReads != 0 && realignIdx.size() > (unsigned)options.maxWindowReads)
+        {
+            abortWindow("max-window-reads", std::to_string(realignIdx.size()) + " records to realign exceed "
+                        "--max-window-reads");
+            return;
+        }
+        // Build FragmentStore from the aligned alignment records.  The consensus engine works on the records and
+        // needs the store only for printing.
+        if (options.engine != BamRealignerOptions::ENGINE_CONSENSUS || needMsas())
+            buildFragmentStore();
+    }
+    stats.peakStoreBytes = storeBytes();
+    // Perform realignment.
+    bool realigned;
+    {
+        StageTimer timer(stats, STAGE_REALIGN);
+        realigned = !pastDeadline() && performRealignment();
+    }
+    stats.peakStoreBytes = std::max(stats.peakStoreBytes, storeBytes());
+    if (!realigned)
+    {
+        abortWindow("max-window-seconds", "realignment exceeds --max-window-seconds");
+        return;
+    }
+    {
+        StageTimer timer(stats, STAGE_UPDATE_RECORDS);
+        // Update the BAM records before writing out, including those held back when downsampling.  The consensus
+        // engine places the held back records itself.
+        if (options.engine != BamRealignerOptions::ENGINE_CONSENSUS)
+        {
+            updateBamRecords();
+            projectDownsampled();
+        }
+        if (options.rescueClips)
+            rescueClippedTails();
+    }
+    // Write out BAM records.
+    writeBamRecords();
+}
+
+// The records are still as loaded when a window is aborted: the engines only change them after a successful
+// realignment.  The MSA text of the window is dropped so the MSA output has no "before" without an "after".
+
+void RealignerStepImpl::abortWindow(char const * reason, std::string const & detail)
+{
     if (options.verbosity >= 1)
-        std::cerr << "    loaded " << length(records) << " records\n";
+    {
+        seqan::CharString buffer;
+        region.toString(buffer);
+        std::cerr << "\nWARNING: Skipping region " << buffer << ", " << detail << "\n";
+    }
+    result->skipReason = reason;
+    msasTxtOut.str("");
+    msasBin.clear();
+    writeBamRecords();
+}
+
+// The pre-screen counts the reads with indels and with soft-clipping and computes the Shannon entropy of the base
+// distribution of each reference column.  Columns with high entropy point to mismatch clusters as caused by
+// misaligned indels (or SNPs).
+
+bool RealignerStepImpl::needsRealignment()
+{
+    if (!options.prescreen)
+        return true;
+
+    unsigned numIndelReads = 0, numClippedReads = 0;
+    BumpVector<unsigned> counts(4 * length(ref), 0, tempAlloc());  // base counts (A, C, G, T) per column
+    for (unsigned idx = 0; idx < arena.size(); ++idx)
+    {
+        if (arena.unmapped(idx))
+            continue;
+
+        bool hasIndel = false, isClipped = false;
+        int refPos = arena.beginPos(idx) - (int)region.beginPos;
+        unsigned readPos = 0;
+        for (unsigned c = 0; c < arena.cigarLength(idx); ++c)
+        {
+            auto const & el = arena.cigar(idx)[c];
+            switch (el.operation)
+            {
+                case 'I':
+                    hasIndel = true;
+                    readPos += el.count;
+                    break;
+                case 'D':
+                    hasIndel = true;
+                    refPos += el.count;
+                    break;
+                case 'N':
+                    refPos += el.count;
+                    break;
+                case 'S':
+                    isClipped = true;
+                    readPos += el.count;
+                    break;
+                case 'M':
+                case '=':
+                case 'X':
+                    for (unsigned i = 0; i < el.count; ++i, ++refPos, ++readPos)
+                        if (refPos >= 0 && refPos < (int)length(ref) && readPos < arena.seqLength(idx) &&
+                            arena.base(idx, readPos) < 4)
+                            counts[4 * refPos + arena.base(idx, readPos)] += 1;
+                    break;
+                default:  // 'H', 'P'
+                    break;
+            }
+        }
+        numIndelReads += hasIndel;
+        numClippedReads += isClipped;
+    }
+
+    double maxEntropy = 0;
+    for (unsigned col = 0; col < length(ref); ++col)
+    {
+        unsigned total = counts[4 * col] + counts[4 * col + 1] + counts[4 * col + 2] + counts[4 * col + 3];
+        if (total < MIN_ENTROPY_COVERAGE)
+            continue;
+        double entropy = 0;
+        for (unsigned i = 0; i < 4; ++i)
+            if (counts[4 * col + i])
+            {
+                double p = (double)counts[4 * col + i] / total;
+                entropy -= p * std::log2(p);
+            }
+        maxEntropy = std::max(maxEntropy, entropy);
+    }
 
+    bool realign = (numIndelReads >= (unsigned)options.prescreenMinIndelReads ||
+                   numClippedReads >= (unsigned)options.prescreenMinClippedReads ||
+                   maxEntropy >= options.prescreenMinEntropy);
     if (options.verbosity >= 2)
-        std::cerr << "  => DONE\n";
+        std::cerr << "Pre-screen: " << numIndelReads << " reads with indels, " << numClippedReads
+                  << " clipped reads, max column entropy " << maxEntropy << " => "
+                  << (realign ? "realigning" : "passing through") << "\n";
+    if (!realign)
+        result->skipReason = "prescreen";
+    return realign;
 }
 
-void RealignerStepImpl::run()
+// Downsampling groups the records by their original alignment (begin position and CIGAR string).  Each group keeps
+// the same number of records, those with the smallest read name hashes, so the sample is reproducible for a given
+// seed and independent of the record order.  With more groups than options.maxDepth, which is common in deep windows
+// as sequencing errors are part of the CIGAR strings, only the options.maxDepth groups whose first records have the
+// smallest hashes keep one record each.  The held back records do not shape the consensus but are aligned against it
+// after realignment, each on its own sequence with the realigned first record of its group (or its own original
+// position if its group has none) as the guide for the band, see projectDownsampled().
+
+void RealignerStepImpl::downsample()
 {
-    // Load alignments, updates positions in region.
-    loadAlignments();
-    // Load reference sequence in regions.
-    loadReference();
-    // Build FragmentStore from the aligned alignment records.
-    buildFragmentStore();
-    // Perform realignment.
-    performRealignment();
-    // Update the BAM records before writing out.
-    updateBamRecords();
-    // Write out BAM records.
-    writeBamRecords();
+    if (options.maxDepth == 0 || arena.size() <= (unsigned)options.maxDepth)
+        return;
+
+    // Group aligned reads by original alignment, unaligned reads are kept unchanged.  The reads of each group are
+    // sorted by hash and the groups by the hash of their first read.
+    std::map<std::string, std::vector<unsigned>> groups;
+    for (unsigned i = 0; i < arena.size(); ++i)
+        if (!arena.unmapped(i))
+            groups[alignmentKey(arena, i)].push_back(i);
+    std::vector<std::vector<std::pair<uint64_t, unsigned>>> hashes;
+    for (auto const & group : groups)
+    {
+        hashes.push_back(std::vector<std::pair<uint64_t, unsigned>>());
+        for (auto idx : group.second)
+            hashes.back().push_back(std::make_pair(readHash(arena, idx, options.seed), idx));
+        std::sort(hashes.back().begin(), hashes.back().end());
+    }
+    std::sort(hashes.begin(), hashes.end());
+
+    // Select records from each group.
+    unsigned perGroup = std::max((size_t)1, options.maxDepth / hashes.size());
+    representativeIdx.assign(arena.size(), seqan::maxValue<unsigned>());
+    realignIdx.clear();
+    for (unsigned g = 0; g < hashes.size(); ++g)
+        for (unsigned i = 0; i < hashes[g].size(); ++i)
+        {
+            representativeIdx[hashes[g][i].second] = hashes[g][0].second;
+            if (g < (unsigned)options.maxDepth && i < perGroup)
+                realignIdx.push_back(hashes[g][i].second);
+            else
+                heldBackIdx.push_back(hashes[g][i].second);
+        }
+    std::sort(realignIdx.begin(), realignIdx.end());
+    std::sort(heldBackIdx.begin(), heldBackIdx.end());
+
+    if (options.verbosity >= 1)
+        std::cerr << "    downsampled to " << realignIdx.size() << " of " << arena.size() << " records ("
+                  << groups.size() << " distinct alignments)\n";
 }
 
-// TODO(holtgrew): This function is much too big, split into smaller ones!
+// The consensus is the contig of store, as left by both engines.  Each held back read's aligned part is aligned with
+// alignBanded() against it, the band centered on where the realigned representative of its group begins (or on the
+// read's own position), and the result is mapped to the reference through the contig columns.  Reads that do not
+// align within the band keep their original alignment.
+
+void RealignerStepImpl::projectDownsampled()
+{
+    if (heldBackIdx.empty())
+        return;  // not downsampled
+
+    std::vector<uint8_t> consensus;
+    std::vector<int> consView;
+    getConsensus(consensus, consView);
+    if (consensus.empty())
+        return;
+
+    // The consensus position at which the aligned part of each realigned representative begins.  The store is still
+    // sorted by read ID from updateBamRecords().
+    int cBeginPos = back(store.alignedReadStore).beginPos;
+    BumpVector<int> repConsBegin(arena.size(), -1, tempAlloc());
+    for (auto const & el : store.alignedReadStore)
+        if (el.readId + 1 != length(store.readSeqStore))
+            repConsBegin[realignIdx[el.readId]] = std::lower_bound(consView.begin(), consView.end(),
+                                                                   (int)el.beginPos - cBeginPos) - consView.begin();
+
+    std::vector<std::vector<uint8_t>> seqs(heldBackIdx.size());
+    std::vector<std::pair<unsigned, unsigned>> clipOps(heldBackIdx.size());
+    std::vector<BandedAlignmentTask> tasks;
+    std::vector<unsigned> taskIdx;  // index into heldBackIdx
+    std::vector<AlignmentOp> ops;
+    for (unsigned i = 0; i < heldBackIdx.size(); ++i)
+    {
+        unsigned idx = heldBackIdx[i];
+        ops.clear();
+        toAlignedPart(seqs[i], ops, clipOps[i], arena, idx);
+        if (seqs[i].empty())
+            continue;  // nothing to align, keep alignment
+        int diagonal = repConsBegin[representativeIdx[idx]];
+        if (diagonal < 0)  // representative not realigned
+            diagonal = consensusPos(consView, arena.beginPos(idx));
+        BandedAlignmentTask task;
+        task.read = &seqs[i][0];
+        task.readLength = seqs[i].size();
+        task.diagonal = diagonal;
+        tasks.push_back(task);
+        taskIdx.push_back(i);
+    }
+    std::vector<BandedAlignment> results;
+    alignBanded(results, tasks, &consensus[0], consensus.size(), std::max(options.minBand, (int)result->stats.band));
+
+    unsigned numKept = heldBackIdx.size() - tasks.size();
+    seqan::String<ReadArena::TCigarElement> alignedCigar, cigar;
+    for (unsigned t = 0; t < results.size(); ++t)
+    {
+        unsigned idx = heldBackIdx[taskIdx[t]];
+        if (!results[t].ok)
+        {
+            ++numKept;
+            continue;
+        }
+        unsigned consBegin = results[t].beginPos;
+        projectToReference(alignedCigar, results[t].ops, consBegin, consView, contigSourcePos);
+        int numViews = (int)contigSourcePos.size() - 1;
+        int beginPos = region.beginPos + contigSourcePos[std::max(0, std::min(numViews, consView[consBegin]))];
+        withClipping(cigar, arena.cigar(idx), arena.cigarLength(idx), clipOps[taskIdx[t]], alignedCigar);
+        arena.setAlignment(idx, beginPos, cigar);
+    }
+    if (options.verbosity >= 2)
+        std::cerr << "    projected " << (heldBackIdx.size() - numKept) << " held back records onto the consensus, "
+                  << numKept << " kept\n";
+}
+
+int RealignerStepImpl::consensusPos(std::vector<int> const & consView, int pos) const
+{
+    unsigned sourcePos = std::max(0, pos - (int)region.beginPos);
+    int view = std::lower_bound(contigSourcePos.begin(), contigSourcePos.end(), sourcePos) - contigSourcePos.begin();
+    return std::lower_bound(consView.begin(), consView.end(), view) - consView.begin();
+}
+
+void RealignerStepImpl::getConsensus(std::vector<uint8_t> & consensus, std::vector<int> & consView)
+{
+    consensus.clear();
+    consView.clear();
+    if (options.engine == BamRealignerOptions::ENGINE_CONSENSUS)
+    {
+        contigSourcePos.clear();
+        for (unsigned pos = 0; pos < length(ref); ++pos)
+        {
+            consensus.push_back(ordValue(ref[pos]));
+            consView.push_back(pos);
+            contigSourcePos.push_back(pos);
+        }
+        contigSourcePos.push_back(length(ref));
+        return;
+    }
+
+    // The store is sorted by read ID from updateBamRecords(), the reference pseudo-read is last.
+    int cBeginPos = back(store.alignedReadStore).beginPos;
+    TContigGaps consensusGaps(store.contigStore[0].seq, store.contigStore[0].gaps);
+    std::vector<unsigned> consensusSourcePos;
+    buildViewToSource(consensusSourcePos, consensusGaps);
+    for (unsigned view = 0; view + 1 < consensusSourcePos.size(); ++view)
+    {
+        if (consensusSourcePos[view + 1] == consensusSourcePos[view])
+            continue;  // gap in consensus
+        consensus.push_back(ordValue(store.contigStore[0].seq[consensusSourcePos[view]]));
+        consView.push_back((int)view - cBeginPos);
+    }
+}
+
+// Aligners clip reads close to indels near their ends, so the clipped tails often continue behind an indel that the
+// realignment has put into the consensus.  Each soft-clipped read is aligned as a whole, tails included, with
+// alignBanded() against the consensus, around where its aligned part is.  A tail is un-clipped if its part of this
+// alignment has at least MIN_RESCUE_BASES aligned bases with at most MAX_RESCUE_MISMATCH_RATE mismatches and at most
+// MAX_RESCUE_GAPS gaps, the read then takes the new alignment.  Gaps and inserted bases at the outer end of a tail stay
+// clipped, and so does the whole tail otherwise.
+//
+// In --streaming mode, records are written out once no record of the current window begins left of them.  Leading
+// tails are therefore only un-clipped if the read does not begin left of the leftmost record of the window before.
+
+void RealignerStepImpl::rescueClippedTails()
+{
+    std::vector<uint8_t> consensus;
+    std::vector<int> consView;
+    getConsensus(consensus, consView);
+    if (consensus.empty())
+        return;
+
+    int minBeginPos = seqan::maxValue<int>();
+    for (unsigned idx = 0; idx < arena.size(); ++idx)
+        if (arena.rID(idx) == (int)region.rID)
+            minBeginPos = std::min(minBeginPos, originalSpans[idx].first);
+
+    int numViews = (int)contigSourcePos.size() - 1;
+
+    // Align the whole soft-clipped reads, the band centered on where their aligned parts are.
+    std::vector<unsigned> readIdx;
+    std::vector<std::vector<uint8_t>> seqs;
+    std::vector<int> diagonals;
+    for (unsigned idx = 0; idx < arena.size(); ++idx)
+    {
+        if (arena.unmapped(idx) || arena.rID(idx) != (int)region.rID)
+            continue;
+        std::pair<unsigned, unsigned> clipOps;
+        auto clipped = clippedBases(clipOps, arena.cigar(idx), arena.cigarLength(idx));
+        if ((clipped.first == 0 && clipped.second == 0) || clipOps.first == clipOps.second)
+            continue;  // no soft-clipping or nothing aligned
+        readIdx.push_back(idx);
+        diagonals.push_back(consensusPos(consView, arena.beginPos(idx)) - (int)clipped.first);
+        seqs.push_back(std::vector<uint8_t>());
+        for (unsigned pos = 0; pos < arena.seqLength(idx); ++pos)
+            seqs.back().push_back(arena.base(idx, pos));
+    }
+    std::vector<BandedAlignmentTask> tasks(seqs.size());
+    for (unsigned t = 0; t < tasks.size(); ++t)
+    {
+        tasks[t].read = &seqs[t][0];
+        tasks[t].readLength = seqs[t].size();
+        tasks[t].diagonal = diagonals[t];
+    }
+    std::vector<BandedAlignment> results;
+    alignBanded(results, tasks, &consensus[0], consensus.size(), std::max(options.minBand, (int)result->stats.band));
+
+    unsigned numRescued = 0;
+    std::vector<AlignmentColumn> columns;
+    std::vector<AlignmentOp> ops;
+    seqan::String<ReadArena::TCigarElement> alignedCigar, cigar;
+    for (unsigned t = 0; t < results.size(); ++t)
+    {
+        if (!results[t].ok)
+            continue;
+        unsigned idx = readIdx[t];
+        ReadArena::TCigarElement const * oldCigar = arena.cigar(idx);
+        unsigned oldCigarLength = arena.cigarLength(idx);
+        std::pair<unsigned, unsigned> clipOps;
+        auto clipped = clippedBases(clipOps, oldCigar, oldCigarLength);
+        int seqLength = seqs[t].size();
+
+        // Split the alignment into the leading tail, the aligned part and the trailing tail.  Gaps between a tail and
+        // the aligned part belong to the tail.
+        columns.clear();
+        int readPos = 0, consPos = results[t].beginPos;
+        for (auto const & op : results[t].ops)
+            for (unsigned i = 0; i < op.count; ++i)
+                columns.push_back(AlignmentColumn(op.operation, (op.operation != 'D') ? readPos++ : -1,
+                                                  (op.operation != 'I') ? consPos++ : -1));
+        unsigned alignedBegin = 0, alignedEnd = columns.size();
+        while (alignedBegin < columns.size() && columns[alignedBegin].readPos < (int)clipped.first)
+            ++alignedBegin;  // deletions have readPos -1
+        while (alignedEnd > alignedBegin && (columns[alignedEnd - 1].readPos >= seqLength - (int)clipped.second ||
+                                             columns[alignedEnd - 1].operation == 'D'))
+            --alignedEnd;
+        // Gaps and insertions at the outer ends stay clipped.
+        unsigned begin = 0, end = columns.size();
+        while (begin < alignedBegin && columns[begin].operation != 'M')
+            ++begin;
+        while (end > alignedEnd && columns[end - 1].operation != 'M')
+            --end;
+
+        bool rescueLeading = clipped.first && isRescuable(columns, begin, alignedBegin, seqs[t], consensus);
+        bool rescueTrailing = clipped.second && isRescuable(columns, alignedEnd, end, seqs[t], consensus);
+        if (!rescueLeading && !rescueTrailing)
+            continue;
+
+        // The new alignment is columns [b, e), it must not move the read left of the window's records.
+        unsigned b = 0, e = 0, consBegin = 0;
+        int beginPos = 0;
+        auto select = [&]() {
+            b = rescueLeading ? begin : alignedBegin;
+            e = rescueTrailing ? end : alignedEnd;
+            unsigned i = b;
+            for (; i < e && columns[i].consPos < 0; ++i)
+                continue;
+            if (i == e)
+                return false;  // nothing aligned to the consensus
+            consBegin = columns[i].consPos;
+            beginPos = region.beginPos + contigSourcePos[std::max(0, std::min(numViews, consView[consBegin]))];
+            return true;
+        };
+        if (!select())
+            continue;
+        if (rescueLeading && beginPos < minBeginPos)
+        {
+            rescueLeading = false;
+            if (!rescueTrailing || !select())
+                continue;
+        }
+        ops.clear();
+        for (unsigned i = b; i < e; ++i)
+            appendAlignmentOp(ops, columns[i].operation, 1);
+        projectToReference(alignedCigar, ops, consBegin, consView, contigSourcePos);
+
+        // Keep the hard-clipping, soft-clip the bases outside of the new alignment.
+        clear(cigar);
+        for (unsigned c = 0; c < clipOps.first; ++c)
+            if (oldCigar[c].operation == 'H')
+                appendValue(cigar, oldCigar[c]);
+        appendCigarOp(cigar, 'S', columns[b].readPos);
+        append(cigar, alignedCigar);
+        appendCigarOp(cigar, 'S', seqLength - 1 - columns[e - 1].readPos);
+        for (unsigned c = clipOps.second; c < oldCigarLength; ++c)
+            if (oldCigar[c].operation == 'H')
+                appendValue(cigar, oldCigar[c]);
+        arena.setAlignment(idx, beginPos, cigar);
+        numRescued += rescueLeading + rescueTrailing;
+    }
+
+    if (options.verbosity >= 1)
+        std::cerr << "    rescued " << numRescued << " clipped tails\n";
+}
 
 void RealignerStepImpl::buildFragmentStore()
 {
+    fillStoreFromRecords();
+
+    // Print store after loading.
+    if (needMsas())
+        outputMsa("before realignment", 0, (int)(region.endPos - region.beginPos));
+
+    if (options.verbosity >= 1)
+        std::cerr << "    added " << length(store.alignedReadStore) << " alignments\n";
+}
+
+// The binary dump is cheap and written first.  Laying out the MSA is the expensive part and only done for the text
+// outputs.
+
+void RealignerStepImpl::outputMsa(char const * title, int beginPos, int endPos)
+{
+    if (dumpMsas())
+        appendMsaDump(msasBin, store, title, beginPos, endPos);
+    if (!printMsas() && options.verbosity < 2)
+        return;
+
+    if (printMsas())
+        msasTxtOut << ">" << store.contigNameStore[0] << " " << title << "\n";
+    if (options.verbosity >= 2)
+        std::cerr << ">" << store.contigNameStore[0] << " " << title << "\n";
+
+    seqan::AlignedReadLayout layout;
+    layoutAlignment(layout, store);
+    std::ostream & msasOut = msasTxtOut;
+    if (printMsas())
+        printAlignment(msasOut, layout, store, 0, beginPos, endPos, 0, 10000);
+    if (options.verbosity >= 2)
+        printAlignment(std::cerr, layout, store, 0, beginPos, endPos, 0, 10000);
+}
+
+void RealignerStepImpl::fillStoreFromRecords()
+{
+    BumpVector<ContigAlignment> alignments(tempAlloc());
+    alignments.reserve(realignIdx.size());
+    for (auto idx : realignIdx)
+        if (arena.unmapped(idx))
+            alignments.push_back(ContigAlignment());
+        else
+            alignments.push_back(ContigAlignment(arena.beginPos(idx) - region.beginPos, arena.cigar(idx),
+                                                 arena.cigarLength(idx)));
+    fillStore(ref, alignments);
+}
+
+// TODO(holtgrew): This function is much too big, split into smaller ones!
+
+void RealignerStepImpl::fillStore(TContigSeq const & contig, BumpVector<ContigAlignment> const & alignments)
+{
+    // Clear store from a previous fill.
+    maxIndelLength = 0;
+    indelLengths.clear();
+    clearReads(store);
+    clear(store.readNameStore);
+    clear(store.alignedReadStore);
+
     // Set sequence into store.
     resize(store.contigStore, 1);
-    store.contigStore[0].seq = ref;
+    store.contigStore[0].seq = contig;
+    clear(store.contigStore[0].gaps);
     resize(store.contigNameStore, 1);
     region.toString(store.contigNameStore[0]);
 
-    // Stores (refPos, numInsertions) for each read, used for distributing gaps to other reads below.
-    std::vector<std::map<int, int> > readInsertions(records.size());
-    // Stores (refPos, numGaps) gaps to insert into the reference.
-    std::map<int, int> refGaps;
-
-    // TODO(holtgrew): The code below does NOT handle soft- and hard-clipping.
-
-    // We append the reads ignoring pairing and forward/reverse information.
-    for (auto const & record : records)
+    // Stores (refPos, numInsertions) for each read, used for distributing gaps to other reads below.  The entries of
+    // read i are readInsertions[readInsertionsBegin[i]..readInsertionsBegin[i + 1]), sorted by refPos.
+    BumpVector<std::pair<int, int>> readInsertions(tempAlloc());
+    BumpVector<unsigned> readInsertionsBegin(tempAlloc());
+    readInsertionsBegin.reserve(alignments.size() + 1);
+    // Stores (refPos, numGaps) gaps to insert into the reference, sorted by refPos after the loop below.
+    BumpVector<std::pair<int, int>> refGaps(tempAlloc());
+
+    // We append the reads ignoring pairing and forward/reverse information.  The read names are not needed in the
+    // store and are not copied.  Only the aligned part of each read goes into the store, without the soft- and
+    // hard-clipping, which updateBamRecords() restores.
+    seqan::Dna5String readSeq;
+    seqan::String<ReadArena::TCigarElement> cigarString;
+    for (unsigned i = 0; i < alignments.size(); ++i)
     {
         // -------------------------------------------------------------------
-        // Append read's sequence and id information.
+        // Append read's sequence.
         // -------------------------------------------------------------------
 
-        auto readID = appendRead(store, record.seq, record.qName);
+        std::pair<unsigned, unsigned> clipOps(0, alignments[i].cigarLength);
+        auto clipped = clippedBases(clipOps, alignments[i].cigar, alignments[i].cigarLength);
+        if (i < realignIdx.size())
+        {
+            unsigned idx = realignIdx[i];
+            resize(readSeq, arena.seqLength(idx) - std::min(arena.seqLength(idx), clipped.first + clipped.second));
+            for (unsigned pos = 0; pos < length(readSeq); ++pos)
+                readSeq[pos] = "ACGTN"[arena.base(idx, clipped.first + pos)];
+        }
+        auto readID = appendRead(store, (i < realignIdx.size()) ? readSeq : ref);
+        readInsertionsBegin.push_back(readInsertions.size());
 
         // -------------------------------------------------------------------
-        // Append alignment for read if it is aligned in the BAM file.
+        // Append alignment for read if it is aligned.
         // -------------------------------------------------------------------
 
-        if (hasFlagUnmapped(record))
+        if (!alignments[i].cigar)
             continue;
-        int beginPos = record.beginPos - region.beginPos;
+        resize(cigarString, clipOps.second - clipOps.first);
+        std::copy(alignments[i].cigar + clipOps.first, alignments[i].cigar + clipOps.second,
+                  begin(cigarString, seqan::Standard()));
+        int beginPos = alignments[i].beginPos;
         int clippedLength = 0;
-        _getClippedLength(record.cigar, clippedLength);
+        _getClippedLength(cigarString, clippedLength);
         int endPos = beginPos + clippedLength;
         auto alignmentID = appendAlignedRead(store, readID, 0, beginPos, endPos);
 
@@ -256,7 +1209,7 @@ void RealignerStepImpl::buildFragmentStore()
 
         TReadGaps readGaps(store.readSeqStore[readID],
                            store.alignedReadStore[alignmentID].gaps);
-        unsigned leadingGaps = cigarToGapAnchorRead(record.cigar, readGaps);
+        unsigned leadingGaps = cigarToGapAnchorRead(cigarString, readGaps);
         store.alignedReadStore[alignmentID].beginPos += leadingGaps;
         store.alignedReadStore[alignmentID].beginPos += leadingGaps;
 
@@ -265,15 +1218,20 @@ void RealignerStepImpl::buildFragmentStore()
         int readPos = 0;
         auto readGapsIt = begin(readGaps, seqan::Standard());
         if (options.verbosity >= 3)
-            std::cerr << "READ\t" << store.readNameStore[readID] << "\n";
-        for (auto cigar : record.cigar)
+            std::cerr << "READ\t" << readID << "\n";
+        for (auto cigar : cigarString)
         {
             switch (cigar.operation)
             {
                 case 'D':  // deletion from read => gap in read
                     // no need to insert gap, already registered in cigarToGapAnchorRead()
                     readGapsIt += cigar.count;
-                    readPos += cigar.count;
+                    refPos += cigar.count;
+                    if (i < realignIdx.size())
+                    {
+                        maxIndelLength = std::max(maxIndelLength, (unsigned)cigar.count);
+                        indelLengths.push_back(cigar.count);
+                    }
                     if (options.verbosity >= 3)
                         std::cerr << "\t" << cigar.operation << "\tcigar.count=" << cigar.count
                                   << "\treadPos=" << readPos
@@ -282,8 +1240,16 @@ void RealignerStepImpl::buildFragmentStore()
                     break;
 
                 case 'I':  // insertion into reference => gap in ref
-                    refGaps[refPos] = std::max(refGaps[refPos], (int)cigar.count);
-                    readInsertions[readID][refPos] = cigar.count;
+                    refGaps.push_back(std::make_pair(refPos, (int)cigar.count));
+                    if (i < realignIdx.size())
+                    {
+                        maxIndelLength = std::max(maxIndelLength, (unsigned)cigar.count);
+                        indelLengths.push_back(cigar.count);
+                    }
+                    if (readInsertions.size() > readInsertionsBegin.back() && readInsertions.back().first == refPos)
+                        readInsertions.back().second = cigar.count;
+                    else
+                        readInsertions.push_back(std::make_pair(refPos, (int)cigar.count));
                     readGapsIt += cigar.count;
                     readPos += cigar.count;
                     if (options.verbosity >= 3)
@@ -321,64 +1287,77 @@ void RealignerStepImpl::buildFragmentStore()
             std::cerr << "\t\t" << readGaps << "\n";
     }
 
+    readInsertionsBegin.push_back(readInsertions.size());
+
+    std::sort(indelLengths.begin(), indelLengths.end());
+    indelLengths.erase(std::unique(indelLengths.begin(), indelLengths.end()), indelLengths.end());
+
     // -----------------------------------------------------------------------
     // Project individual insertions to MSA
     // -----------------------------------------------------------------------
 
-    // Sort aligned reads, so we can lowerBound() below.
+    // Sort the reference gaps by position, keeping the largest insertion at each position.
+    std::sort(refGaps.begin(), refGaps.end());
+    unsigned numRefGaps = 0;
+    for (auto const & gap : refGaps)
+        if (numRefGaps > 0 && refGaps[numRefGaps - 1].first == gap.first)
+            refGaps[numRefGaps - 1].second = gap.second;  // sorted, so this is the largest
+        else
+            refGaps[numRefGaps++] = gap;
+    refGaps.resize(numRefGaps);
+
+    // gapsBefore[i] is the number of gap columns inserted for the first i reference gaps.
+    BumpVector<int> gapsBefore(refGaps.size() + 1, 0, tempAlloc());
+    for (unsigned i = 0; i < refGaps.size(); ++i)
+        gapsBefore[i + 1] = gapsBefore[i] + refGaps[i].second;
+
+    // Sort aligned reads by begin position, ties by end position.
     sortAlignedReads(store.alignedReadStore, seqan::SortEndPos());
     sortAlignedReads(store.alignedReadStore, seqan::SortBeginPos());
 
     // Obtain contig gaps.
     TContigGaps contigGaps(store.contigStore[0].seq, store.contigStore[0].gaps);
 
-    // Build interval tree for overlapping reads lookup (cargo is alignment id, not read id!)
-    typedef seqan::IntervalAndCargo<int, int> TInterval;
-    seqan::String<TInterval> intervals;
-    for (auto const & el : store.alignedReadStore)
-        appendValue(intervals, TInterval(toSourcePosition(contigGaps, el.beginPos),
-                                         toSourcePosition(contigGaps, el.endPos),
-                                         el.id));
-    seqan::IntervalTree<int, int> tree(intervals);
-
-    // Insert gaps into overlapping reads.
-    seqan::String<int> results;
-    for (auto it = refGaps.rbegin(); it != refGaps.rend(); ++it)
+    // Project the reference gaps onto each read in one pass over the reads.  All positions are still reference
+    // positions since the contig has no gaps yet.  Gaps strictly within the read are inserted into the read (less the
+    // read's own insertion at this position), right to left so the view positions stay valid.  Gaps at or left of the
+    // read's begin position shift the whole read to the right.
+    auto byPos = [](std::pair<int, int> const & gap, int pos) { return gap.first < pos; };
+    for (auto & el : store.alignedReadStore)
     {
-        // Update overlapping reads.
-        clear(results);
-        findIntervals(tree, it->first, it->first + 1, results);
-        for (auto alignmentID : results)
-        {
-            auto & el = store.alignedReadStore[alignmentID];
-            int viewPos = it->first - el.beginPos;
-
-            TReadGaps readGaps(store.readSeqStore[el.readId],
-                               store.alignedReadStore[alignmentID].gaps);
+        int beginPos = el.beginPos, endPos = el.endPos;
+        auto itBegin = std::lower_bound(refGaps.begin(), refGaps.end(), beginPos + 1, byPos);
+        auto itEnd = std::lower_bound(itBegin, refGaps.end(), endPos, byPos);
 
-            // Leading gaps are handled below in shifting step and trailing gaps are ignored.
-            if (viewPos == 0 || viewPos == (int)(el.endPos - el.beginPos))
-                continue;
-
-            int delta = readInsertions[el.readId].count(it->first) ? readInsertions[el.readId][it->first] : 0;
-            insertGaps(readGaps, viewPos, it->second - delta);
-            el.endPos += it->second - delta;
-            if (options.verbosity >= 3)
-                std::cerr << "INSERTING READ GAPS\t" << el.readId << "\t" << readGaps << "\t" << viewPos
-                          << "\t" << (it->second - delta) << "\n";
-        }
-        // Update reads left of where we are inserting gaps.
-        auto itA = lowerBoundAlignedReads(store.alignedReadStore, toViewPosition(contigGaps, it->first), seqan::SortBeginPos());
-        for (; itA != end(store.alignedReadStore, seqan::Standard()); ++itA)
+        if (itBegin != itEnd)
         {
-            if (options.verbosity >= 3)
-                std::cerr << "SHIFTING LEFT\t" << itA->readId << "\t" << store.readSeqStore[itA->readId]
-                          << " by " << it->second << "\n";
-            itA->beginPos += it->second;
-            itA->endPos += it->second;
+            TReadGaps readGaps(store.readSeqStore[el.readId], el.gaps);
+            auto insBegin = readInsertions.begin() + readInsertionsBegin[el.readId];
+            auto insEnd = readInsertions.begin() + readInsertionsBegin[el.readId + 1];
+            for (auto it = itEnd; it != itBegin; )
+            {
+                --it;
+                auto itIns = std::lower_bound(insBegin, insEnd, it->first, byPos);
+                int delta = (itIns != insEnd && itIns->first == it->first) ? itIns->second : 0;
+                if (it->second == delta)
+                    continue;  // read has the longest insertion here
+                int viewPos = it->first - beginPos;
+                insertGaps(readGaps, viewPos, it->second - delta);
+                el.endPos += it->second - delta;
+                if (options.verbosity >= 3)
+                    std::cerr << "INSERTING READ GAPS\t" << el.readId << "\t" << readGaps << "\t" << viewPos
+                              << "\t" << (it->second - delta) << "\n";
+            }
         }
+
+        int shift = gapsBefore[itBegin - refGaps.begin()];
+        if (options.verbosity >= 3 && shift)
+            std::cerr << "SHIFTING LEFT\t" << el.readId << "\t" << store.readSeqStore[el.readId]
+                      << " by " << shift << "\n";
+        el.beginPos += shift;
+        el.endPos += shift;
     }
-    
+
     // Insert gaps into contig.
     for (auto it = refGaps.rbegin(); it != refGaps.rend(); ++it)
     {
@@ -387,47 +1366,59 @@ void RealignerStepImpl::buildFragmentStore()
             std::cerr << "INSERTING CONTIG GAPS\t" << it->first << "\t" << it->second << "\n";
         insertGaps(contigGaps, it->first, it->second);
     }
-
-    // Print store after loading.
-    if (options.verbosity >= 2 || msasTxtOut.good())
-    {
-        if (msasTxtOut.good())
-            msasTxtOut << ">" << store.contigNameStore[0] << " before realignment\n";
-        if (options.verbosity >= 2)
-            std::cerr << ">" << store.contigNameStore[0] << " before realignment\n";
-
-        seqan::AlignedReadLayout layout;
-        layoutAlignment(layout, store);
-        if (msasTxtOut.good())
-            printAlignment(msasTxtOut, layout, store, 0, 0, (int)(region.endPos - region.beginPos), 0, 10000);
-        if (options.verbosity >= 2)
-            printAlignment(std::cerr, layout, store, 0, 0, (int)(region.endPos - region.beginPos), 0, 10000);
-    }
-
-    if (options.verbosity >= 1)
-        std::cerr << "    added " << length(store.alignedReadStore) << " alignments\n";
 }
 
-void RealignerStepImpl::performRealignment()
+// The band starts at the window's largest indel plus BAND_MARGIN and is doubled (up to options.maxBand) while the
+// alignments reach its edge.  reAlignment() does not report this, so a gap run as long as the band is taken as the
+// sign of a too narrow band.  Long indels are not widened for: gap runs as long as an indel of the input CIGAR strings
+// are most likely that indel and are ignored, and widening stops when the longest gap run stays the same with the wider
+// band, as a run cut by the band would have grown or disappeared.
+
+bool RealignerStepImpl::performRealignment()
 {
     double startTime = seqan::sysTime();
     if (options.verbosity >= 1)
         std::cerr << "Performing realignment\n";
-    reAlignment(store, 0, 1, 10, 1, 0, 0, /*debug=*/(options.verbosity >= 3),
-                /*printTiming=*/(options.verbosity >= 2));
+    int band = std::max(options.minBand, std::min(options.maxBand, (int)maxIndelLength + BAND_MARGIN));
+    if (options.engine == BamRealignerOptions::ENGINE_BANDED)
+    {
+        if (!performBandedRealignment(band))
+            return false;
+    }
+    else if (options.engine == BamRealignerOptions::ENGINE_CONSENSUS)
+    {
+        if (!performConsensusRealignment())
+            return false;
+    }
+    else
+    {
+        // The deadline is checked around each step, a single reAlignment() call cannot be interrupted.
+        unsigned lastGapRun = 0;
+        while (true)
+        {
+            result->stats.band = band;
+            reAlignment(store, 0, 1, band, 1, 0, 0, /*debug=*/(options.verbosity >= 3),
+                        /*printTiming=*/(options.verbosity >= 2));
+            if (pastDeadline())
+                return false;
+            unsigned gapRun = longestGapRun();
+            if (band >= options.maxBand || gapRun < (unsigned)band || gapRun == lastGapRun)
+                break;
+            lastGapRun = gapRun;
+            band = std::min(options.maxBand, 2 * band);
+            if (options.verbosity >= 2)
+                std::cerr << "    widening band to " << band << "\n";
+            fillStoreFromRecords();
+            if (pastDeadline())
+                return false;
+        }
+    }
     if (options.verbosity >= 1)
         std::cerr << "  => DONE (took " << seqan::sysTime() - startTime << " s)\n";
 
     // Print store after realignment.
-    if (options.verbosity >= 2 || msasTxtOut.good())
+    if (needMsas())
     {
-        if (msasTxtOut.good())
-            msasTxtOut << ">" << store.contigNameStore[0] << " after realignment\n";
-        if (options.verbosity >= 2)
-            std::cerr << ">" << store.contigNameStore[0] << " after realignment\n";
-
-        seqan::AlignedReadLayout layout;
-        layoutAlignment(layout, store);
         int minPos = seqan::maxValue<int>(), maxPos = seqan::minValue<int>();
         for (auto const & el : store.alignedReadStore)
         {
@@ -436,68 +1427,319 @@ void RealignerStepImpl::performRealignment()
         }
         if (minPos == seqan::maxValue<int>())
             minPos = maxPos = 0;
-        if (msasTxtOut.good())
-            printAlignment(msasTxtOut, layout, store, 0, minPos, maxPos, 0, 10000);
+        outputMsa("after realignment", minPos, maxPos);
+    }
+    return true;
+}
+
+// The banded engine works on the aligned parts of the reads, the clipping is kept.  The result is written to the store
+// as after reAlignment(): the consensus as the contig and the reference as the last read, so updateBamRecords() works
+// the same for both engines.
+
+bool RealignerStepImpl::performBandedRealignment(int band)
+{
+    // Convert reads and reference, the clipping operations of read i are cigar[0..clipOps[i].first) and
+    // cigar[clipOps[i].second..).
+    std::vector<BandedRealignerRead> reads(realignIdx.size());
+    BumpVector<std::pair<unsigned, unsigned>> clipOps(realignIdx.size(), std::pair<unsigned, unsigned>(), tempAlloc());
+    for (unsigned i = 0; i < realignIdx.size(); ++i)
+    {
+        unsigned idx = realignIdx[i];
+        if (arena.unmapped(idx))
+            continue;
+
+        BandedRealignerRead & read = reads[i];
+        toAlignedPart(read.seq, read.ops, clipOps[i], arena, idx);
+        read.beginPos = arena.beginPos(idx) - region.beginPos;
+        read.aligned = !read.seq.empty();
+    }
+    std::vector<uint8_t> refCodes;
+    refCodes.reserve(length(ref));
+    for (unsigned pos = 0; pos < length(ref); ++pos)
+        refCodes.push_back(ordValue(ref[pos]));
+
+    std::vector<uint8_t> consensus;
+    BandedAlignment refAlignment;
+    BandedRealignerStats stats;
+    std::vector<BandedRealignerRead> input;
+    auto stop = [this]() { return pastDeadline(); };
+    bool ok;
+    while (true)
+    {
+        if (band < options.maxBand)
+            input = reads;  // keep for realigning with a wider band
+        result->stats.band = band;
+        stats = BandedRealignerStats();
+        ok = realignBanded(consensus, refAlignment, reads, refCodes, band, BANDED_MAX_ROUNDS, stats, stop);
+        if (pastDeadline())
+            return false;
+        if (band >= options.maxBand || stats.bandEdgeHits == 0)
+            break;
+        band = std::min(options.maxBand, 2 * band);
         if (options.verbosity >= 2)
-            printAlignment(std::cerr, layout, store, 0, minPos, maxPos, 0, 10000);
+            std::cerr << "    " << stats.bandEdgeHits << " alignments touching the band edge, widening band to "
+                      << band << "\n";
+        reads.swap(input);
+    }
+    if (!ok)
+    {
+        if (options.verbosity >= 1)
+            std::cerr << "WARNING: Could not align reference against consensus, keeping alignments.\n";
+        consensus = refCodes;
+        refAlignment.beginPos = 0;
+        refAlignment.ops.assign(1, AlignmentOp('M', refCodes.size()));
     }
+    if (options.verbosity >= 2)
+        std::cerr << "    " << stats.rounds << " rounds, " << stats.alignments << " alignments, "
+                  << stats.bandEdgeHits << " touching the band edge\n";
+
+    // Write consensus and alignments into the store, restoring the clipping.
+    std::vector<seqan::String<ReadArena::TCigarElement> > cigars(realignIdx.size() + 1);
+    BumpVector<ContigAlignment> alignments(realignIdx.size() + 1, ContigAlignment(), tempAlloc());
+    for (unsigned i = 0; i < realignIdx.size(); ++i)
+    {
+        unsigned idx = realignIdx[i];
+        if (!reads[i].aligned)
+        {
+            if (!arena.unmapped(idx))  // nothing to realign, keep alignment
+                alignments[i] = ContigAlignment(arena.beginPos(idx) - region.beginPos, arena.cigar(idx),
+                                                arena.cigarLength(idx));
+            continue;
+        }
+        withClipping(cigars[i], arena.cigar(idx), arena.cigarLength(idx), clipOps[i], reads[i].ops);
+        alignments[i] = ContigAlignment(reads[i].beginPos, cigars[i]);
+    }
+    for (auto const & op : refAlignment.ops)
+        appendValue(cigars.back(), ReadArena::TCigarElement(op.operation, op.count));
+    alignments.back() = ContigAlignment(refAlignment.beginPos, cigars.back());
+
+    TContigSeq consensusSeq;
+    resize(consensusSeq, consensus.size());
+    for (unsigned pos = 0; pos < consensus.size(); ++pos)
+        consensusSeq[pos] = seqan::Dna5("ACGTN"[consensus[pos]]);
+    fillStore(consensusSeq, alignments);
+    return true;
 }
 
+// The consensus engine works on the aligned parts of the reads as the banded engine.  Only the reads moved to the
+// winning haplotype change, the others keep their alignment.
+
+bool RealignerStepImpl::performConsensusRealignment()
+{
+    // The reads held back by downsample() follow the sampled ones, they are placed on the winning haplotype without
+    // voting for it.
+    BumpVector<unsigned> readIdx(realignIdx.begin(), realignIdx.end(), tempAlloc());
+    readIdx.insert(readIdx.end(), heldBackIdx.begin(), heldBackIdx.end());
+    std::vector<ConsensusRealignerRead> reads(readIdx.size());
+    BumpVector<std::pair<unsigned, unsigned>> clipOps(readIdx.size(), std::pair<unsigned, unsigned>(), tempAlloc());
+    for (unsigned i = 0; i < readIdx.size(); ++i)
+    {
+        unsigned idx = readIdx[i];
+        if (arena.unmapped(idx))
+            continue;
+
+        ConsensusRealignerRead & read = reads[i];
+        read.votes = (i < realignIdx.size());
+        toAlignedPart(read.seq, read.ops, clipOps[i], arena, idx);
+        unsigned clipBegin = clippedBases(clipOps[i], arena.cigar(idx), arena.cigarLength(idx)).first;
+        auto qual = arena.qual(idx);
+        bool hasQual = (qual.second == arena.seqLength(idx));
+        for (unsigned pos = 0; pos < read.seq.size(); ++pos)
+        {
+            int q = hasQual ? (int)qual.first[clipBegin + pos] - 33 : DEFAULT_QUALITY;
+            read.qual.push_back(std::max(0, std::min((int)MAX_QUALITY, q)));
+        }
+        read.beginPos = arena.beginPos(idx) - region.beginPos;
+        read.aligned = !read.seq.empty();
+    }
+    std::vector<uint8_t> refCodes;
+    refCodes.reserve(length(ref));
+    for (unsigned pos = 0; pos < length(ref); ++pos)
+        refCodes.push_back(ordValue(ref[pos]));
+
+    ConsensusRealignerStats stats;
+    bool realigned = realignConsensus(reads, refCodes, CONSENSUS_MIN_LOD, stats, [this]() { return pastDeadline(); });
+    if (options.verbosity >= 2)
+        std::cerr << "    " << stats.alleles << " indel alleles, " << stats.haplotypes << " haplotypes, improvement "
+                  << stats.improvement << ", " << stats.realignedReads << " reads realigned\n";
+    if (pastDeadline())
+        return false;
+    if (!realigned)
+        return true;
+
+    seqan::String<ReadArena::TCigarElement> cigar;
+    for (unsigned i = 0; i < readIdx.size(); ++i)
+    {
+        if (!reads[i].realigned)
+            continue;
+        unsigned idx = readIdx[i];
+        withClipping(cigar, arena.cigar(idx), arena.cigarLength(idx), clipOps[i], reads[i].ops);
+        arena.setAlignment(idx, region.beginPos + reads[i].beginPos, cigar);
+    }
+
+    // Refill the store for printing the MSA after realignment.
+    if (needMsas())
+        fillStoreFromRecords();
+    return true;
+}
+
+// The gaps of the contig pseudo-read (the reference) are converted once per window into a view to source table, so
+// the begin position of each read is a lookup and its CIGAR is emitted by walking the read's gap runs and the table
+// in lockstep.  This is linear in the total alignment length, without searching the contig's gap anchors per read.
+
 void RealignerStepImpl::updateBamRecords()
 {
     // Make sure that the contig pseudo-read is the last one.
     sortAlignedReads(store.alignedReadStore, seqan::SortReadId());
 
-    // Obtain contig gaps.
+    // Obtain contig gaps and their view to source table.
     TContigGaps contigGaps(back(store.readSeqStore),
                            back(store.alignedReadStore).gaps);
     int cBeginPos = back(store.alignedReadStore).beginPos;
-    //int cEndPos = back(store.alignedReadStore).endPos;
+    buildViewToSource(contigSourcePos, contigGaps);
+    unsigned numViews = contigSourcePos.size() - 1;
+    if (numViews > contigSourcePos.back())
+        result->stats.numGaps = numViews - contigSourcePos.back();
+    seqan::String<ReadArena::TCigarElement> alignedCigar, cigar;
     for (auto const & el : store.alignedReadStore)
     {
-        auto & record = records[el.readId];
         if (el.readId + 1 == length(store.readSeqStore))
             continue;  // skip contig pseudo-read
 
-        // Obtain read gaps and clipped contig gaps.
+        // Update alignment position and alignment info, restoring the clipping.
         TReadGaps readGaps(store.readSeqStore[el.readId], el.gaps);
-        TContigGaps clippedContigGaps(back(store.readSeqStore),
-                                      back(store.alignedReadStore).gaps);
-        setClippedEndPosition(clippedContigGaps, el.endPos - cBeginPos);
-        setClippedBeginPosition(clippedContigGaps, el.beginPos - cBeginPos);
-
-        // Update alignment position and alignment info.
-        record.beginPos = region.beginPos + toSourcePosition(contigGaps, el.beginPos);
-        getCigarString(record.cigar, clippedContigGaps, readGaps);
+        unsigned idx = realignIdx[el.readId];
+        int viewBegin = el.beginPos - cBeginPos;
+        int beginPos = region.beginPos + contigSourcePos[std::max(0, std::min((int)numViews, viewBegin))];
+        getAlignedCigar(alignedCigar, readGaps, contigSourcePos, viewBegin, el.endPos - cBeginPos);
+        std::pair<unsigned, unsigned> clipOps;
+        clippedBases(clipOps, arena.cigar(idx), arena.cigarLength(idx));
+        withClipping(cigar, arena.cigar(idx), arena.cigarLength(idx), clipOps, alignedCigar);
+        arena.setAlignment(idx, beginPos, cigar);
     }
 }
 
 void RealignerStepImpl::writeBamRecords()
 {
-    for (auto const & record : records)
-        writeRecord(bamFileOut, record);
+    result->records.resize(arena.size());
+    for (unsigned i = 0; i < arena.size(); ++i)
+        arena.get(result->records[i], i);
+    fixMates();
+    result->msasTxt = msasTxtOut.str();
+    result->msasBin.swap(msasBin);
+}
+
+void RealignerStepImpl::fixMates()
+{
+    std::vector<seqan::BamAlignmentRecord> & records = result->records;
+    result->mateMoves.clear();
+
+    auto moved = [&](unsigned idx) {
+        return records[idx].beginPos != originalSpans[idx].first ||
+                records[idx].beginPos + (int)arena.alignmentLengthInRef(idx) != originalSpans[idx].second;
+    };
+    unsigned idx = 0;
+    while (idx < records.size() && !(moved(idx) && isPrimaryWithAlignedMate(records[idx])))
+        ++idx;
+    if (idx == records.size())
+        return;  // no mate to update
+
+    pairedIdx.clear();
+    for (unsigned i = 0; i < records.size(); ++i)
+        if (isPrimaryWithAlignedMate(records[i]))
+            pairedIdx.insert(std::make_pair(hashReadName(records[i].qName), i));
+
+    for (; idx < records.size(); ++idx)
+    {
+        seqan::BamAlignmentRecord & record = records[idx];
+        if (!moved(idx) || !isPrimaryWithAlignedMate(record))
+            continue;
+        int endPos = record.beginPos + arena.alignmentLengthInRef(idx);
+        uint64_t nameHash = hashReadName(record.qName);
+
+        // Update both records if the mate is in the window.
+        auto range = pairedIdx.equal_range(nameHash);
+        auto it = std::find_if(range.first, range.second, [&](std::pair<uint64_t const, unsigned> const & el) {
+                return isOtherSegment(records[el.second], record.flag) && records[el.second].qName == record.qName;
+            });
+        if (it != range.second)
+        {
+            seqan::BamAlignmentRecord & mate = records[it->second];
+            int mateEndPos = mate.beginPos + arena.alignmentLengthInRef(it->second);
+            record.pNext = mate.beginPos;
+            mate.pNext = record.beginPos;
+            if (record.rID == mate.rID)
+            {
+                record.tLen = templateLength(record.beginPos, endPos, mate.beginPos, mateEndPos,
+                                             record.flag & seqan::BAM_FLAG_FIRST);
+                mate.tLen = -record.tLen;
+            }
+            continue;
+        }
+
+        // Otherwise, shift TLEN by the moved outer end, assuming that the mate's other end is the outer one, and
+        // leave the mate to the output stage.
+        if (record.rID == record.rNextId && record.tLen > 0)
+            record.tLen -= record.beginPos - originalSpans[idx].first;
+        else if (record.rID == record.rNextId && record.tLen < 0)
+            record.tLen -= endPos - originalSpans[idx].second;
+        MateMove move;
+        move.nameHash = nameHash;
+        move.flag = record.flag;
+        move.rID = record.rID;
+        move.oldBeginPos = originalSpans[idx].first;
+        move.beginPos = record.beginPos;
+        move.endPos = endPos;
+        move.mateRID = record.rNextId;
+        move.mateBeginPos = record.pNext;
+        result->mateMoves.push_back(move);
+    }
+}
+
+unsigned RealignerStepImpl::longestGapRun()
+{
+    TContigGaps contigGaps(store.contigStore[0].seq, store.contigStore[0].gaps);
+    unsigned result = maxGapRun(contigGaps, indelLengths);
+    for (auto & el : store.alignedReadStore)
+    {
+        TReadGaps readGaps(store.readSeqStore[el.readId], el.gaps);
+        result = std::max(result, maxGapRun(readGaps, indelLengths));
+    }
+    return result;
+}
+
+uint64_t RealignerStepImpl::storeBytes() const
+{
+    typedef seqan::Value<TAlignedRead::TGapAnchors>::Type TGapAnchor;
+
+    uint64_t bytes = length(store.alignedReadStore) * sizeof(TAlignedRead) +
+            length(store.contigStore) * sizeof(TContig);
+    for (auto const & el : store.alignedReadStore)
+        bytes += length(el.gaps) * sizeof(TGapAnchor);
+    for (auto const & contig : store.contigStore)
+        bytes += length(contig.seq) + length(contig.gaps) * sizeof(TGapAnchor);
+    for (unsigned i = 0; i < length(store.readSeqStore); ++i)
+        bytes += length(store.readSeqStore[i]);
+    for (unsigned i = 0; i < length(store.readNameStore); ++i)
+        bytes += length(store.readNameStore[i]);
+    return bytes;
 }
 
 // ---------------------------------------------------------------------------
 // Class RealignerStep
 // ---------------------------------------------------------------------------
 
-RealignerStep::RealignerStep(seqan::BamFileOut & bamFileOut,
-                             seqan::VirtualStream<char, seqan::Output> & msaTxtOut,
-                             seqan::BamFileIn & bamFileIn,
-                             seqan::BamIndex<seqan::Bai> & baiIndex,
-                             seqan::FaiIndex & faiIndex,
-                             seqan::GenomicRegion const & region,
-                             BamRealignerOptions const & options) :
-        impl(new RealignerStepImpl(bamFileOut, msaTxtOut, bamFileIn, baiIndex, faiIndex,
-                                   region, options))
+RealignerStep::RealignerStep(ReferenceProvider & referenceProvider, BamRealignerOptions const & options) :
+        impl(new RealignerStepImpl(referenceProvider, options))
 {}
 
 RealignerStep::~RealignerStep()
 {}
 
-void RealignerStep::run()
+void RealignerStep::run(RealignerStepResult & result,
+                        std::vector<seqan::BamAlignmentRecord> & records,
+                        RealignmentWindow const & window)
 {
-    impl->run();
+    impl->run(result, records, window);
 }
 
@@ -36,6 +36,8 @@
 #define REALIGNER_STEP_H_
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <seqan/seq_io.h>
 #include <seqan/bam_io.h>
@@ -43,22 +45,57 @@
 #include <seqan/store.h>
 
 #include "bam_realigner_options.h"
+#include "mate_fixer.h"
+#include "step_stats.h"
 
 class BamRealignerOptions;
+class RealignmentWindow;
+class ReferenceProvider;
 class RealignerStepImpl;
 
+// ---------------------------------------------------------------------------
+// Class RealignerStepResult
+// ---------------------------------------------------------------------------
+
+// The output of one RealignerStep.  The results are buffered so the caller can write them out in region order,
+// regardless of the order in which the steps finish.
+
+class RealignerStepResult
+{
+public:
+    // The realigned records, to be written to the output BAM file.
+    std::vector<seqan::BamAlignmentRecord> records;
+    // The moved records whose mates were not in the window, for updating the mates on output.  Mates in the window
+    // are updated in records.
+    std::vector<MateMove> mateMoves;
+    // The MSAs before/after realignment in text format, empty if no MSA output was requested.
+    std::string msasTxt;
+    // The MSAs before/after realignment in the binary dump format, empty if no binary MSA output was requested.
+    std::string msasBin;
+    // Why the records were passed through unchanged, empty if the window was realigned.
+    std::string skipReason;
+    // Counters and timings, the caller adds the time for loading the alignments and for writing.
+    StepStats stats;
+};
+
+// ---------------------------------------------------------------------------
+// Class RealignerStep
+// ---------------------------------------------------------------------------
+
+// Realigns windows one after the other.  The step keeps its FragmentStore and buffers between windows, so one step
+// per thread realigns many windows without allocating anew for each.
+
 class RealignerStep
 {
 public:
-    RealignerStep(seqan::BamFileOut & bamFileOut,
-                  seqan::VirtualStream<char, seqan::Output> & msaTxtOut,
-                  seqan::BamFileIn & bamFileIn,
-                  seqan::BamIndex<seqan::Bai> & baiIndex,
-                  seqan::FaiIndex & faiIndex,
-                  seqan::GenomicRegion const & region,
-                  BamRealignerOptions const & options);
+    RealignerStep(ReferenceProvider & referenceProvider, BamRealignerOptions const & options);
     ~RealignerStep();  // for pimpl
-    void run();
+
+    // Realign the given records of window and write the outcome to result.  The region to realign is window.region,
+    // extended by the records.  records is cleared.
+    void run(RealignerStepResult & result,
+             std::vector<seqan::BamAlignmentRecord> & records,
+             RealignmentWindow const & window);
 
 private:
     std::unique_ptr<RealignerStepImpl> impl;
@@ -0,0 +1,257 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "record_cache.h"
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+
+#include "bam_realigner_options.h"
+#include "cram_io.h"
+#include "interval_planner.h"
+
+namespace {  // anonymous namespace
+
+// Continue reading sequentially instead of jumping if the next window begins at most this many bases right of the
+// cached range.
+int const MAX_SKIP_DISTANCE = 16 * 1024;
+
+inline int endPosition(seqan::BamAlignmentRecord const & record)
+{
+    return record.beginPos + getAlignmentLengthInRef(record);
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class RecordCacheStats
+// ---------------------------------------------------------------------------
+
+void RecordCacheStats::print(std::ostream & out) const
+{
+    out << "    Record cache: " << hits << " hits, " << partialHits << " partial hits, " << misses << " misses, "
+        << recordsDecoded << " records decoded, " << recordsServed << " records served\n";
+}
+
+// ---------------------------------------------------------------------------
+// Class RecordCacheImpl
+// ---------------------------------------------------------------------------
+
+class RecordCacheImpl
+{
+public:
+    RecordCacheImpl(seqan::BamFileIn & bamFileIn,
+                    seqan::BamIndex<seqan::Bai> const & baiIndex,
+                    CramFileIn * cramFileIn,
+                    BamRealignerOptions const & options) :
+            bamFileIn(bamFileIn), baiIndex(baiIndex), cramFileIn(cramFileIn), options(options), rID(-1),
+            cacheBegin(0), cacheEnd(0), hasLookahead(false), atContigEnd(true)
+    {}
+
+    void fetch(std::vector<seqan::BamAlignmentRecord> & result, RealignmentWindow const & window);
+
+    // Counters.
+    RecordCacheStats stats;
+
+private:
+
+    // Clear cache and jump to the given position using the BAI or CRAI index.
+    void jumpTo(int rID, int beginPos, int endPos);
+    // Read records beginning left of endPos into the cache.
+    void readUntil(int endPos);
+    // Remove records ending left of or at beginPos.
+    void evict(int beginPos);
+
+    // Input BAM file and BAI index.
+    seqan::BamFileIn & bamFileIn;
+    seqan::BamIndex<seqan::Bai> const & baiIndex;
+    // Input CRAM file, used instead of bamFileIn if not nullptr.
+    CramFileIn * cramFileIn;
+
+    // Options.
+    BamRealignerOptions const & options;
+
+    // The cached records are all records on contig rID overlapping with [cacheBegin, cacheEnd), sorted by begin
+    // position as in the BAM file.
+    int rID;
+    int cacheBegin;
+    int cacheEnd;
+    std::deque<seqan::BamAlignmentRecord> records;
+
+    // The first record right of the cached range, already read from the file.
+    seqan::BamAlignmentRecord lookahead;
+    bool hasLookahead;
+    // Whether the file position is at the end of contig rID, so no further records can be read for it.
+    bool atContigEnd;
+};
+
+void RecordCacheImpl::fetch(std::vector<seqan::BamAlignmentRecord> & result, RealignmentWindow const & window)
+{
+    int beginPos = window.region.beginPos;
+    int endPos = window.region.endPos;
+
+    if (window.region.rID != rID || beginPos < cacheBegin || beginPos > cacheEnd + MAX_SKIP_DISTANCE)
+    {
+        ++stats.misses;
+        jumpTo(window.region.rID, beginPos, endPos);
+    }
+    else if (endPos > cacheEnd)
+    {
+        ++stats.partialHits;
+        readUntil(endPos);
+    }
+    else
+    {
+        ++stats.hits;
+    }
+    evict(beginPos);
+
+    result.clear();
+    for (auto const & record : records)
+    {
+        if (record.beginPos >= endPos)
+            break;  // done, no more records
+        if (endPosition(record) <= beginPos || record.beginPos < window.prevEndPos)
+            continue;  // skip record, left of window or realigned in previous window
+        result.push_back(record);
+    }
+    stats.recordsServed += result.size();
+
+    if (options.verbosity >= 3)
+        std::cerr << "RECORD CACHE\t" << records.size() << " records cached in [" << cacheBegin << ", "
+                  << cacheEnd << ")\n";
+}
+
+void RecordCacheImpl::jumpTo(int newRID, int beginPos, int endPos)
+{
+    records.clear();
+    hasLookahead = false;
+    atContigEnd = false;
+    rID = newRID;
+    cacheBegin = cacheEnd = beginPos;
+
+    if (cramFileIn)
+    {
+        cramFileIn->jumpTo(rID, beginPos);
+        readUntil(endPos);
+        return;
+    }
+
+    bool hasAlignments = false;
+    if (!jumpToRegion(bamFileIn, hasAlignments, rID, beginPos, endPos, baiIndex))
+        throw seqan::IOError("Problem jumping in file.\n");
+    if (!hasAlignments)
+    {
+        rID = -1;  // nothing to read, the next window has to jump again
+        return;
+    }
+
+    readUntil(endPos);
+}
+
+void RecordCacheImpl::readUntil(int endPos)
+{
+    if (hasLookahead)
+    {
+        if (lookahead.beginPos >= endPos)
+        {
+            cacheEnd = endPos;
+            return;  // still right of range
+        }
+        hasLookahead = false;
+        records.push_back(lookahead);
+    }
+
+    seqan::BamAlignmentRecord record;
+    while (!atContigEnd)
+    {
+        if (!readNextRecord(record, bamFileIn, cramFileIn))
+        {
+            atContigEnd = true;  // end of file, or of the contig for CRAM
+            break;
+        }
+        ++stats.recordsDecoded;
+        if (record.rID != rID)
+        {
+            atContigEnd = true;  // done, no more records on this contig
+            break;
+        }
+        if (endPosition(record) <= cacheBegin)
+            continue;  // skip record too far to the left
+        if (record.beginPos >= endPos)
+        {
+            lookahead = record;
+            hasLookahead = true;
+            break;  // done, keep record for next window
+        }
+        records.push_back(record);
+    }
+
+    cacheEnd = endPos;
+}
+
+void RecordCacheImpl::evict(int beginPos)
+{
+    records.erase(std::remove_if(records.begin(), records.end(),
+                                 [beginPos](seqan::BamAlignmentRecord const & record) {
+                                     return endPosition(record) <= beginPos;
+                                 }),
+                  records.end());
+    cacheBegin = std::max(cacheBegin, beginPos);
+}
+
+// ---------------------------------------------------------------------------
+// Class RecordCache
+// ---------------------------------------------------------------------------
+
+RecordCache::RecordCache(seqan::BamFileIn & bamFileIn,
+                         seqan::BamIndex<seqan::Bai> const & baiIndex,
+                         CramFileIn * cramFileIn,
+                         BamRealignerOptions const & options) :
+        impl(new RecordCacheImpl(bamFileIn, baiIndex, cramFileIn, options))
+{}
+
+RecordCache::~RecordCache()
+{}
+
+void RecordCache::fetch(std::vector<seqan::BamAlignmentRecord> & records, RealignmentWindow const & window)
+{
+    impl->fetch(records, window);
+}
+
+RecordCacheStats const & RecordCache::stats() const
+{
+    return impl->stats;
+}
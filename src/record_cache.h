@@ -0,0 +1,105 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef RECORD_CACHE_H_
+#define RECORD_CACHE_H_
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include <seqan/bam_io.h>
+
+class BamRealignerOptions;
+class CramFileIn;
+class RealignmentWindow;
+class RecordCacheImpl;
+
+// ---------------------------------------------------------------------------
+// Class RecordCacheStats
+// ---------------------------------------------------------------------------
+
+// Counters of a RecordCache.
+
+class RecordCacheStats
+{
+public:
+    // Number of windows served from memory only.
+    uint64_t hits;
+    // Number of windows served from memory and by continuing to read sequentially.
+    uint64_t partialHits;
+    // Number of windows that required jumping in the BAM file.
+    uint64_t misses;
+    // Number of records decoded from the BAM file.
+    uint64_t recordsDecoded;
+    // Number of records handed out for windows.
+    uint64_t recordsServed;
+
+    RecordCacheStats() : hits(0), partialHits(0), misses(0), recordsDecoded(0), recordsServed(0)
+    {}
+
+    void print(std::ostream & out) const;
+};
+
+// ---------------------------------------------------------------------------
+// Class RecordCache
+// ---------------------------------------------------------------------------
+
+// Sliding cache of decoded BAM records around the current sweep position.  When the windows are fetched in sorted
+// order, overlapping and neighbouring windows are served from memory or by continuing to read where the previous
+// window stopped, instead of jumping with the BAI index and decoding the same BGZF blocks again.  Records left of the
+// current window are evicted.
+//
+// If cramFileIn is not nullptr, the records are read from it with its CRAI index instead, and bamFileIn (not opened)
+// and baiIndex are not used.
+
+class RecordCache
+{
+public:
+    RecordCache(seqan::BamFileIn & bamFileIn,
+                seqan::BamIndex<seqan::Bai> const & baiIndex,
+                CramFileIn * cramFileIn,
+                BamRealignerOptions const & options);
+    ~RecordCache();  // for pimpl
+
+    // Write the records to realign in window to records.
+    void fetch(std::vector<seqan::BamAlignmentRecord> & records, RealignmentWindow const & window);
+
+    RecordCacheStats const & stats() const;
+
+private:
+    std::unique_ptr<RecordCacheImpl> impl;
+};
+
+#endif  // #ifndef RECORD_CACHE_H_
@@ -0,0 +1,231 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "reference_provider.h"
+
+#include <algorithm>
+#include <iostream>
+#include <list>
+#include <map>
+#include <utility>
+
+#include "bam_realigner_options.h"
+
+namespace {  // anonymous namespace
+
+// Length of the contig chunks in the LRU cache.
+unsigned const CHUNK_LENGTH = 64 * 1024;
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class ReferenceProviderImpl
+// ---------------------------------------------------------------------------
+
+class ReferenceProviderImpl
+{
+public:
+    ReferenceProviderImpl(seqan::FaiIndex & faiIndex, BamRealignerOptions const & options) :
+            faiIndex(faiIndex), options(options), chunkHits(0), chunkMisses(0), prefetchHits(0)
+    {}
+
+    void preload();
+    void getRegion(seqan::Dna5String & seq, seqan::GenomicRegion const & region);
+
+    // The FAI index to load from.
+    seqan::FaiIndex & faiIndex;
+
+    // Options.
+    BamRealignerOptions const & options;
+
+    // All contigs, by FAI sequence ID, if preloaded.
+    std::shared_ptr<seqan::StringSet<seqan::Dna5String> const> preloaded;
+    // Sequence of prefetchedRegion, handed over by setPrefetched().
+    seqan::GenomicRegion prefetchedRegion;
+    seqan::Dna5String prefetched;
+
+    // Counters.
+    uint64_t chunkHits;
+    uint64_t chunkMisses;
+    uint64_t prefetchHits;
+
+private:
+
+    // Key of a chunk: FAI sequence ID and chunk number.
+    typedef std::pair<unsigned, unsigned> TChunkKey;
+
+    // Return FAI sequence ID for the given name.
+    unsigned getFaiId(seqan::CharString const & seqName);
+    // Return the chunk with the given key, loading it if necessary.
+    seqan::Dna5String const & getChunk(TChunkKey const & key);
+
+    // Mapping from sequence name to FAI sequence ID.
+    std::map<seqan::CharString, unsigned> faiIds;
+
+    // The cached chunks, most recently used first, and index into the list.
+    std::list<std::pair<TChunkKey, seqan::Dna5String>> chunks;
+    std::map<TChunkKey, std::list<std::pair<TChunkKey, seqan::Dna5String>>::iterator> chunkIndex;
+};
+
+void ReferenceProviderImpl::preload()
+{
+    std::shared_ptr<seqan::StringSet<seqan::Dna5String>> seqs(new seqan::StringSet<seqan::Dna5String>);
+    resize(*seqs, numSeqs(faiIndex));
+    for (unsigned faiId = 0; faiId < numSeqs(faiIndex); ++faiId)
+        readSequence((*seqs)[faiId], faiIndex, faiId);
+    preloaded = seqs;
+}
+
+unsigned ReferenceProviderImpl::getFaiId(seqan::CharString const & seqName)
+{
+    auto it = faiIds.find(seqName);
+    if (it != faiIds.end())
+        return it->second;
+
+    unsigned faiId = 0;
+    if (!getIdByName(faiId, faiIndex, seqName))
+    {
+        std::string msg = std::string("Unknown reference ")  + toCString(seqName);
+        throw seqan::IOError(msg.c_str());
+    }
+    faiIds[seqName] = faiId;
+    return faiId;
+}
+
+seqan::Dna5String const & ReferenceProviderImpl::getChunk(TChunkKey const & key)
+{
+    auto it = chunkIndex.find(key);
+    if (it != chunkIndex.end())
+    {
+        ++chunkHits;
+        chunks.splice(chunks.begin(), chunks, it->second);  // move to front
+        return chunks.front().second;
+    }
+
+    ++chunkMisses;
+    unsigned seqLength = sequenceLength(faiIndex, key.first);
+    unsigned beginPos = key.second * CHUNK_LENGTH;
+    unsigned endPos = std::min(seqLength, beginPos + CHUNK_LENGTH);
+    chunks.push_front(std::make_pair(key, seqan::Dna5String()));
+    readRegion(chunks.front().second, faiIndex, key.first, beginPos, endPos);
+    chunkIndex[key] = chunks.begin();
+
+    // Evict least recently used chunk.
+    if (chunks.size() > (unsigned)options.referenceCacheChunks)
+    {
+        chunkIndex.erase(chunks.back().first);
+        chunks.pop_back();
+    }
+
+    return chunks.front().second;
+}
+
+void ReferenceProviderImpl::getRegion(seqan::Dna5String & seq, seqan::GenomicRegion const & region)
+{
+    unsigned faiId = getFaiId(region.seqName);
+    unsigned seqLength = sequenceLength(faiIndex, faiId);
+    unsigned beginPos = std::min(region.beginPos, seqLength);
+    unsigned endPos = std::min(region.endPos, seqLength);
+
+    clear(seq);
+    unsigned prefetchedBegin = std::min(prefetchedRegion.beginPos, seqLength);
+    if (prefetchedRegion.seqName == region.seqName && beginPos >= prefetchedBegin &&
+        endPos <= prefetchedBegin + length(prefetched))
+    {
+        ++prefetchHits;
+        seq = infix(prefetched, beginPos - prefetchedBegin, endPos - prefetchedBegin);
+        return;
+    }
+    if (preloaded)
+    {
+        seq = infix((*preloaded)[faiId], beginPos, endPos);
+        return;
+    }
+
+    reserve(seq, endPos - beginPos);
+    for (unsigned chunkNo = beginPos / CHUNK_LENGTH; chunkNo * CHUNK_LENGTH < endPos; ++chunkNo)
+    {
+        seqan::Dna5String const & chunk = getChunk(TChunkKey(faiId, chunkNo));
+        unsigned chunkBegin = chunkNo * CHUNK_LENGTH;
+        unsigned infixBegin = std::max(beginPos, chunkBegin) - chunkBegin;
+        unsigned infixEnd = std::min(endPos, chunkBegin + (unsigned)length(chunk)) - chunkBegin;
+        append(seq, infix(chunk, infixBegin, infixEnd));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Class ReferenceProvider
+// ---------------------------------------------------------------------------
+
+ReferenceProvider::ReferenceProvider(seqan::FaiIndex & faiIndex, BamRealignerOptions const & options) :
+        impl(new ReferenceProviderImpl(faiIndex, options))
+{}
+
+ReferenceProvider::ReferenceProvider(seqan::FaiIndex & faiIndex,
+                                     ReferenceProvider const & other,
+                                     BamRealignerOptions const & options) :
+        impl(new ReferenceProviderImpl(faiIndex, options))
+{
+    impl->preloaded = other.impl->preloaded;
+}
+
+ReferenceProvider::~ReferenceProvider()
+{}
+
+void ReferenceProvider::preload()
+{
+    impl->preload();
+}
+
+void ReferenceProvider::getRegion(seqan::Dna5String & seq, seqan::GenomicRegion const & region)
+{
+    impl->getRegion(seq, region);
+}
+
+void ReferenceProvider::setPrefetched(seqan::GenomicRegion const & region, seqan::Dna5String & seq)
+{
+    impl->prefetchedRegion = region;
+    swap(impl->prefetched, seq);
+}
+
+void ReferenceProvider::printStats(std::ostream & out) const
+{
+    if (impl->prefetchHits)
+        out << "    Reference: " << impl->prefetchHits << " windows served from prefetched sequence\n";
+    if (impl->preloaded)
+        out << "    Reference: preloaded " << length(*impl->preloaded) << " contigs\n";
+    else
+        out << "    Reference cache: " << impl->chunkHits << " chunk hits, " << impl->chunkMisses
+            << " chunk misses\n";
+}
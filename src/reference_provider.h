@@ -0,0 +1,80 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef REFERENCE_PROVIDER_H_
+#define REFERENCE_PROVIDER_H_
+
+#include <iosfwd>
+#include <memory>
+
+#include <seqan/seq_io.h>
+
+class BamRealignerOptions;
+class ReferenceProviderImpl;
+
+// ---------------------------------------------------------------------------
+// Class ReferenceProvider
+// ---------------------------------------------------------------------------
+
+// Provides reference sequence windows from a FAI-indexed FASTA file.  Without preloading, the windows are assembled
+// from fixed-size contig chunks that are kept in an LRU cache, so neighbouring windows do not seek and parse the
+// FASTA file again.  With preloading, all contigs are read into memory once and windows are copied from there.
+
+class ReferenceProvider
+{
+public:
+    ReferenceProvider(seqan::FaiIndex & faiIndex, BamRealignerOptions const & options);
+    // Share the preloaded sequences of other, if any, instead of loading them again.
+    ReferenceProvider(seqan::FaiIndex & faiIndex, ReferenceProvider const & other, BamRealignerOptions const & options);
+    ~ReferenceProvider();  // for pimpl
+
+    // Read all contigs into memory.
+    void preload();
+
+    // Write the sequence of region (seqName is used for identifying the contig) to seq.  The region is clipped to
+    // the contig length.
+    void getRegion(seqan::Dna5String & seq, seqan::GenomicRegion const & region);
+
+    // Serve getRegion() from seq, the sequence of region as loaded by getRegion() of another provider, for all
+    // regions within region until the next call.  seq is swapped in.
+    void setPrefetched(seqan::GenomicRegion const & region, seqan::Dna5String & seq);
+
+    // Print chunk cache counters.
+    void printStats(std::ostream & out) const;
+
+private:
+    std::unique_ptr<ReferenceProviderImpl> impl;
+};
+
+#endif  // #ifndef REFERENCE_PROVIDER_H_
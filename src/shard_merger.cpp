@@ -0,0 +1,144 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "shard_merger.h"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <seqan/basic.h>
+#include <seqan/stream.h>
+
+#include "bam_realigner_options.h"
+#include "bgzf_io.h"
+
+namespace {  // anonymous namespace
+
+// Compression level for the records in the block of the header, only a small part of the output.
+int const COMPRESSION_LEVEL = 6;
+
+inline uint32_t loadUInt32(char const * src)
+{
+    uint32_t result = 0;
+    for (int i = 3; i >= 0; --i)
+        result = (result << 8) | (unsigned char)src[i];
+    return result;
+}
+
+// Returns the length of the BAM header at the beginning of data, 0 if data does not contain the whole header yet.
+// refsBegin is set to the offset of the reference sequences in the header.
+size_t bamHeaderLength(size_t & refsBegin, std::vector<char> const & data)
+{
+    if (data.size() >= 4 && memcmp(data.data(), "BAM\1", 4) != 0)
+        throw seqan::IOError("Not a BAM file.");
+    if (data.size() < 8)
+        return 0;
+    refsBegin = 8 + loadUInt32(&data[4]);
+    if (data.size() < refsBegin + 4)
+        return 0;
+
+    // Each reference sequence is stored as name length, name and sequence length.
+    size_t pos = refsBegin + 4;
+    for (uint32_t i = 0, numRefs = loadUInt32(&data[refsBegin]); i < numRefs; ++i)
+    {
+        if (data.size() < pos + 4)
+            return 0;
+        pos += 8 + loadUInt32(&data[pos]);
+    }
+    return (data.size() < pos) ? 0 : pos;
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function mergeShards()
+// ---------------------------------------------------------------------------
+
+void mergeShards(MergeOptions const & options)
+{
+    if (options.verbosity >= 1)
+        std::cerr << "Merging " << options.inAlignmentPaths.size() << " shards into " << options.outAlignmentPath
+                  << " ...";
+
+    BgzfWriter writer(options.outAlignmentPath, 1, COMPRESSION_LEVEL);
+    // The reference sequences of the first shard.
+    std::vector<char> refs;
+    std::vector<char> block, data, blockData;
+    for (auto const & path : options.inAlignmentPaths)
+    {
+        if (options.verbosity >= 2)
+            std::cerr << "\n    " << path;
+
+        // Decompress the blocks of the header.
+        BgzfBlockReader reader(path);
+        data.clear();
+        size_t refsBegin = 0, headerLength = 0;
+        while (headerLength == 0)
+        {
+            if (!reader.readBlock(block))
+            {
+                std::string msg = "Truncated BAM header in " + path + ".";
+                throw seqan::IOError(msg.c_str());
+            }
+            decompressBgzfBlock(blockData, block);
+            data.insert(data.end(), blockData.begin(), blockData.end());
+            headerLength = bamHeaderLength(refsBegin, data);
+        }
+
+        if (refs.empty())
+        {
+            refs.assign(data.begin() + refsBegin, data.begin() + headerLength);
+            writer.write(data.data(), headerLength);
+        }
+        else if (refs.size() != headerLength - refsBegin ||
+                 !std::equal(refs.begin(), refs.end(), data.begin() + refsBegin))
+        {
+            std::string msg = "Reference sequences of " + path + " differ from the first shard.";
+            throw seqan::IOError(msg.c_str());
+        }
+
+        // Recompress the records in the last block of the header and copy all following blocks.
+        writer.write(data.data() + headerLength, data.size() - headerLength);
+        writer.flush();
+        while (reader.readBlock(block))
+            if (bgzfBlockDataSize(block) != 0)  // skip end-of-file blocks
+                writer.writeBlocks(block.data(), block.size());
+    }
+    writer.close();
+
+    if (options.verbosity >= 1)
+        std::cerr << " OK\n";
+}
@@ -0,0 +1,162 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "shard_planner.h"
+
+#include <algorithm>
+#include <map>
+
+#include "interval_planner.h"
+
+namespace {  // anonymous namespace
+
+// The pseudo bin of the BAI index, its second chunk holds the number of mapped and unmapped reads of a reference.
+uint32_t const BAI_PSEUDO_BIN = 37450;
+// First bin and bin size (as shift) of the levels of the BAI binning scheme.
+uint32_t const BAI_LEVEL_FIRST_BIN[] = { 0, 1, 9, 73, 585, 4681 };
+int const BAI_LEVEL_SHIFT[] = { 29, 26, 23, 20, 17, 14 };
+unsigned const BAI_NUM_LEVELS = 6;
+
+// Assumed compression ratio for chunks within one BGZF block, whose compressed size is unknown.
+double const ASSUMED_COMPRESSION_RATIO = 3.0;
+// Weight of every window on top of its estimated reads, so windows are spread even without any reads.
+double const MIN_WINDOW_WEIGHT = 1.0;
+
+// Compressed bytes of the chunks of a bin.
+double chunkBytes(seqan::BaiBamIndexBinData_ const & binData)
+{
+    double result = 0;
+    for (unsigned i = 0; i < length(binData.chunkBegEnds); ++i)
+    {
+        auto const & chunk = binData.chunkBegEnds[i];
+        uint64_t beginBlock = chunk.i1 >> 16, endBlock = chunk.i2 >> 16;
+        if (endBlock > beginBlock)
+            result += endBlock - beginBlock;
+        else
+            result += ((chunk.i2 & 0xffff) - (chunk.i1 & 0xffff)) / ASSUMED_COMPRESSION_RATIO;
+    }
+    return result;
+}
+
+// Estimated number of reads in each bin of a reference.  The mapped reads of the reference (from the pseudo bin) are
+// distributed to the bins in proportion to the compressed bytes of their chunks, without pseudo bin the bytes are
+// used as they are.
+std::map<uint32_t, double> estimateBinReads(std::map<uint32_t, seqan::BaiBamIndexBinData_> const & bins)
+{
+    std::map<uint32_t, double> result;
+    double totalBytes = 0;
+    double numMapped = -1;
+    for (auto const & bin : bins)
+        if (bin.first == BAI_PSEUDO_BIN)
+        {
+            if (length(bin.second.chunkBegEnds) >= 2)
+                numMapped = bin.second.chunkBegEnds[1].i1;
+        }
+        else
+        {
+            totalBytes += (result[bin.first] = chunkBytes(bin.second));
+        }
+
+    if (numMapped >= 0 && totalBytes > 0)
+        for (auto & bin : result)
+            bin.second *= numMapped / totalBytes;
+    return result;
+}
+
+// Estimated number of reads in window: the reads of all bins overlapping with it, scaled by the overlapping fraction
+// of each bin.
+double estimateWindowReads(RealignmentWindow const & window, std::map<uint32_t, double> const & binReads)
+{
+    int64_t beginPos = window.region.beginPos, endPos = std::max(window.region.endPos, window.region.beginPos + 1);
+    double result = 0;
+    for (unsigned level = 0; level < BAI_NUM_LEVELS; ++level)
+    {
+        int shift = BAI_LEVEL_SHIFT[level];
+        for (int64_t i = beginPos >> shift; i <= (endPos - 1) >> shift; ++i)
+        {
+            auto it = binReads.find(BAI_LEVEL_FIRST_BIN[level] + i);
+            if (it == binReads.end())
+                continue;
+            int64_t overlap = std::min(endPos, (i + 1) << shift) - std::max(beginPos, i << shift);
+            result += it->second * overlap / (double)(1ll << shift);
+        }
+    }
+    return result;
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function selectShard()
+// ---------------------------------------------------------------------------
+
+double selectShard(std::vector<RealignmentWindow> & windows,
+                   seqan::BamIndex<seqan::Bai> const & baiIndex,
+                   unsigned shardIndex,
+                   unsigned numShards)
+{
+    // Estimate the reads of each window, the bin estimates are computed once per reference.
+    std::vector<double> weights;
+    std::map<uint32_t, double> binReads;
+    int rID = -1;
+    double totalWeight = 0;
+    for (auto const & window : windows)
+    {
+        if (window.region.rID != rID)
+        {
+            rID = window.region.rID;
+            binReads.clear();
+            if (rID >= 0 && (unsigned)rID < length(baiIndex._binIndices))
+                binReads = estimateBinReads(baiIndex._binIndices[rID]);
+        }
+        weights.push_back(MIN_WINDOW_WEIGHT + estimateWindowReads(window, binReads));
+        totalWeight += weights.back();
+    }
+
+    // Assign each window to the shard its weight's center falls into, this keeps the shards consecutive.
+    std::vector<RealignmentWindow> selected;
+    double prefix = 0, shardWeight = 0;
+    for (unsigned i = 0; i < windows.size(); ++i)
+    {
+        unsigned shard = std::min(numShards - 1, (unsigned)((prefix + weights[i] / 2) * numShards / totalWeight));
+        prefix += weights[i];
+        if (shard != shardIndex)
+            continue;
+        selected.push_back(windows[i]);
+        shardWeight += weights[i] - MIN_WINDOW_WEIGHT;
+    }
+
+    windows.swap(selected);
+    return shardWeight;
+}
@@ -0,0 +1,59 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef SHARD_PLANNER_H_
+#define SHARD_PLANNER_H_
+
+#include <vector>
+
+#include <seqan/bam_io.h>
+
+class RealignmentWindow;
+
+// ---------------------------------------------------------------------------
+// Function selectShard()
+// ---------------------------------------------------------------------------
+
+// Keep only the windows of shard shardIndex (0-based) out of numShards.  The windows (sorted as by planWindows()) are
+// cut into consecutive shards of about the same estimated number of reads, estimated from the per-bin data of the
+// BAI index.  Since the shards are consecutive and each record is realigned in the first window it overlaps with,
+// the shard BAM files can be concatenated into a sorted BAM file.  Returns the estimated number of reads of the
+// shard.
+
+double selectShard(std::vector<RealignmentWindow> & windows,
+                   seqan::BamIndex<seqan::Bai> const & baiIndex,
+                   unsigned shardIndex,
+                   unsigned numShards);
+
+#endif  // #ifndef SHARD_PLANNER_H_
@@ -0,0 +1,292 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "step_stats.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <utility>
+
+#include <seqan/basic.h>
+
+namespace {  // anonymous namespace
+
+// The percentiles written to the summary rows of the report.
+unsigned const PERCENTILES[] = { 50, 90, 99 };
+
+// Whether StageTimer samples the peak resident set size, see setStageRssSampling().
+bool stageRssSampling = false;
+
+// Returns the CPU time used by the calling thread in seconds.
+inline double threadCpuTime()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif  // #ifdef CLOCK_THREAD_CPUTIME_ID
+    return (double)std::clock() / CLOCKS_PER_SEC;  // process time as fallback
+}
+
+// Returns the sum of the wall clock times of all stages of stats.
+inline double totalWallTime(StepStats const & stats)
+{
+    double sum = 0;
+    for (auto x : stats.wallTime)
+        sum += x;
+    return sum;
+}
+
+// Returns the value at percentile p of the sorted values (nearest rank).
+inline double percentile(std::vector<double> const & sorted, unsigned p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = (p * sorted.size() + 99) / 100;
+    return sorted[std::max((size_t)1, rank) - 1];
+}
+
+// A numeric column of the report.
+typedef std::pair<std::string, std::function<double(StepStats const &)>> TColumn;
+
+std::vector<TColumn> reportColumns()
+{
+    std::vector<TColumn> columns;
+    columns.push_back(TColumn("records", [](StepStats const & s) { return (double)s.numRecords; }));
+    columns.push_back(TColumn("realigned", [](StepStats const & s) { return (double)s.numRealigned; }));
+    columns.push_back(TColumn("alignment_bytes", [](StepStats const & s) { return (double)s.alignmentBytes; }));
+    columns.push_back(TColumn("reference_bytes", [](StepStats const & s) { return (double)s.referenceBytes; }));
+    columns.push_back(TColumn("span", [](StepStats const & s) { return (double)s.span; }));
+    columns.push_back(TColumn("gaps", [](StepStats const & s) { return (double)s.numGaps; }));
+    columns.push_back(TColumn("band", [](StepStats const & s) { return (double)s.band; }));
+    columns.push_back(TColumn("peak_store_bytes", [](StepStats const & s) { return (double)s.peakStoreBytes; }));
+    for (int stage = 0; stage < NUM_STAGES; ++stage)
+    {
+        std::string name = stageName((StepStage)stage);
+        columns.push_back(TColumn(name + "_wall", [stage](StepStats const & s) { return s.wallTime[stage]; }));
+        columns.push_back(TColumn(name + "_cpu", [stage](StepStats const & s) { return s.cpuTime[stage]; }));
+        columns.push_back(TColumn(name + "_rss_kb",
+                                  [stage](StepStats const & s) { return (double)s.peakRss[stage]; }));
+    }
+    columns.push_back(TColumn("total_wall", totalWallTime));
+    columns.push_back(TColumn("total_cpu", [](StepStats const & s) {
+                double sum = 0;
+                for (auto x : s.cpuTime)
+                    sum += x;
+                return sum;
+            }));
+    return columns;
+}
+
+}  // anonymous namespace
+
+char const * stageName(StepStage stage)
+{
+    switch (stage)
+    {
+        case STAGE_LOAD_ALIGNMENTS:
+            return "load_alignments";
+        case STAGE_LOAD_REFERENCE:
+            return "load_reference";
+        case STAGE_BUILD_STORE:
+            return "build_store";
+        case STAGE_REALIGN:
+            return "realign";
+        case STAGE_UPDATE_RECORDS:
+            return "update_records";
+        case STAGE_WRITE:
+            return "write";
+        default:
+            return "unknown";
+    }
+}
+
+uint64_t bamRecordBytes(seqan::BamAlignmentRecord const & record)
+{
+    // Fixed-size fields, read name with terminating zero, CIGAR, 4 bit bases, qualities and tags.
+    return 36 + length(record.qName) + 1 + 4 * length(record.cigar) + (length(record.seq) + 1) / 2 +
+            length(record.qual) + length(record.tags);
+}
+
+void resetPeakRss()
+{
+    std::ofstream out("/proc/self/clear_refs");
+    out << "5";
+}
+
+uint64_t peakRssKb()
+{
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while (std::getline(in, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::stoull(line.substr(6));
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;  // bytes on OS X
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+void setStageRssSampling(bool enabled)
+{
+    stageRssSampling = enabled;
+}
+
+// ---------------------------------------------------------------------------
+// Class StageTimer
+// ---------------------------------------------------------------------------
+
+StageTimer::StageTimer(StepStats & stats, StepStage stage) :
+        stats(stats), stage(stage), wallBegin(seqan::sysTime()), cpuBegin(threadCpuTime())
+{
+    if (stageRssSampling)
+        resetPeakRss();
+}
+
+StageTimer::~StageTimer()
+{
+    stats.wallTime[stage] += seqan::sysTime() - wallBegin;
+    stats.cpuTime[stage] += threadCpuTime() - cpuBegin;
+    if (stageRssSampling)
+        stats.peakRss[stage] = std::max(stats.peakRss[stage], peakRssKb());
+}
+
+// ---------------------------------------------------------------------------
+// Class StatsReport
+// ---------------------------------------------------------------------------
+
+void StatsReport::add(StepStats const & stats, std::string const & skipReason)
+{
+    rows.push_back(stats);
+    skipReasons.push_back(skipReason.empty() ? "-" : skipReason);
+}
+
+// The report has a "window" row for each window with the region and skip reason, followed by "sum", "mean", "pN" and
+// "max" rows over all windows with the same numeric columns.  The header line starts with '#'.
+
+void StatsReport::write(std::string const & path) const
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::out);
+    if (!out.good())
+    {
+        std::string msg = std::string("Could not open stats output file ") + path;
+        throw seqan::IOError(msg.c_str());
+    }
+
+    std::vector<TColumn> columns = reportColumns();
+    out << "#type\tregion\tskip_reason";
+    for (auto const & column : columns)
+        out << '\t' << column.first;
+    out << '\n';
+
+    for (unsigned i = 0; i < rows.size(); ++i)
+    {
+        out << "window\t" << rows[i].region << '\t' << skipReasons[i];
+        for (auto const & column : columns)
+            out << '\t' << column.second(rows[i]);
+        out << '\n';
+    }
+
+    // Summary rows, computed column by column.
+    std::vector<std::string> labels = { "sum", "mean" };
+    for (auto p : PERCENTILES)
+        labels.push_back("p" + std::to_string(p));
+    labels.push_back("max");
+    std::vector<std::vector<double>> summary(labels.size(), std::vector<double>(columns.size(), 0));
+    for (unsigned j = 0; j < columns.size(); ++j)
+    {
+        std::vector<double> values;
+        for (auto const & row : rows)
+            values.push_back(columns[j].second(row));
+        std::sort(values.begin(), values.end());
+
+        unsigned k = 0;
+        for (auto x : values)
+            summary[k][j] += x;
+        ++k;
+        summary[k++][j] = values.empty() ? 0 : summary[0][j] / values.size();
+        for (auto p : PERCENTILES)
+            summary[k++][j] = percentile(values, p);
+        summary[k++][j] = values.empty() ? 0 : values.back();
+    }
+    for (unsigned k = 0; k < labels.size(); ++k)
+    {
+        out << labels[k] << "\t*\t*";
+        for (auto x : summary[k])
+            out << '\t' << x;
+        out << '\n';
+    }
+
+    if (!out.good())
+    {
+        std::string msg = std::string("Could not write stats output file ") + path;
+        throw seqan::IOError(msg.c_str());
+    }
+}
+
+// One row per skipped window in output order, with the columns needed for finding the window again and for telling
+// a budget that is too tight from a pathological window.
+
+void StatsReport::writeSkipped(std::string const & path) const
+{
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::out);
+    if (!out.good())
+    {
+        std::string msg = std::string("Could not open skipped windows output file ") + path;
+        throw seqan::IOError(msg.c_str());
+    }
+
+    out << "#region\treason\trecords\trealigned\tspan\twall\n";
+    for (unsigned i = 0; i < rows.size(); ++i)
+    {
+        if (skipReasons[i] == "-" || skipReasons[i] == "prescreen")
+            continue;
+        out << rows[i].region << '\t' << skipReasons[i] << '\t' << rows[i].numRecords << '\t'
+            << rows[i].numRealigned << '\t' << rows[i].span << '\t' << totalWallTime(rows[i]) << '\n';
+    }
+
+    if (!out.good())
+    {
+        std::string msg = std::string("Could not write skipped windows output file ") + path;
+        throw seqan::IOError(msg.c_str());
+    }
+}
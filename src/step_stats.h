@@ -0,0 +1,160 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef STEP_STATS_H_
+#define STEP_STATS_H_
+
+#include <string>
+#include <vector>
+
+#include <seqan/bam_io.h>
+
+// ---------------------------------------------------------------------------
+// Enum StepStage
+// ---------------------------------------------------------------------------
+
+// The stages of processing one window, in order.
+
+enum StepStage
+{
+    STAGE_LOAD_ALIGNMENTS,
+    STAGE_LOAD_REFERENCE,
+    STAGE_BUILD_STORE,
+    STAGE_REALIGN,
+    STAGE_UPDATE_RECORDS,
+    STAGE_WRITE,
+    NUM_STAGES
+};
+
+// Returns the name of stage as used in the stats report.
+char const * stageName(StepStage stage);
+
+// ---------------------------------------------------------------------------
+// Class StepStats
+// ---------------------------------------------------------------------------
+
+// Counters and timings of processing one window.
+
+class StepStats
+{
+public:
+    // The window region as text.
+    std::string region;
+    // Number of records in the window and number of records realigned (after pre-screen and downsampling).
+    uint64_t numRecords;
+    uint64_t numRealigned;
+    // Estimated size of the records in BAM encoding and number of reference characters loaded.
+    uint64_t alignmentBytes;
+    uint64_t referenceBytes;
+    // Length of the realigned region, extended by the records.
+    uint64_t span;
+    // Number of gap columns in the MSA after realignment.
+    uint64_t numGaps;
+    // Band used for realignment, after widening.
+    uint64_t band;
+    // Largest estimated memory use of the FragmentStore.
+    uint64_t peakStoreBytes;
+    // Wall clock and CPU time of the processing thread in each stage, in seconds.
+    double wallTime[NUM_STAGES];
+    double cpuTime[NUM_STAGES];
+    // Peak resident set size of the process in each stage in KiB, 0 unless enabled with setStageRssSampling().
+    uint64_t peakRss[NUM_STAGES];
+
+    StepStats() : numRecords(0), numRealigned(0), alignmentBytes(0), referenceBytes(0), span(0), numGaps(0),
+                  band(0), peakStoreBytes(0), wallTime(), cpuTime(), peakRss()
+    {}
+};
+
+// Returns the estimated size of record in BAM encoding.
+uint64_t bamRecordBytes(seqan::BamAlignmentRecord const & record);
+
+// Reset the peak resident set size of the process, only supported on Linux.
+void resetPeakRss();
+
+// Returns the peak resident set size in KiB since the last resetPeakRss(), or of the whole process if resetting is
+// not supported.
+uint64_t peakRssKb();
+
+// Enable or disable sampling StepStats::peakRss in StageTimer, disabled by default.  The peak is that of the whole
+// process and is reset at the beginning of each stage, so the values are only meaningful with a single thread and
+// without pipelining, and the peak of the whole process has to be taken as the maximum of the stage peaks and
+// peakRssKb().  Must not be called while StageTimer objects exist.
+void setStageRssSampling(bool enabled);
+
+// ---------------------------------------------------------------------------
+// Class StageTimer
+// ---------------------------------------------------------------------------
+
+// Adds the wall clock and CPU time of the calling thread from construction to destruction to a stage of stats and, if
+// enabled with setStageRssSampling(), raises the stage's peak resident set size to the one in between.
+
+class StageTimer
+{
+public:
+    StageTimer(StepStats & stats, StepStage stage);
+    ~StageTimer();
+
+private:
+    StepStats & stats;
+    StepStage stage;
+    double wallBegin;
+    double cpuBegin;
+};
+
+// ---------------------------------------------------------------------------
+// Class StatsReport
+// ---------------------------------------------------------------------------
+
+// Collects the StepStats of all windows and writes them as a TSV file with one row per window, followed by rows with
+// the sum, mean and percentiles of each column.
+
+class StatsReport
+{
+public:
+    // Add the stats of the next window, skipReason is empty if the window was realigned.
+    void add(StepStats const & stats, std::string const & skipReason);
+
+    // Write the report to the file at path, throws seqan::IOError on errors.
+    void write(std::string const & path) const;
+
+    // Write the windows that were passed through for exceeding a limit (all skip reasons but the pre-screen) to the
+    // file at path, throws seqan::IOError on errors.
+    void writeSkipped(std::string const & path) const;
+
+private:
+    std::vector<StepStats> rows;
+    std::vector<std::string> skipReasons;
+};
+
+#endif  // #ifndef STEP_STATS_H_
@@ -0,0 +1,263 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "streaming_realigner.h"
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <seqan/bam_io.h>
+#include <seqan/seq_io.h>
+
+#include "bam_realigner_options.h"
+#include "cram_io.h"
+#include "interval_planner.h"
+#include "mate_fixer.h"
+#include "msa_dump.h"
+#include "realigner_step.h"
+#include "step_stats.h"
+
+namespace {  // anonymous namespace
+
+// Genomic position (rID, pos) for comparisons, unaligned records with rID -1 are sorted to the end.
+typedef std::pair<unsigned, int> TGenomicPos;
+
+inline TGenomicPos genomicPos(int rID, int pos)
+{
+    return TGenomicPos((unsigned)rID, pos);
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Class StreamingRealignerImpl
+// ---------------------------------------------------------------------------
+
+class StreamingRealignerImpl
+{
+public:
+    StreamingRealignerImpl(MateFixer & output,
+                           seqan::VirtualStream<char, seqan::Output> & msasTxtOut,
+                           MsaDumpWriter * msasBinOut,
+                           seqan::BamFileIn & bamFileIn,
+                           CramFileIn * cramFileIn,
+                           ReferenceProvider & referenceProvider,
+                           std::vector<RealignmentWindow> const & windows,
+                           StatsReport & statsReport,
+                           BamRealignerOptions const & options) :
+            output(output), msasTxtOut(msasTxtOut), msasBinOut(msasBinOut), bamFileIn(bamFileIn),
+            cramFileIn(cramFileIn), referenceProvider(referenceProvider), statsReport(statsReport), options(options),
+            step(referenceProvider, options), windows(windows), currentWindow(0), windowMinBeginPos(0), numRead(0),
+            numBuffered(0), numRealigned(0)
+    {}
+
+    void run();
+
+private:
+
+    // Sort key of the records in the output buffer, ties are broken by the order of insertion.
+    typedef std::tuple<unsigned, int, uint64_t> TOutputKey;
+
+    // Returns whether record overlaps with window.
+    bool overlaps(seqan::BamAlignmentRecord const & record, RealignmentWindow const & window) const
+    {
+        int endPos = record.beginPos + getAlignmentLengthInRef(record);
+        return (record.rID == window.region.rID && endPos > (int)window.region.beginPos &&
+                record.beginPos < (int)window.region.endPos);
+    }
+
+    // Realign the records of the current window and put them into the output buffer.
+    void closeWindow();
+    // Put record into the output buffer.
+    void bufferRecord(seqan::BamAlignmentRecord & record);
+    // Write out all buffered records before the given position.
+    void flushRecords(TGenomicPos watermark);
+
+    // Output of the records (updating the mates of moved records) and the MSAs.
+    MateFixer & output;
+    seqan::VirtualStream<char, seqan::Output> & msasTxtOut;
+    MsaDumpWriter * msasBinOut;
+    // Input BAM file and reference.  Records are read from cramFileIn instead if it is not nullptr.
+    seqan::BamFileIn & bamFileIn;
+    CramFileIn * cramFileIn;
+    ReferenceProvider & referenceProvider;
+    // Collects the per-window stats.
+    StatsReport & statsReport;
+
+    // Options.
+    BamRealignerOptions const & options;
+
+    // Realigns the windows, reused for all of them.
+    RealignerStep step;
+
+    // The windows to realign, sorted by position, and the index of the first one that is not closed yet.
+    std::vector<RealignmentWindow> const & windows;
+    unsigned currentWindow;
+    // The records overlapping with the current window and their smallest begin position.
+    std::vector<seqan::BamAlignmentRecord> windowRecords;
+    int windowMinBeginPos;
+
+    // Records waiting to be written out in coordinate order.
+    std::map<TOutputKey, seqan::BamAlignmentRecord> outputBuffer;
+
+    // Counters.
+    uint64_t numRead;
+    uint64_t numBuffered;
+    uint64_t numRealigned;
+};
+
+void StreamingRealignerImpl::run()
+{
+    std::cerr << "\n"
+              << "__PROCESSING REGIONS (STREAMING)_________________________________\n"
+              << "\n";
+
+    seqan::BamAlignmentRecord record;
+    while (readNextRecord(record, bamFileIn, cramFileIn))
+    {
+        ++numRead;
+        TGenomicPos pos = genomicPos(record.rID, record.beginPos);
+
+        // Close windows that no further record can overlap with, input is sorted by coordinate.
+        while (currentWindow < windows.size() &&
+               genomicPos(windows[currentWindow].region.rID, windows[currentWindow].region.endPos) <= pos)
+            closeWindow();
+
+        if (currentWindow < windows.size() && overlaps(record, windows[currentWindow]))
+        {
+            if (windowRecords.empty() || record.beginPos < windowMinBeginPos)
+                windowMinBeginPos = record.beginPos;
+            windowRecords.push_back(record);
+        }
+        else
+        {
+            bufferRecord(record);
+        }
+
+        // Realigned records cannot move left of the current window or of its records.
+        TGenomicPos watermark = pos;
+        if (currentWindow < windows.size())
+        {
+            RealignmentWindow const & window = windows[currentWindow];
+            watermark = std::min(watermark, genomicPos(window.region.rID, window.region.beginPos));
+            if (!windowRecords.empty())
+                watermark = std::min(watermark, genomicPos(window.region.rID, windowMinBeginPos));
+        }
+        flushRecords(watermark);
+    }
+
+    while (currentWindow < windows.size())
+        closeWindow();
+    flushRecords(genomicPos(-1, seqan::maxValue<int>()));
+
+    std::cerr << " DONE\n";
+    if (options.verbosity >= 1)
+        std::cerr << "    read " << numRead << " records, realigned " << numRealigned << " records in "
+                  << windows.size() << " windows\n";
+}
+
+void StreamingRealignerImpl::closeWindow()
+{
+    RealignmentWindow const & window = windows[currentWindow++];
+    if (windowRecords.empty())
+        return;  // nothing to realign
+
+    seqan::CharString buffer;
+    window.region.toString(buffer);
+    std::cerr << "Processing (#" << currentWindow << ") " << buffer << "\n";
+
+    numRealigned += windowRecords.size();
+    RealignerStepResult result;
+    step.run(result, windowRecords, window);
+
+    {
+        // Records are only buffered here, the time for writing them out is not attributed to the window.
+        StageTimer timer(result.stats, STAGE_WRITE);
+        output.addMoves(result.mateMoves);
+        for (auto & record : result.records)
+            bufferRecord(record);
+        if (!result.msasTxt.empty())
+            msasTxtOut << result.msasTxt;
+        if (!result.msasBin.empty())
+            msasBinOut->write(result.msasBin);
+    }
+    if (!options.statsOutPath.empty() || !options.skippedWindowsOutPath.empty())
+        statsReport.add(result.stats, result.skipReason);
+}
+
+void StreamingRealignerImpl::bufferRecord(seqan::BamAlignmentRecord & record)
+{
+    TOutputKey key((unsigned)record.rID, record.beginPos, numBuffered++);
+    outputBuffer.insert(std::make_pair(key, std::move(record)));
+}
+
+void StreamingRealignerImpl::flushRecords(TGenomicPos watermark)
+{
+    auto it = outputBuffer.begin();
+    for (; it != outputBuffer.end(); ++it)
+    {
+        if (genomicPos(std::get<0>(it->first), std::get<1>(it->first)) >= watermark)
+            break;
+        output.writeRecord(it->second);
+    }
+    outputBuffer.erase(outputBuffer.begin(), it);
+}
+
+// ---------------------------------------------------------------------------
+// Class StreamingRealigner
+// ---------------------------------------------------------------------------
+
+StreamingRealigner::StreamingRealigner(MateFixer & output,
+                                       seqan::VirtualStream<char, seqan::Output> & msasTxtOut,
+                                       MsaDumpWriter * msasBinOut,
+                                       seqan::BamFileIn & bamFileIn,
+                                       CramFileIn * cramFileIn,
+                                       ReferenceProvider & referenceProvider,
+                                       std::vector<RealignmentWindow> const & windows,
+                                       StatsReport & statsReport,
+                                       BamRealignerOptions const & options) :
+        impl(new StreamingRealignerImpl(output, msasTxtOut, msasBinOut, bamFileIn, cramFileIn, referenceProvider,
+                                        windows, statsReport, options))
+{}
+
+StreamingRealigner::~StreamingRealigner()
+{}
+
+void StreamingRealigner::run()
+{
+    impl->run();
+}
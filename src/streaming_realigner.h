@@ -0,0 +1,85 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef STREAMING_REALIGNER_H_
+#define STREAMING_REALIGNER_H_
+
+#include <memory>
+#include <vector>
+
+#include <seqan/seq_io.h>
+#include <seqan/bam_io.h>
+#include <seqan/stream.h>
+
+class BamRealignerOptions;
+class CramFileIn;
+class MateFixer;
+class MsaDumpWriter;
+class RealignmentWindow;
+class ReferenceProvider;
+class StatsReport;
+class StreamingRealignerImpl;
+
+// ---------------------------------------------------------------------------
+// Class StreamingRealigner
+// ---------------------------------------------------------------------------
+
+// Reads the whole input BAM file once from start to end and writes out every record exactly once, in coordinate
+// order.  Records overlapping with the windows are buffered and realigned, each in the first window it overlaps
+// with.  All other records (including the unaligned ones) are passed through.  No BAI index is required.
+
+class StreamingRealigner
+{
+public:
+    // The windows must be sorted as by planWindows().  bamFileIn must be positioned behind the header.  cramFileIn
+    // is nullptr for BAM input, otherwise the records are read from it and bamFileIn only provides the reference
+    // names.  msasBinOut is nullptr if no binary MSA dump was requested.  The stats of the realigned windows are
+    // added to statsReport if options.statsOutPath or options.skippedWindowsOutPath is set.
+    StreamingRealigner(MateFixer & output,
+                       seqan::VirtualStream<char, seqan::Output> & msasTxtOut,
+                       MsaDumpWriter * msasBinOut,
+                       seqan::BamFileIn & bamFileIn,
+                       CramFileIn * cramFileIn,
+                       ReferenceProvider & referenceProvider,
+                       std::vector<RealignmentWindow> const & windows,
+                       StatsReport & statsReport,
+                       BamRealignerOptions const & options);
+    ~StreamingRealigner();  // for pimpl
+    void run();
+
+private:
+    std::unique_ptr<StreamingRealignerImpl> impl;
+};
+
+#endif  // #ifndef STREAMING_REALIGNER_H_
@@ -0,0 +1,398 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "synthetic_dataset.h"
+
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <vector>
+
+#include <seqan/bam_io.h>
+#include <seqan/seq_io.h>
+
+namespace {  // anonymous namespace
+
+// Smallest distance between two indels in the donor genome.
+int const MIN_INDEL_DISTANCE = 20;
+// Indels at most this many bases from a read end are aligned as mismatches.
+unsigned const READ_END_LENGTH = 15;
+// Mapping quality of all records.
+unsigned const MAPPING_QUALITY = 60;
+
+char const BASES[] = "ACGT";
+
+// ---------------------------------------------------------------------------
+// Class Random
+// ---------------------------------------------------------------------------
+
+// Random numbers derived from std::mt19937_64 directly since the output of the std distributions differs between
+// standard library implementations.
+
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : engine(seed)
+    {}
+
+    // Returns a number in [0, n).
+    uint64_t below(uint64_t n)
+    {
+        return engine() % n;
+    }
+
+    // Returns a number in [0, 1).
+    double uniform()
+    {
+        return (engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    char base()
+    {
+        return BASES[below(4)];
+    }
+
+private:
+    std::mt19937_64 engine;
+};
+
+// A simulated indel, begin position and length in the reference (1 for insertions).
+class Indel
+{
+public:
+    int pos;
+    int length;
+
+    Indel(int pos, int length) : pos(pos), length(length)
+    {}
+};
+
+// Returns the BAI bin of the alignment [beginPos, endPos), as in the SAM specification.
+inline unsigned reg2bin(int beginPos, int endPos)
+{
+    --endPos;
+    if (beginPos >> 14 == endPos >> 14)
+        return ((1 << 15) - 1) / 7 + (beginPos >> 14);
+    if (beginPos >> 17 == endPos >> 17)
+        return ((1 << 12) - 1) / 7 + (beginPos >> 17);
+    if (beginPos >> 20 == endPos >> 20)
+        return ((1 << 9) - 1) / 7 + (beginPos >> 20);
+    if (beginPos >> 23 == endPos >> 23)
+        return ((1 << 6) - 1) / 7 + (beginPos >> 23);
+    if (beginPos >> 26 == endPos >> 26)
+        return ((1 << 3) - 1) / 7 + (beginPos >> 26);
+    return 0;
+}
+
+// Append the CIGAR operation, merging with the last one.
+inline void appendCigar(seqan::String<seqan::CigarElement<> > & cigar, char op, unsigned count)
+{
+    if (!empty(cigar) && back(cigar).operation == op)
+        back(cigar).count += count;
+    else
+        appendValue(cigar, seqan::CigarElement<>(op, count));
+}
+
+// ---------------------------------------------------------------------------
+// Class ContigSimulator
+// ---------------------------------------------------------------------------
+
+// Simulates the reference, donor genome, reads and targets of one contig.
+
+class ContigSimulator
+{
+public:
+    ContigSimulator(Random & rng, int rID, SyntheticDatasetOptions const & options) :
+            rng(rng), rID(rID), options(options)
+    {}
+
+    // Simulate reference and donor genome.
+    void simulateGenome();
+    // Append the aligned reads, sorted by position, names are numbered starting with readNo.
+    void simulateReads(std::vector<seqan::BamAlignmentRecord> & records, unsigned readNo);
+    // Append the target intervals [begin, end), sorted by position.
+    void simulateTargets(std::vector<std::pair<int, int>> & targets);
+
+    // The reference sequence.
+    std::string ref;
+
+private:
+    // Compute the alignment of the donor genome's infix [begin, begin + length) to the reference, returns false if
+    // the infix cannot be aligned.
+    bool alignRead(seqan::BamAlignmentRecord & record, unsigned begin, unsigned length);
+
+    Random & rng;
+    int rID;
+    SyntheticDatasetOptions const & options;
+
+    // The donor genome, reference position of each donor base (-1 for inserted bases) and the indels.
+    std::string donor;
+    std::vector<int> donorRefPos;
+    std::vector<Indel> indels;
+};
+
+void ContigSimulator::simulateGenome()
+{
+    ref.resize(options.contigLength);
+    for (auto & c : ref)
+        c = rng.base();
+
+    int lastIndel = -MIN_INDEL_DISTANCE;
+    for (int pos = 0; pos < (int)ref.size(); )
+    {
+        if (pos - lastIndel >= MIN_INDEL_DISTANCE && rng.uniform() < options.indelRate)
+        {
+            int length = 1 + rng.below(options.maxIndelLength);
+            lastIndel = pos;
+            if (rng.below(2) && pos + length < (int)ref.size())
+            {
+                indels.push_back(Indel(pos, length));  // deletion
+                pos += length;
+                continue;
+            }
+            indels.push_back(Indel(pos, 1));  // insertion before pos
+            for (int i = 0; i < length; ++i)
+            {
+                donor.push_back(rng.base());
+                donorRefPos.push_back(-1);
+            }
+        }
+        donor.push_back(ref[pos]);
+        donorRefPos.push_back(pos);
+        ++pos;
+    }
+}
+
+bool ContigSimulator::alignRead(seqan::BamAlignmentRecord & record, unsigned begin, unsigned length)
+{
+    clear(record.cigar);
+    int prevRefPos = -1, lastRefPos = -1;
+    std::vector<unsigned> indelOffsets;  // read offsets of the indels
+    for (unsigned i = 0; i < length; ++i)
+    {
+        int refPos = donorRefPos[begin + i];
+        if (refPos < 0)
+        {
+            if (prevRefPos >= 0 && back(record.cigar).operation != 'I')
+                indelOffsets.push_back(i);
+            appendCigar(record.cigar, (prevRefPos < 0) ? 'S' : 'I', 1);
+            continue;
+        }
+        if (prevRefPos < 0)
+        {
+            record.beginPos = refPos;
+        }
+        else if (refPos > prevRefPos + 1)
+        {
+            indelOffsets.push_back(i);
+            appendCigar(record.cigar, 'D', refPos - prevRefPos - 1);
+        }
+        appendCigar(record.cigar, 'M', 1);
+        prevRefPos = lastRefPos = refPos;
+    }
+    if (lastRefPos < 0)
+        return false;  // only inserted bases
+    if (back(record.cigar).operation == 'I')
+    {
+        back(record.cigar).operation = 'S';
+        if (!indelOffsets.empty() && donorRefPos[begin + indelOffsets.back()] < 0)
+            indelOffsets.pop_back();
+    }
+
+    // Align indels close to one read end as mismatches.
+    if (!indelOffsets.empty() && (indelOffsets.front() + READ_END_LENGTH >= length ||
+                                  indelOffsets.back() < READ_END_LENGTH))
+    {
+        if (indelOffsets.back() < READ_END_LENGTH)
+            record.beginPos = lastRefPos + 1 - (int)length;
+        if (record.beginPos < 0 || record.beginPos + length > ref.size())
+            return true;  // keep gapped alignment at the contig ends
+        clear(record.cigar);
+        appendCigar(record.cigar, 'M', length);
+    }
+    return true;
+}
+
+void ContigSimulator::simulateReads(std::vector<seqan::BamAlignmentRecord> & records, unsigned readNo)
+{
+    if (donor.size() < options.readLength)
+        return;
+
+    uint64_t numReads = options.coverage * donor.size() / options.readLength;
+    std::vector<seqan::BamAlignmentRecord> contigRecords;
+    for (uint64_t i = 0; i < numReads; ++i)
+    {
+        seqan::BamAlignmentRecord record;
+        unsigned begin = rng.below(donor.size() - options.readLength + 1);
+        if (!alignRead(record, begin, options.readLength))
+            continue;
+
+        std::string seq = donor.substr(begin, options.readLength);
+        for (auto & c : seq)
+            if (rng.uniform() < options.errorRate)
+                c = BASES[(std::find(BASES, BASES + 4, c) - BASES + 1 + rng.below(3)) % 4];
+
+        record.qName = "read" + std::to_string(readNo + i);
+        record.flag = rng.below(2) ? seqan::BAM_FLAG_RC : 0;
+        record.rID = rID;
+        record.mapQ = MAPPING_QUALITY;
+        record.seq = seq;
+        record.qual = std::string(seq.size(), 'I');
+        record.bin = reg2bin(record.beginPos, record.beginPos + getAlignmentLengthInRef(record));
+        contigRecords.push_back(record);
+    }
+
+    std::stable_sort(contigRecords.begin(), contigRecords.end(),
+                     [](seqan::BamAlignmentRecord const & lhs, seqan::BamAlignmentRecord const & rhs) {
+                         return lhs.beginPos < rhs.beginPos;
+                     });
+    for (auto & record : contigRecords)
+        records.push_back(std::move(record));
+}
+
+void ContigSimulator::simulateTargets(std::vector<std::pair<int, int>> & targets)
+{
+    unsigned numTargets = options.targetsPerMbp * ref.size() / 1e6;
+
+    // Shuffle indels and take the first ones, then fill up with random positions.
+    std::vector<Indel> candidates = indels;
+    for (unsigned i = candidates.size(); i > 1; --i)
+        std::swap(candidates[i - 1], candidates[rng.below(i)]);
+    std::vector<std::pair<int, int>> contigTargets;
+    for (unsigned i = 0; i < numTargets; ++i)
+    {
+        if (i < candidates.size())
+        {
+            contigTargets.push_back(std::make_pair(candidates[i].pos, candidates[i].pos + candidates[i].length));
+        }
+        else
+        {
+            int pos = rng.below(ref.size());
+            contigTargets.push_back(std::make_pair(pos, pos + 1));
+        }
+    }
+    std::sort(contigTargets.begin(), contigTargets.end());
+    targets.insert(targets.end(), contigTargets.begin(), contigTargets.end());
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function generateSyntheticDataset()
+// ---------------------------------------------------------------------------
+
+void generateSyntheticDataset(SyntheticDataset & result,
+                              std::string const & prefix,
+                              SyntheticDatasetOptions const & options)
+{
+    result.referencePath = prefix + "ref.fa";
+    result.alignmentPath = prefix + "reads.bam";
+    result.intervalsPath = prefix + "targets.intervals";
+
+    Random rng(options.seed);
+    std::vector<std::string> names;
+    std::vector<std::string> seqs;
+    std::vector<seqan::BamAlignmentRecord> records;
+    std::vector<std::vector<std::pair<int, int>>> targets(options.numContigs);
+    for (unsigned rID = 0; rID < options.numContigs; ++rID)
+    {
+        ContigSimulator simulator(rng, rID, options);
+        simulator.simulateGenome();
+        simulator.simulateReads(records, records.size());
+        simulator.simulateTargets(targets[rID]);
+        names.push_back("chr" + std::to_string(rID + 1));
+        seqs.push_back(simulator.ref);
+    }
+    result.numRecords = records.size();
+
+    // Write reference and build FAI index.
+    {
+        seqan::SeqFileOut seqFileOut;
+        if (!open(seqFileOut, result.referencePath.c_str()))
+            throw seqan::IOError("Could not open synthetic reference file.");
+        for (unsigned rID = 0; rID < names.size(); ++rID)
+            writeRecord(seqFileOut, names[rID], seqs[rID]);
+    }
+    seqan::FaiIndex faiIndex;
+    if (!build(faiIndex, result.referencePath.c_str()) || !save(faiIndex))
+        throw seqan::IOError("Could not build synthetic reference .fai index.");
+
+    // Write BAM file and build BAI index.
+    {
+        seqan::BamFileOut bamFileOut;
+        if (!open(bamFileOut, result.alignmentPath.c_str()))
+            throw seqan::IOError("Could not open synthetic BAM file.");
+
+        seqan::BamHeader header;
+        seqan::BamHeaderRecord headerRecord;
+        headerRecord.type = seqan::BAM_HEADER_FIRST;
+        appendValue(headerRecord.tags, seqan::Pair<seqan::CharString>("VN", "1.4"));
+        appendValue(headerRecord.tags, seqan::Pair<seqan::CharString>("SO", "coordinate"));
+        appendValue(header, headerRecord);
+        for (unsigned rID = 0; rID < names.size(); ++rID)
+        {
+            clear(headerRecord.tags);
+            headerRecord.type = seqan::BAM_HEADER_REFERENCE;
+            appendValue(headerRecord.tags, seqan::Pair<seqan::CharString>("SN", names[rID]));
+            appendValue(headerRecord.tags,
+                        seqan::Pair<seqan::CharString>("LN", std::to_string(seqs[rID].size())));
+            appendValue(header, headerRecord);
+
+            appendValue(contigNames(context(bamFileOut)), names[rID]);
+            appendValue(contigLengths(context(bamFileOut)), seqs[rID].size());
+        }
+        writeRecord(bamFileOut, header);
+        for (auto const & record : records)
+            writeRecord(bamFileOut, record);
+    }
+    seqan::BamIndex<seqan::Bai> baiIndex;
+    std::string baiPath = result.alignmentPath + ".bai";
+    if (!build(baiIndex, result.alignmentPath.c_str()) || !save(baiIndex, baiPath.c_str()))
+        throw seqan::IOError("Could not build synthetic BAM .bai index.");
+
+    // Write Picard-style intervals file, 1-based and inclusive.
+    std::ofstream intervalsOut(result.intervalsPath.c_str(), std::ios::binary | std::ios::out);
+    intervalsOut << "@HD\tVN:1.4\tSO:coordinate\n";
+    for (unsigned rID = 0; rID < names.size(); ++rID)
+        intervalsOut << "@SQ\tSN:" << names[rID] << "\tLN:" << seqs[rID].size() << "\n";
+    result.numTargets = 0;
+    for (unsigned rID = 0; rID < names.size(); ++rID)
+        for (auto const & target : targets[rID])
+        {
+            intervalsOut << names[rID] << "\t" << (target.first + 1) << "\t" << target.second << "\t+\ttarget"
+                         << ++result.numTargets << "\n";
+        }
+    if (!intervalsOut.good())
+        throw seqan::IOError("Could not write synthetic intervals file.");
+}
@@ -0,0 +1,105 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef SYNTHETIC_DATASET_H_
+#define SYNTHETIC_DATASET_H_
+
+#include <string>
+
+// ---------------------------------------------------------------------------
+// Class SyntheticDatasetOptions
+// ---------------------------------------------------------------------------
+
+// Parameters of a synthetic dataset, the same parameters always give the same dataset.
+
+class SyntheticDatasetOptions
+{
+public:
+    // Seed for the random number generator.
+    unsigned seed;
+    // Number and length of the reference contigs.
+    unsigned numContigs;
+    unsigned contigLength;
+    // Length of the reads and average coverage.
+    unsigned readLength;
+    double coverage;
+    // Probability of an indel starting at a reference position and largest indel length.
+    double indelRate;
+    unsigned maxIndelLength;
+    // Probability of a sequencing error per base.
+    double errorRate;
+    // Number of target intervals per million reference bases, placed on the indels first.
+    double targetsPerMbp;
+
+    SyntheticDatasetOptions() :
+            seed(42), numContigs(2), contigLength(1000 * 1000), readLength(100), coverage(30), indelRate(0.0005),
+            maxIndelLength(6), errorRate(0.001), targetsPerMbp(200)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Class SyntheticDataset
+// ---------------------------------------------------------------------------
+
+// The files of a generated dataset.
+
+class SyntheticDataset
+{
+public:
+    // Paths to the reference FASTA file (with .fai), sorted BAM file (with .bai) and Picard-style intervals file.
+    std::string referencePath;
+    std::string alignmentPath;
+    std::string intervalsPath;
+
+    // Number of records and number of target intervals.
+    unsigned numRecords;
+    unsigned numTargets;
+
+    SyntheticDataset() : numRecords(0), numTargets(0)
+    {}
+};
+
+// ---------------------------------------------------------------------------
+// Function generateSyntheticDataset()
+// ---------------------------------------------------------------------------
+
+// Generate a dataset with files starting with prefix.  The reads are sampled from a donor genome with random indels
+// and sequencing errors and are aligned at their true positions, except that indels close to a read end are aligned
+// as mismatches, as short read aligners tend to do.  Throws seqan::IOError on errors.
+
+void generateSyntheticDataset(SyntheticDataset & result,
+                              std::string const & prefix,
+                              SyntheticDatasetOptions const & options);
+
+#endif  // #ifndef SYNTHETIC_DATASET_H_
@@ -0,0 +1,287 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "target_discoverer.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+#include <seqan/stream.h>
+
+#include "bam_realigner_options.h"
+#include "cram_io.h"
+#include "reference_provider.h"
+
+namespace {  // anonymous namespace
+
+// Columns with at least this many bases and at least this fraction of them mismatching the reference are mismatch
+// sites.
+unsigned const MIN_MISMATCH_COVERAGE = 4;
+double const MIN_MISMATCH_FRACTION = 0.15;
+// Events (indels and mismatch sites) at most this far apart form one target.
+int const EVENT_MERGE_DISTANCE = 10;
+// Targets with only mismatch sites need at least this many of them.
+unsigned const MIN_MISMATCH_SITES = 2;
+// Targets spanning more than this many bases are dropped, they are more likely repeats than misaligned indels.
+int const MAX_TARGET_SPAN = 500;
+
+// Returns whether c is one of ACGT (in upper or lower case).
+inline bool isBase(char c)
+{
+    c &= ~0x20;  // to upper case
+    return c == 'A' || c == 'C' || c == 'G' || c == 'T';
+}
+
+// ---------------------------------------------------------------------------
+// Class TargetDiscoverer
+// ---------------------------------------------------------------------------
+
+// Counts the bases and mismatches per column for the records added in coordinate order.  A column is final once a
+// record begins right of it; the final columns and the indels left of the current record are passed on in
+// position order to the clustering, which writes targets.
+
+class TargetDiscoverer
+{
+public:
+    TargetDiscoverer(std::vector<seqan::GenomicRegion> & targets, ReferenceProvider & referenceProvider) :
+            targets(targets), referenceProvider(referenceProvider), columnsBegin(0), clusterBegin(0),
+            clusterEnd(0), clusterHasIndel(false), numClusterMismatchSites(0)
+    {}
+
+    // Add record, which must not begin left of the previous one on the same contig.
+    void addRecord(seqan::BamAlignmentRecord const & record, seqan::CharString const & seqName);
+    // Finish the current contig.
+    void finish();
+
+private:
+
+    // Base and mismatch count of a column.
+    struct Column
+    {
+        unsigned coverage;
+        unsigned mismatches;
+
+        Column() : coverage(0), mismatches(0)
+        {}
+    };
+
+    // Pass on the columns and indels left of pos.
+    void flush(int pos);
+    // Add an event in [beginPos, endPos) to the clustering, in position order.
+    void addEvent(int beginPos, int endPos, bool isIndel);
+    // Write the current cluster to targets if it is a target.
+    void closeCluster();
+
+    std::vector<seqan::GenomicRegion> & targets;
+    ReferenceProvider & referenceProvider;
+
+    // The current contig.
+    seqan::GenomicRegion contig;
+    // The columns from position columnsBegin on.
+    std::deque<Column> columns;
+    int columnsBegin;
+    // The indels not passed on yet, end position by begin position.
+    std::map<int, int> indels;
+    // The current cluster of events.
+    int clusterBegin;
+    int clusterEnd;
+    bool clusterHasIndel;
+    unsigned numClusterMismatchSites;
+
+    // Buffer for the reference of a record.
+    seqan::Dna5String ref;
+};
+
+void TargetDiscoverer::addRecord(seqan::BamAlignmentRecord const & record, seqan::CharString const & seqName)
+{
+    if (record.rID != contig.rID)
+    {
+        finish();
+        contig.rID = record.rID;
+        contig.seqName = seqName;
+        columnsBegin = record.beginPos;
+    }
+    flush(record.beginPos);
+
+    // Load the reference and extend the columns to the record's end.
+    int endPos = record.beginPos + getAlignmentLengthInRef(record);
+    seqan::GenomicRegion region = contig;
+    region.beginPos = record.beginPos;
+    region.endPos = endPos;
+    referenceProvider.getRegion(ref, region);
+    if (endPos > columnsBegin + (int)columns.size())
+        columns.resize(endPos - columnsBegin);
+
+    int refPos = record.beginPos;
+    unsigned readPos = 0;
+    for (unsigned i = 0; i < length(record.cigar); ++i)
+    {
+        auto const & el = record.cigar[i];
+        switch (el.operation)
+        {
+            case 'M':
+            case '=':
+            case 'X':
+                for (unsigned j = 0; j < el.count; ++j, ++refPos, ++readPos)
+                {
+                    unsigned offset = refPos - record.beginPos;
+                    if (offset >= length(ref) || readPos >= length(record.seq))
+                        continue;
+                    char readBase = static_cast<char>(record.seq[readPos]);
+                    char refBase = static_cast<char>(ref[offset]);
+                    if (!isBase(readBase) || !isBase(refBase))
+                        continue;
+                    Column & column = columns[refPos - columnsBegin];
+                    column.coverage += 1;
+                    column.mismatches += ((readBase & ~0x20) != (refBase & ~0x20));
+                }
+                break;
+            case 'I':
+                indels[refPos] = std::max(indels[refPos], refPos + 1);
+                readPos += el.count;
+                break;
+            case 'D':
+                indels[refPos] = std::max(indels[refPos], refPos + (int)el.count);
+                refPos += el.count;
+                break;
+            case 'N':
+                refPos += el.count;
+                break;
+            case 'S':
+                readPos += el.count;
+                break;
+            default:  // 'H', 'P'
+                break;
+        }
+    }
+}
+
+void TargetDiscoverer::finish()
+{
+    if (contig.rID == seqan::GenomicRegion::INVALID_ID)
+        return;
+    flush(seqan::maxValue<int>());
+    closeCluster();
+    columns.clear();
+    indels.clear();
+}
+
+// The columns and the indels left of pos are merged by position.  Indels are added before the column they start
+// at, an indel always spans its column so the order within a position does not change the clusters.
+
+void TargetDiscoverer::flush(int pos)
+{
+    auto it = indels.begin();
+    for (; !columns.empty() && columnsBegin < pos; ++columnsBegin)
+    {
+        for (; it != indels.end() && it->first <= columnsBegin; ++it)
+            addEvent(it->first, it->second, true);
+        Column const & column = columns.front();
+        if (column.coverage >= MIN_MISMATCH_COVERAGE && column.mismatches >= MIN_MISMATCH_FRACTION * column.coverage)
+            addEvent(columnsBegin, columnsBegin + 1, false);
+        columns.pop_front();
+    }
+    for (; it != indels.end() && it->first < pos; ++it)
+        addEvent(it->first, it->second, true);
+    indels.erase(indels.begin(), it);
+    if (columns.empty())
+        columnsBegin = std::max(columnsBegin, pos);
+}
+
+void TargetDiscoverer::addEvent(int beginPos, int endPos, bool isIndel)
+{
+    if (clusterEnd == 0 || beginPos > clusterEnd + EVENT_MERGE_DISTANCE)
+    {
+        closeCluster();
+        clusterBegin = beginPos;
+    }
+    clusterEnd = std::max(clusterEnd, endPos);
+    clusterHasIndel = clusterHasIndel || isIndel;
+    numClusterMismatchSites += !isIndel;
+}
+
+void TargetDiscoverer::closeCluster()
+{
+    if (clusterEnd != 0 && (clusterHasIndel || numClusterMismatchSites >= MIN_MISMATCH_SITES) &&
+        clusterEnd - clusterBegin <= MAX_TARGET_SPAN)
+    {
+        seqan::GenomicRegion target = contig;
+        target.beginPos = clusterBegin;
+        target.endPos = clusterEnd;
+        targets.push_back(target);
+    }
+    clusterBegin = clusterEnd = 0;
+    clusterHasIndel = false;
+    numClusterMismatchSites = 0;
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function discoverTargets()
+// ---------------------------------------------------------------------------
+
+// As RealignerTargetCreator, unmapped, secondary, duplicate and QC failed records and records with mapping quality 0
+// are ignored.
+
+uint64_t discoverTargets(std::vector<seqan::GenomicRegion> & targets,
+                         seqan::BamFileIn & bamFileIn,
+                         CramFileIn * cramFileIn,
+                         ReferenceProvider & referenceProvider,
+                         BamRealignerOptions const & options)
+{
+    TargetDiscoverer discoverer(targets, referenceProvider);
+    seqan::BamAlignmentRecord record;
+    uint64_t numUsed = 0;
+    int prevRID = seqan::BamAlignmentRecord::INVALID_REFID, prevBeginPos = 0;
+    while (readNextRecord(record, bamFileIn, cramFileIn))
+    {
+        if (hasFlagUnmapped(record) || hasFlagSecondary(record) || hasFlagDuplicate(record) ||
+            hasFlagQCNoPass(record) || record.mapQ == 0 || record.rID == seqan::BamAlignmentRecord::INVALID_REFID)
+            continue;
+        if (record.rID < prevRID || (record.rID == prevRID && record.beginPos < prevBeginPos))
+            throw seqan::IOError("Input BAM file is not sorted by coordinate.");
+        prevRID = record.rID;
+        prevBeginPos = record.beginPos;
+
+        discoverer.addRecord(record, contigNames(context(bamFileIn))[record.rID]);
+        ++numUsed;
+    }
+    discoverer.finish();
+
+    if (options.verbosity >= 2)
+        std::cerr << "    Used " << numUsed << " records for target discovery\n";
+    return numUsed;
+}
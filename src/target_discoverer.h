@@ -0,0 +1,63 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef TARGET_DISCOVERER_H_
+#define TARGET_DISCOVERER_H_
+
+#include <vector>
+
+#include <seqan/bam_io.h>
+#include <seqan/seq_io.h>
+
+class BamRealignerOptions;
+class CramFileIn;
+class ReferenceProvider;
+
+// ---------------------------------------------------------------------------
+// Function discoverTargets()
+// ---------------------------------------------------------------------------
+
+// Read the records of the coordinate-sorted bamFileIn (positioned behind the header) once and append the regions
+// that need realignment to targets, in the manner of GATK's RealignerTargetCreator: regions where records have
+// insertions or deletions and clusters of columns with many mismatches against the reference.  Returns the number of
+// records used.  For CRAM input, the records are read from cramFileIn (not nullptr) and bamFileIn only provides the
+// reference names.  Throws seqan::IOError on errors.
+
+uint64_t discoverTargets(std::vector<seqan::GenomicRegion> & targets,
+                         seqan::BamFileIn & bamFileIn,
+                         CramFileIn * cramFileIn,
+                         ReferenceProvider & referenceProvider,
+                         BamRealignerOptions const & options);
+
+#endif  // #ifndef TARGET_DISCOVERER_H_
@@ -0,0 +1,164 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#include "target_reader.h"
+
+#include <algorithm>
+
+#include <seqan/bed_io.h>
+#include <seqan/simple_intervals_io.h>
+#include <seqan/stream.h>
+#include <seqan/vcf_io.h>
+
+namespace {  // anonymous namespace
+
+// Returns whether path ends with suffix.
+inline bool endsWith(std::string const & path, std::string const & suffix)
+{
+    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Set rID of region from its seqName and the reference names of bamFileIn.
+void setRefId(seqan::GenomicRegion & region, seqan::BamFileIn & bamFileIn)
+{
+    if (!getIdByName(region.rID, nameStoreCache(context(bamFileIn)), region.seqName))
+    {
+        std::string msg = std::string("Unknown reference ")  + toCString(region.seqName);
+        throw seqan::IOError(msg.c_str());
+    }
+}
+
+void readIntervals(std::vector<seqan::GenomicRegion> & targets, std::string const & path, seqan::BamFileIn & bamFileIn)
+{
+    seqan::SimpleIntervalsFileIn intervalsFileIn;
+    if (!open(intervalsFileIn, path.c_str()))
+        throw seqan::IOError("Could not open intervals file.");
+
+    seqan::GenomicRegion region;
+    while (!atEnd(intervalsFileIn))
+    {
+        readRecord(region, intervalsFileIn);
+        setRefId(region, bamFileIn);
+        targets.push_back(region);
+    }
+}
+
+void readBed(std::vector<seqan::GenomicRegion> & targets, std::string const & path, seqan::BamFileIn & bamFileIn)
+{
+    seqan::BedFileIn bedFileIn;
+    if (!open(bedFileIn, path.c_str()))
+        throw seqan::IOError("Could not open BED file.");
+
+    seqan::BedRecord<seqan::Bed3> record;
+    seqan::GenomicRegion region;
+    while (!atEnd(bedFileIn))
+    {
+        readRecord(record, bedFileIn);
+        region.seqName = record.ref;
+        region.beginPos = record.beginPos;
+        region.endPos = record.endPos;
+        setRefId(region, bamFileIn);
+        targets.push_back(region);
+    }
+}
+
+// Each indel record gives the region of its reference allele, which includes the base before the indel.  A record is
+// an indel if the reference allele or one of the alternative alleles has a different length than the others.
+// Symbolic alleles ("<DEL>") and breakends are skipped.
+
+void readVcf(std::vector<seqan::GenomicRegion> & targets, std::string const & path, seqan::BamFileIn & bamFileIn)
+{
+    seqan::VcfFileIn vcfFileIn;
+    if (!open(vcfFileIn, path.c_str()))
+        throw seqan::IOError("Could not open VCF file.");
+    seqan::VcfHeader header;
+    readHeader(header, vcfFileIn);
+
+    seqan::VcfRecord record;
+    seqan::GenomicRegion region;
+    while (!atEnd(vcfFileIn))
+    {
+        readRecord(record, vcfFileIn);
+
+        bool isIndel = false;
+        std::string alt = toCString(record.alt);
+        if (alt.find_first_of("<[]") != std::string::npos)
+            continue;
+        for (size_t begin = 0, end = 0; begin <= alt.size(); begin = end + 1)
+        {
+            end = std::min(alt.find(',', begin), alt.size());
+            isIndel = isIndel || (end - begin != length(record.ref));
+        }
+        if (!isIndel)
+            continue;
+
+        region.seqName = contigNames(context(vcfFileIn))[record.rID];
+        region.beginPos = record.beginPos;
+        region.endPos = record.beginPos + length(record.ref);
+        setRefId(region, bamFileIn);
+        targets.push_back(region);
+    }
+}
+
+}  // anonymous namespace
+
+// ---------------------------------------------------------------------------
+// Function targetFileExtensions()
+// ---------------------------------------------------------------------------
+
+std::vector<std::string> targetFileExtensions()
+{
+    std::vector<std::string> result = seqan::SimpleIntervalsFileIn::getFileExtensions();
+    for (auto const & ext : seqan::BedFileIn::getFileExtensions())
+        result.push_back(ext);
+    for (auto const & ext : seqan::VcfFileIn::getFileExtensions())
+        result.push_back(ext);
+    return result;
+}
+
+// ---------------------------------------------------------------------------
+// Function readTargets()
+// ---------------------------------------------------------------------------
+
+void readTargets(std::vector<seqan::GenomicRegion> & targets,
+                 std::string const & path,
+                 seqan::BamFileIn & bamFileIn)
+{
+    if (endsWith(path, ".bed") || endsWith(path, ".bed.gz"))
+        readBed(targets, path, bamFileIn);
+    else if (endsWith(path, ".vcf") || endsWith(path, ".vcf.gz"))
+        readVcf(targets, path, bamFileIn);
+    else
+        readIntervals(targets, path, bamFileIn);
+}
@@ -0,0 +1,64 @@
+// ==========================================================================
+//                               BAM Realigner
+// ==========================================================================
+// Copyright (c) 2014, Manuel Holtgrewe
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Knut Reinert or the FU Berlin nor the names of
+//       its contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL KNUT REINERT OR THE FU BERLIN BE LIABLE
+// FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+// SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+// DAMAGE.
+//
+// ==========================================================================
+// Author: Manuel Holtgrewe <manuel.holtgrewe@fu-berlin.de>
+// ==========================================================================
+
+#ifndef TARGET_READER_H_
+#define TARGET_READER_H_
+
+#include <string>
+#include <vector>
+
+#include <seqan/bam_io.h>
+#include <seqan/seq_io.h>
+
+// ---------------------------------------------------------------------------
+// Function targetFileExtensions()
+// ---------------------------------------------------------------------------
+
+// Returns the file extensions accepted by readTargets().
+
+std::vector<std::string> targetFileExtensions();
+
+// ---------------------------------------------------------------------------
+// Function readTargets()
+// ---------------------------------------------------------------------------
+
+// Append the target regions of the file at path to targets, with rID set from the reference names of bamFileIn.
+// The format is chosen by the extension: BED (.bed), the indel sites of a VCF file (.vcf, .vcf.gz; SNPs are skipped)
+// or Picard-style intervals (all others).  Throws seqan::IOError on errors and for unknown references.
+
+void readTargets(std::vector<seqan::GenomicRegion> & targets,
+                 std::string const & path,
+                 seqan::BamFileIn & bamFileIn);
+
+#endif  // #ifndef TARGET_READER_H_
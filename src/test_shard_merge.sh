@@ -0,0 +1,58 @@
+#!/bin/sh
+# ==========================================================================
+#                               BAM Realigner
+# ==========================================================================
+# Runs the realigner on a synthetic dataset once without sharding and once as
+# N shard processes, merges the shard BAM files and checks that the merged
+# file has the same content as the unsharded one.
+#
+# Mates in windows of other shards are not updated (see README.md), so both
+# runs only update mates in the same window (--mate-fix-distance 0).
+#
+# Usage: test_shard_merge.sh BAM_REALIGNER BAM_REALIGNER_BENCH WORK_DIR [N]
+# ==========================================================================
+
+set -e
+
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 BAM_REALIGNER BAM_REALIGNER_BENCH WORK_DIR [N]" >&2
+    exit 2
+fi
+REALIGNER=$1
+BENCH=$2
+DIR=$3
+N=${4:-4}
+
+# Generate the dataset, the benchmark's own run is not needed.
+mkdir -p "$DIR"
+"$BENCH" -q --out-dir "$DIR" --contigs 2 --contig-length 200000 --coverage 20 > /dev/null
+
+set -- --in-reference "$DIR/ref.fa" --in-alignment "$DIR/reads.bam" --in-intervals "$DIR/targets.intervals" \
+       --mate-fix-distance 0 -q
+
+"$REALIGNER" "$@" --out-alignment "$DIR/unsharded.bam"
+
+# Run the shards as separate processes.
+PIDS=
+SHARDS=
+i=1
+while [ $i -le $N ]; do
+    "$REALIGNER" "$@" --shard $i/$N --out-alignment "$DIR/shard$i.bam" &
+    PIDS="$PIDS $!"
+    SHARDS="$SHARDS $DIR/shard$i.bam"
+    i=$((i + 1))
+done
+for PID in $PIDS; do
+    wait $PID
+done
+
+"$REALIGNER" merge -q --out-alignment "$DIR/merged.bam" $SHARDS
+
+# BGZF files are gzip files, compare the uncompressed BAM data.
+gzip -dc "$DIR/unsharded.bam" > "$DIR/unsharded.raw"
+gzip -dc "$DIR/merged.bam" > "$DIR/merged.raw"
+if ! cmp -s "$DIR/unsharded.raw" "$DIR/merged.raw"; then
+    echo "Merged output of $N shards differs from the unsharded output." >&2
+    exit 1
+fi
+echo "Merged output of $N shards is the same as the unsharded output."